@@ -0,0 +1,157 @@
+/* =============================================================================
+ *
+ * Title:         Channel access benchmark
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Accesses and encodes the readings of a sensor once
+ *                through the values() map and once through channels() and
+ *                readings(), and counts time and allocations per readout.
+ *                Run by "make bench"
+ *
+ * =============================================================================
+ */
+
+
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include <map>
+#include <string>
+
+#include "sensor.hpp"
+#include "encoder.hpp"
+#include "scheduler.hpp"
+
+
+using namespace std;
+using namespace sensors;
+using namespace meteo;
+
+static long allocations = 0;
+
+void* operator new(size_t size) {
+	allocations++;
+	void *ptr = ::malloc(size == 0 ? 1 : size);
+	if(ptr == NULL) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size) {
+	allocations++;
+	void *ptr = ::malloc(size == 0 ? 1 : size);
+	if(ptr == NULL) throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept { ::free(ptr); }
+void operator delete[](void *ptr) noexcept { ::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { ::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { ::free(ptr); }
+
+
+/** Sensor without a bus with the channels of a BMP180 */
+class FakeSensor : public Sensor {
+private:
+	float _readings[3];
+public:
+	FakeSensor() : Sensor("/dev/null", 0x77) {
+		this->_readings[0] = 21.5F;
+		this->_readings[1] = 1013.25F;
+		this->_readings[2] = 540.0F;
+	}
+	virtual int read(void) { return 0; }
+	virtual size_t channelCount(void) const { return 3; }
+	virtual const Channel* channels(void) const {
+		static const Channel channels[] = { {"t", "C", CHANNEL_TEMPERATURE, 0}, {"p", "hPa", CHANNEL_PRESSURE, 1}, {"alt", "m", CHANNEL_ALTITUDE, 2} };
+		return channels;
+	}
+	virtual const float* readings(void) const { return this->_readings; }
+	virtual int init(void) { return 0; }
+};
+
+/** Readouts of one access path */
+struct Result {
+	/** Duration per readout [ns] */
+	double duration;
+	/** Allocations per readout */
+	double allocations;
+	/** Encoded bytes of the last readout, to compare both paths */
+	size_t bytes;
+	/** Sum of the readings, so that the access is not optimized away */
+	double sum;
+};
+
+/** Reads the readings through values(), encodes them if an encoder is given */
+static Result readMap(const Sensor &sensor, JsonEncoder *encoder, long iterations) {
+	Result result;
+	result.sum = 0.0;
+	const long allocated = allocations;
+	const long long start = monotonic_ns();
+	for(long i = 0; i < iterations; i++) {
+		if(encoder != NULL) encoder->begin();
+		const std::map<std::string, float> values = sensor.values();
+		for(std::map<std::string, float>::const_iterator it = values.begin(); it != values.end(); ++it) {
+			result.sum += it->second;
+			if(encoder != NULL) encoder->field(it->first.c_str(), it->second);
+		}
+		if(encoder != NULL) encoder->end();
+	}
+	result.duration = (double)(monotonic_ns() - start) / iterations;
+	result.allocations = (double)(allocations - allocated) / iterations;
+	result.bytes = (encoder != NULL ? encoder->size() : 0);
+	return result;
+}
+
+/** Reads the readings through channels() and readings(), encodes them if an encoder is given */
+static Result readChannels(const Sensor &sensor, JsonEncoder *encoder, long iterations) {
+	Result result;
+	result.sum = 0.0;
+	const long allocated = allocations;
+	const long long start = monotonic_ns();
+	for(long i = 0; i < iterations; i++) {
+		if(encoder != NULL) encoder->begin();
+		const Channel *channels = sensor.channels();
+		for(size_t c = 0; c < sensor.channelCount(); c++) {
+			const float value = sensor.reading(channels[c]);
+			result.sum += value;
+			if(encoder != NULL) encoder->field(sensor.prefix(), channels[c].name, value);
+		}
+		if(encoder != NULL) encoder->end();
+	}
+	result.duration = (double)(monotonic_ns() - start) / iterations;
+	result.allocations = (double)(allocations - allocated) / iterations;
+	result.bytes = (encoder != NULL ? encoder->size() : 0);
+	return result;
+}
+
+int main(int argc, char** argv) {
+	const long iterations = (argc > 1 ? atol(argv[1]) : 200000L);
+	FakeSensor sensor;
+	JsonEncoder encoder(1024);
+
+	cout << "Channels: " << iterations << " readouts of " << sensor.channelCount() << " channels" << endl;
+	// Warm-up of the allocator and the caches
+	readMap(sensor, &encoder, iterations / 10);
+	readChannels(sensor, &encoder, iterations / 10);
+
+	const char* prefixes[] = { "", "out_" };
+	bool slower = false;
+	for(size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+		sensor.setPrefix(prefixes[i]);
+		for(int encode = 0; encode <= 1; encode++) {
+			JsonEncoder *enc = (encode ? &encoder : NULL);
+			const Result map = readMap(sensor, enc, iterations);
+			const Result flat = readChannels(sensor, enc, iterations);
+			cout << "  " << (encode ? "encode" : "access") << ", prefix \"" << prefixes[i] << "\": values() " << map.duration << " ns, " << map.allocations << " allocations";
+			cout << ", channels() " << flat.duration << " ns, " << flat.allocations << " allocations per readout" << endl;
+			if(map.bytes != flat.bytes || map.sum != flat.sum) cerr << "bench_channels: Both paths differ" << endl;
+			if(flat.duration >= map.duration || flat.allocations > 0) slower = true;
+		}
+	}
+	if(slower) {
+		cerr << "bench_channels: channels() is not cheaper than values()" << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,161 @@
+/* =============================================================================
+ *
+ * Title:         Snapshot contention benchmark
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Many reader threads against one writer of the latest
+ *                readout of a sensor: the sequence lock of
+ *                Sensor::snapshot() against a mutex-protected copy.
+ *                Run by "make bench"
+ *
+ * =============================================================================
+ */
+
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include <string.h>
+
+#include "sensor.hpp"
+#include "scheduler.hpp"
+
+
+using namespace std;
+using namespace sensors;
+using namespace meteo;
+
+/** Sensor without a bus, the writer sets its readings directly */
+class FakeSensor : public Sensor {
+public:
+	float _readings[3];
+
+	FakeSensor() : Sensor("/dev/null", 0) {
+		for(int i = 0; i < 3; i++) this->_readings[i] = 0.0F;
+	}
+	virtual int read(void) { return 0; }
+	virtual size_t channelCount(void) const { return 3; }
+	virtual const Channel* channels(void) const {
+		static const Channel channels[] = { {"t", "C", CHANNEL_TEMPERATURE, 0}, {"p", "hPa", CHANNEL_PRESSURE, 1}, {"hum", "%rel", CHANNEL_HUMIDITY, 2} };
+		return channels;
+	}
+	virtual const float* readings(void) const { return this->_readings; }
+	virtual int init(void) { return 0; }
+};
+
+/** Snapshot behind a mutex, as the readouts were shared before the sequence lock */
+class LockedSnapshot {
+private:
+	mutable std::mutex _mutex;
+	Snapshot _snapshot;
+public:
+	LockedSnapshot() { memset(&this->_snapshot, 0, sizeof(this->_snapshot)); }
+	void store(const Snapshot &snapshot) {
+		std::lock_guard<std::mutex> lock(this->_mutex);
+		this->_snapshot = snapshot;
+	}
+	Snapshot load(void) const {
+		std::lock_guard<std::mutex> lock(this->_mutex);
+		return this->_snapshot;
+	}
+};
+
+/** Every store writes the same number into all fields, so a mixed copy is a torn read */
+static bool torn(const Snapshot &snapshot) {
+	const long long n = snapshot.monotonic;
+	for(uint32_t i = 0; i < 3; i++)
+		if(snapshot.values[i] != (float)(n % 1000000)) return true;
+	return snapshot.started != n || snapshot.realtime != n || snapshot.version != (uint32_t)n;
+}
+
+struct Result {
+	long reads, writes, torn;
+	/** Mean and maximum duration of a store [ns] */
+	long long store_mean, store_max;
+};
+
+/** Runs the given number of readers against one writer for the given time */
+static Result run(bool seqlock, int readers, long long duration) {
+	FakeSensor sensor;
+	LockedSnapshot locked;
+	std::atomic<bool> running(true);
+	std::atomic<long> reads(0), torn_reads(0);
+
+	vector<std::thread> threads;
+	for(int i = 0; i < readers; i++) {
+		threads.push_back(std::thread([&]() {
+			long count = 0, bad = 0;
+			while(running.load(std::memory_order_relaxed)) {
+				const Snapshot snapshot = (seqlock ? sensor.snapshot() : locked.load());
+				if(snapshot.version > 0 && torn(snapshot)) bad++;
+				count++;
+			}
+			reads += count;
+			torn_reads += bad;
+		}));
+	}
+
+	Result result;
+	result.writes = 0;
+	result.store_mean = result.store_max = 0;
+	const long long end = monotonic_ns() + duration;
+	Snapshot snapshot;
+	memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.channels = 3;
+	while(monotonic_ns() < end) {
+		const long long n = result.writes + 1;
+		const float value = (float)(n % 1000000);
+		const long long start = monotonic_ns();
+		if(seqlock) {
+			for(int i = 0; i < 3; i++) sensor._readings[i] = value;
+			sensor.publish(n, n, n);
+		} else {
+			for(int i = 0; i < 3; i++) snapshot.values[i] = value;
+			snapshot.version = (uint32_t)n;
+			snapshot.started = snapshot.monotonic = snapshot.realtime = n;
+			locked.store(snapshot);
+		}
+		const long long elapsed = monotonic_ns() - start;
+		result.store_mean += elapsed;
+		if(elapsed > result.store_max) result.store_max = elapsed;
+		result.writes++;
+		// Leaves the CPU to the readers on machines with few cores
+		if(result.writes % 1024 == 0) std::this_thread::yield();
+	}
+	running = false;
+	for(vector<std::thread>::iterator it = threads.begin(); it != threads.end(); ++it) it->join();
+
+	result.reads = reads;
+	result.torn = torn_reads;
+	if(result.writes > 0) result.store_mean /= result.writes;
+	return result;
+}
+
+int main(int argc, char** argv) {
+	const double seconds = (argc > 1 ? atof(argv[1]) : 1.0);
+	const long long duration = (long long)(seconds * 1e9);
+	const int readers[] = { 1, 2, 4, 8, 16 };
+
+	cout << "Snapshot: " << std::thread::hardware_concurrency() << " CPUs, " << seconds << " s per run" << endl;
+	long torn_total = 0;
+	for(size_t i = 0; i < sizeof(readers) / sizeof(readers[0]); i++) {
+		for(int seqlock = 1; seqlock >= 0; seqlock--) {
+			const Result result = run(seqlock != 0, readers[i], duration);
+			torn_total += result.torn;
+			cout << "  " << (seqlock ? "seqlock" : "mutex  ") << " " << readers[i] << " readers: ";
+			cout << (result.reads / seconds / 1e6) << " M reads/s, " << (result.writes / seconds / 1e6) << " M writes/s";
+			cout << ", store mean " << result.store_mean << " ns, max " << result.store_max / 1000.0 << " us";
+			cout << ", " << result.torn << " torn reads" << endl;
+		}
+	}
+	if(torn_total > 0) {
+		cerr << "bench_snapshot: " << torn_total << " torn reads" << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
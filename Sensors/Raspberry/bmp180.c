@@ -64,6 +64,12 @@
  */
 #define BMP180_CTRL 0xF4
 
+/*
+ * Chip ID register and its value
+ */
+#define BMP180_REG_ID 0xD0
+#define BMP180_CHIP_ID 0x55
+
 /* 
  * Temperature register
  */
@@ -108,6 +114,13 @@
 #define BMP180_PRE_OSS2_WAIT_US 14000
 #define BMP180_PRE_OSS3_WAIT_US 26000
 
+/*
+ * Conversion phases of bmp180_start and bmp180_collect
+ */
+#define BMP180_PHASE_IDLE 0
+#define BMP180_PHASE_TMP 1
+#define BMP180_PHASE_PRE 2
+
 /*
  * Average sea-level pressure in hPa
  */
@@ -146,6 +159,18 @@ typedef struct {
 	/* BMP180 oversampling mode */
 	int oss;
 	
+	/* Number of pressure reads served by one temperature conversion */
+	int t_reuse;
+	
+	/* Pressure reads since the last temperature conversion */
+	int t_count;
+	
+	/* Last uncompensated temperature */
+	int32_t ut;
+	
+	/* Running conversion (BMP180_PHASE_*) */
+	int phase;
+	
 	/* i2c device file path */
 	char *i2c_device;
 	
@@ -188,9 +213,18 @@ int32_t bmp180_register_table[11][2] = {
 int bmp180_set_addr(void *_bmp);
 void bmp180_read_eprom_reg(void *_bmp, int32_t *_data, uint8_t reg, int32_t sign);
 void bmp180_read_eprom(void *_bmp);
+int bmp180_check_eprom(void *_bmp, const bmp180_eprom_t *eprom);
 int32_t bmp180_read_raw_pressure(void *_bmp, uint8_t oss);
 int32_t bmp180_read_raw_temperature(void *_bmp);
+long bmp180_start_raw_pressure(void *_bmp, uint8_t oss);
+int32_t bmp180_fetch_raw_pressure(void *_bmp);
+long bmp180_start_raw_temperature(void *_bmp);
+int32_t bmp180_fetch_raw_temperature(void *_bmp);
 void bmp180_init_error_cleanup(void *_bmp);
+long bmp180_compute_b5(void *_bmp, long UT);
+float bmp180_compute_temperature(void *_bmp, long UT);
+long bmp180_compute_pressure(void *_bmp, long UT, long UP);
+float bmp180_compute_altitude(float p);
 
 
 /*
@@ -284,15 +318,62 @@ void bmp180_read_eprom(void *_bmp) {
 
 
 /*
- * Returns the raw measured temperature value of this BMP180 sensor.
+ * Checks if the given eprom values belong to this BMP180 sensor and
+ * takes them over. Only the chip ID and one coefficient are read,
+ * instead of the whole eprom.
  * 
  * @param bmp180 sensor
+ * @param bmp180 eprom struct
+ * @return 1 if the eprom values have been taken over, otherwise 0
  */
-int32_t bmp180_read_raw_temperature(void *_bmp) {
+int bmp180_check_eprom(void *_bmp, const bmp180_eprom_t *eprom) {
+	bmp180_t *bmp = TO_BMP(_bmp);
+	if(i2c_smbus_read_byte_data(bmp->file, BMP180_REG_ID) != BMP180_CHIP_ID) {
+		return 0;
+	}
+	
+	int32_t ac1;
+	bmp180_read_eprom_reg(_bmp, &ac1, BMP180_REG_AC1_H, 1);
+	if(ac1 != eprom->ac1) {
+		return 0;
+	}
+	
+	bmp->ac1 = eprom->ac1;
+	bmp->ac2 = eprom->ac2;
+	bmp->ac3 = eprom->ac3;
+	bmp->ac4 = eprom->ac4;
+	bmp->ac5 = eprom->ac5;
+	bmp->ac6 = eprom->ac6;
+	bmp->b1 = eprom->b1;
+	bmp->b2 = eprom->b2;
+	bmp->mb = eprom->mb;
+	bmp->mc = eprom->mc;
+	bmp->md = eprom->md;
+	return 1;
+}
+
+
+/*
+ * Starts a temperature conversion on this BMP180 sensor.
+ * 
+ * @param bmp180 sensor
+ * @return waiting time in us until the conversion is complete
+ */
+long bmp180_start_raw_temperature(void *_bmp) {
 	bmp180_t* bmp = TO_BMP(_bmp);
 	i2c_smbus_write_byte_data(bmp->file, BMP180_CTRL, BMP180_TMP_READ_CMD);
+	
+	return BMP180_TMP_READ_WAIT_US;
+}
+
 
-	usleep(BMP180_TMP_READ_WAIT_US);
+/*
+ * Fetches the result of a completed temperature conversion.
+ * 
+ * @param bmp180 sensor
+ */
+int32_t bmp180_fetch_raw_temperature(void *_bmp) {
+	bmp180_t* bmp = TO_BMP(_bmp);
 	int32_t data = i2c_smbus_read_word_data(bmp->file, BMP180_REG_TMP) & 0xFFFF;
 	
 	data = ((data << 8) & 0xFF00) + (data >> 8);
@@ -302,11 +383,24 @@ int32_t bmp180_read_raw_temperature(void *_bmp) {
 
 
 /*
- * Returns the raw measured pressure value of this BMP180 sensor.
+ * Returns the raw measured temperature value of this BMP180 sensor.
  * 
  * @param bmp180 sensor
  */
-int32_t bmp180_read_raw_pressure(void *_bmp, uint8_t oss) {
+int32_t bmp180_read_raw_temperature(void *_bmp) {
+	usleep(bmp180_start_raw_temperature(_bmp));
+	return bmp180_fetch_raw_temperature(_bmp);
+}
+
+
+/*
+ * Starts a pressure conversion on this BMP180 sensor.
+ * 
+ * @param bmp180 sensor
+ * @param oversampling mode
+ * @return waiting time in us until the conversion is complete
+ */
+long bmp180_start_raw_pressure(void *_bmp, uint8_t oss) {
 	bmp180_t* bmp = TO_BMP(_bmp);
 	uint16_t wait;
 	uint8_t cmd;
@@ -331,8 +425,18 @@ int32_t bmp180_read_raw_pressure(void *_bmp, uint8_t oss) {
 	}
 	
 	i2c_smbus_write_byte_data(bmp->file, BMP180_CTRL, cmd);
+	
+	return wait;
+}
 
-	usleep(wait);
+
+/*
+ * Fetches the result of a completed pressure conversion.
+ * 
+ * @param bmp180 sensor
+ */
+int32_t bmp180_fetch_raw_pressure(void *_bmp) {
+	bmp180_t* bmp = TO_BMP(_bmp);
 	
 	int32_t msb, lsb, xlsb, data;
 	msb = i2c_smbus_read_byte_data(bmp->file, BMP180_REG_PRE) & 0xFF;
@@ -344,6 +448,99 @@ int32_t bmp180_read_raw_pressure(void *_bmp, uint8_t oss) {
 	return data;
 }
 
+
+/*
+ * Returns the raw measured pressure value of this BMP180 sensor.
+ * 
+ * @param bmp180 sensor
+ */
+int32_t bmp180_read_raw_pressure(void *_bmp, uint8_t oss) {
+	usleep(bmp180_start_raw_pressure(_bmp, oss));
+	return bmp180_fetch_raw_pressure(_bmp);
+}
+
+/*
+ * Computes the B5 coefficient from an uncompensated temperature.
+ * 
+ * @param bmp180 sensor
+ * @param uncompensated temperature
+ */
+long bmp180_compute_b5(void *_bmp, long UT) {
+	bmp180_t* bmp = TO_BMP(_bmp);
+	long X1, X2;
+	
+	X1 = ((UT - bmp->ac6) * bmp->ac5) >> 15;
+	X2 = (bmp->mc << 11) / (X1 + bmp->md);
+	return X1 + X2;
+}
+
+
+/*
+ * Computes the temperature in celsius from an uncompensated temperature.
+ * 
+ * @param bmp180 sensor
+ * @param uncompensated temperature
+ */
+float bmp180_compute_temperature(void *_bmp, long UT) {
+	long B5 = bmp180_compute_b5(_bmp, UT);
+	return ((B5 + 8) >> 4) / 10.0;
+}
+
+
+/*
+ * Computes the pressure in pascal from an uncompensated temperature 
+ * and pressure pair.
+ * 
+ * @param bmp180 sensor
+ * @param uncompensated temperature
+ * @param uncompensated pressure
+ */
+long bmp180_compute_pressure(void *_bmp, long UT, long UP) {
+	bmp180_t* bmp = TO_BMP(_bmp);
+	long B6, B5, X1, X2, X3, B3, p;
+	unsigned long B4, B7;
+	
+	B5 = bmp180_compute_b5(_bmp, UT);
+	
+	B6 = B5 - 4000;
+	
+	X1 = (bmp->b2 * (B6 * B6) >> 12) >> 11;
+	X2 = (bmp->ac2 * B6) >> 11;
+	X3 = X1 + X2;
+	
+	B3 = ((((bmp->ac1 * 4) + X3) << bmp->oss) + 2) / 4;
+	X1 = (bmp->ac3 * B6) >> 13;
+	X2 = (bmp->b1 * ((B6 * B6) >> 12)) >> 16;
+	X3 = ((X1 + X2) + 2) >> 2;
+	
+	
+	B4 = bmp->ac4 * (unsigned long)(X3 + 32768) >> 15;
+	B7 = ((unsigned long) UP - B3) * (50000 >> bmp->oss);
+	
+	if(B7 < 0x80000000) {
+		p = (B7 * 2) / B4;
+	} else {
+		p = (B7 / B4) * 2;
+	}
+	
+	X1 = (p >> 8) * (p >> 8);
+	X1 = (X1 * 3038) >> 16;
+	X2 = (-7357 * p) >> 16;
+	p = p + ((X1 + X2 + 3791) >> 4);
+	
+	return p;
+}
+
+
+/*
+ * Computes the altitude in meters from a pressure in pascal.
+ * 
+ * @param pressure
+ */
+float bmp180_compute_altitude(float p) {
+	return 44330 * (1 - pow(( (p/100) / BMP180_SEA_LEVEL),1/5.255));
+}
+
 /*
  * Implementation of the interface functions
  */
@@ -378,6 +575,20 @@ void bmp180_dump_eprom(void *_bmp, bmp180_eprom_t *eprom) {
  * @return bmp180 sensor
  */
 void *bmp180_init(int address, const char* i2c_device_filepath) {
+	return bmp180_init_eprom(address, i2c_device_filepath, NULL);
+}
+
+
+/**
+ * Creates a BMP180 sensor object with previously dumped eprom values.
+ * If they don't match the sensor, the eprom is read.
+ *
+ * @param i2c device address
+ * @param i2c device file path
+ * @param bmp180 eprom struct from bmp180_dump_eprom or NULL
+ * @return bmp180 sensor
+ */
+void *bmp180_init_eprom(int address, const char* i2c_device_filepath, const bmp180_eprom_t *eprom) {
 	DEBUG("device: init using address %#x and i2cbus %s\n", address, i2c_device_filepath);
 	
 	// setup BMP180
@@ -417,8 +628,14 @@ void *bmp180_init(int address, const char* i2c_device_filepath) {
 	}
 
 	// setup i2c device
-	bmp180_read_eprom(_bmp);
+	if(eprom == NULL || !bmp180_check_eprom(_bmp, eprom)) {
+		bmp180_read_eprom(_bmp);
+	}
 	bmp->oss = 0;
+	bmp->t_reuse = 1;
+	bmp->t_count = 0;
+	bmp->ut = 0;
+	bmp->phase = BMP180_PHASE_IDLE;
 	
 	DEBUG("device: open ok\n");
 
@@ -457,20 +674,13 @@ void bmp180_close(void *_bmp) {
  * @return temperature
  */
 float bmp180_temperature(void *_bmp) {
-	bmp180_t* bmp = TO_BMP(_bmp);
-	long UT, X1, X2, B5;
-	float T;
+	long UT;
 	
 	UT = bmp180_read_raw_temperature(_bmp);
 	
 	DEBUG("UT=%lu\n",UT);
 	
-	X1 = ((UT - bmp->ac6) * bmp->ac5) >> 15;
-	X2 = (bmp->mc << 11) / (X1 + bmp->md);
-	B5 = X1 + X2;
-	T = ((B5 + 8) >> 4) / 10.0;
-	
-	return T;
+	return bmp180_compute_temperature(_bmp, UT);
 }
 
 
@@ -482,60 +692,133 @@ float bmp180_temperature(void *_bmp) {
  */
 long bmp180_pressure(void *_bmp) {
 	bmp180_t* bmp = TO_BMP(_bmp);
-	long UT, UP, B6, B5, X1, X2, X3, B3, p;
-	unsigned long B4, B7;
+	long UT, UP;
 	
 	UT = bmp180_read_raw_temperature(_bmp);
 	UP = bmp180_read_raw_pressure(_bmp, bmp->oss);
 	
-	X1 = ((UT - bmp->ac6) * bmp->ac5) >> 15;
-	X2 = (bmp->mc << 11) / (X1 + bmp->md);
-	
-	B5 = X1 + X2;
-	
-	B6 = B5 - 4000;
-	
-	X1 = (bmp->b2 * (B6 * B6) >> 12) >> 11;
-	X2 = (bmp->ac2 * B6) >> 11;
-	X3 = X1 + X2;
-	
-	B3 = ((((bmp->ac1 * 4) + X3) << bmp->oss) + 2) / 4;
-	X1 = (bmp->ac3 * B6) >> 13;
-	X2 = (bmp->b1 * ((B6 * B6) >> 12)) >> 16;
-	X3 = ((X1 + X2) + 2) >> 2;
-	
-	
-	B4 = bmp->ac4 * (unsigned long)(X3 + 32768) >> 15;
-	B7 = ((unsigned long) UP - B3) * (50000 >> bmp->oss);
+	return bmp180_compute_pressure(_bmp, UT, UP);
+}
+
+
+/**
+ * Returns altitude in meters based on the measured pressure 
+ * and temperature of this sensor.
+ * 
+ * @param bmp180 sensor
+ * @return altitude
+ */
+float bmp180_altitude(void *_bmp) {
+	return bmp180_compute_altitude(bmp180_pressure(_bmp));
+}
+
+
+/**
+ * Starts the conversions for one uncompensated sample without waiting for
+ * them. The temperature conversion is skipped if it is still valid 
+ * according to bmp180_set_temperature_reuse.
+ * 
+ * @param bmp180 sensor
+ * @return waiting time in us until bmp180_collect should be called
+ */
+long bmp180_start(void *_bmp) {
+	bmp180_t* bmp = TO_BMP(_bmp);
 	
-	if(B7 < 0x80000000) {
-		p = (B7 * 2) / B4;
+	if(bmp->t_count == 0) {
+		bmp->phase = BMP180_PHASE_TMP;
+		return bmp180_start_raw_temperature(_bmp);
 	} else {
-		p = (B7 / B4) * 2;
+		bmp->phase = BMP180_PHASE_PRE;
+		return bmp180_start_raw_pressure(_bmp, bmp->oss);
 	}
+}
+
+
+/**
+ * Collects the result of the conversion started by bmp180_start.
+ * After the temperature conversion the pressure conversion is started,
+ * so this function needs to be called again after the returned waiting time.
+ * 
+ * @param bmp180 sensor
+ * @param raw sample
+ * @return 0 if the sample is complete, the waiting time in us if 
+ *         another conversion has been started and -1 if no conversion is running
+ */
+long bmp180_collect(void *_bmp, bmp180_raw_t *raw) {
+	bmp180_t* bmp = TO_BMP(_bmp);
 	
-	X1 = (p >> 8) * (p >> 8);
-	X1 = (X1 * 3038) >> 16;
-	X2 = (-7357 * p) >> 16;
-	p = p + ((X1 + X2 + 3791) >> 4);
+	switch(bmp->phase) {
+		case BMP180_PHASE_TMP:
+			bmp->ut = bmp180_fetch_raw_temperature(_bmp);
+			bmp->phase = BMP180_PHASE_PRE;
+			return bmp180_start_raw_pressure(_bmp, bmp->oss);
+		
+		case BMP180_PHASE_PRE:
+			if(++bmp->t_count >= bmp->t_reuse)
+				bmp->t_count = 0;
+			bmp->phase = BMP180_PHASE_IDLE;
+			raw->ut = bmp->ut;
+			raw->up = bmp180_fetch_raw_pressure(_bmp);
+			DEBUG("UT=%lu, UP=%lu\n", raw->ut, raw->up);
+			return 0;
+		
+		default:
+			return -1;
+	}
+}
+
+
+/**
+ * Reads one uncompensated temperature and pressure sample.
+ * The temperature conversion is skipped if it is still valid according
+ * to bmp180_set_temperature_reuse.
+ * 
+ * @param bmp180 sensor
+ * @param raw sample
+ */
+void bmp180_read_raw(void *_bmp, bmp180_raw_t *raw) {
+	long wait = bmp180_start(_bmp);
 	
-	return p;
+	do {
+		usleep(wait);
+	} while((wait = bmp180_collect(_bmp, raw)) > 0);
 }
 
 
 /**
- * Returns altitude in meters based on the measured pressure 
- * and temperature of this sensor.
+ * Computes temperature, pressure and altitude from a raw sample.
  * 
  * @param bmp180 sensor
- * @return altitude
+ * @param raw sample
+ * @param temperature in celsius
+ * @param pressure in pascal
+ * @param altitude in meters
  */
-float bmp180_altitude(void *_bmp) {
-	float p, alt;
-	p = bmp180_pressure(_bmp);
-	alt = 44330 * (1 - pow(( (p/100) / BMP180_SEA_LEVEL),1/5.255));
+void bmp180_compensate(void *_bmp, const bmp180_raw_t *raw, float *temperature, long *pressure, float *altitude) {
+	long p = bmp180_compute_pressure(_bmp, raw->ut, raw->up);
+	
+	if(temperature != NULL) *temperature = bmp180_compute_temperature(_bmp, raw->ut);
+	if(pressure != NULL) *pressure = p;
+	if(altitude != NULL) *altitude = bmp180_compute_altitude(p);
+}
+
+
+/**
+ * Measures temperature, pressure and altitude from a single sample.
+ * This requires one temperature and one pressure conversion, whereas
+ * calling bmp180_temperature, bmp180_pressure and bmp180_altitude
+ * requires three and two of them.
+ * 
+ * @param bmp180 sensor
+ * @param temperature in celsius
+ * @param pressure in pascal
+ * @param altitude in meters
+ */
+void bmp180_measure(void *_bmp, float *temperature, long *pressure, float *altitude) {
+	bmp180_raw_t raw;
 	
-	return alt;
+	bmp180_read_raw(_bmp, &raw);
+	bmp180_compensate(_bmp, &raw, temperature, pressure, altitude);
 }
 
 
@@ -550,3 +833,36 @@ void bmp180_set_oss(void *_bmp, int oss) {
 	bmp->oss = oss;
 }
 
+
+/**
+ * Returns the time a temperature and a pressure conversion take
+ * with the current oversampling setting.
+ * 
+ * @param bmp180 sensor
+ * @return conversion time in microseconds
+ */
+long bmp180_conversion_time(void *_bmp) {
+	bmp180_t* bmp = TO_BMP(_bmp);
+	switch(bmp->oss) {
+		case BMP180_PRE_OSS1: return BMP180_TMP_READ_WAIT_US + BMP180_PRE_OSS1_WAIT_US;
+		case BMP180_PRE_OSS2: return BMP180_TMP_READ_WAIT_US + BMP180_PRE_OSS2_WAIT_US;
+		case BMP180_PRE_OSS3: return BMP180_TMP_READ_WAIT_US + BMP180_PRE_OSS3_WAIT_US;
+		default: return BMP180_TMP_READ_WAIT_US + BMP180_PRE_OSS0_WAIT_US;
+	}
+}
+
+
+/**
+ * Sets the number of pressure reads that share one temperature conversion
+ * in bmp180_read_raw and bmp180_measure. The temperature changes much
+ * slower than the pressure, so reusing it saves one conversion per read.
+ * 
+ * @param bmp180 sensor
+ * @param number of pressure reads per temperature conversion (1 = always convert)
+ */
+void bmp180_set_temperature_reuse(void *_bmp, int n) {
+	bmp180_t* bmp = TO_BMP(_bmp);
+	if(n < 1) n = 1;
+	bmp->t_reuse = n;
+	bmp->t_count = 0;
+}
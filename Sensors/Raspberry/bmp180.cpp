@@ -22,21 +22,32 @@
 
 namespace sensors {
 
+constexpr Channel BMP180::CHANNEL_TABLE[];
+
 BMP180::BMP180(const char* i2c_device, int address) : Sensor(i2c_device, address) {
-	this->bmp = bmp180_init(address, i2c_device);
-	if(this->bmp == NULL) this->_error = true;
-	this->t = 0.0F;
-	this->p = 0.0F;
-	this->alt = 0.0F;
+	this->bmp = NULL;
+	this->_treuse = 1;
+	this->_oss = 0;
+	if(this->init() != 0) this->_error = true;
+	for(int i = 0; i < CHANNELS; i++) this->_readings[i] = 0.0F;
 }
 
 
 BMP180::BMP180(const std::string i2c_device, int address)  : Sensor(i2c_device, address) {
-	this->bmp = bmp180_init(address, i2c_device.c_str());
-	if(this->bmp == NULL) this->_error = true;
-	this->t = 0.0F;
-	this->p = 0.0F;
-	this->alt = 0.0F;
+	this->bmp = NULL;
+	this->_treuse = 1;
+	this->_oss = 0;
+	if(this->init() != 0) this->_error = true;
+	for(int i = 0; i < CHANNELS; i++) this->_readings[i] = 0.0F;
+}
+
+
+BMP180::BMP180(const std::string i2c_device, int address, const void *state, size_t size)  : Sensor(i2c_device, address) {
+	this->bmp = NULL;
+	this->_treuse = 1;
+	this->_oss = 0;
+	if(this->restoreState(state, size) != 0) this->_error = true;
+	for(int i = 0; i < CHANNELS; i++) this->_readings[i] = 0.0F;
 }
 
 
@@ -44,15 +55,48 @@ BMP180::~BMP180() {
 	bmp180_close(bmp);
 }
 
+int BMP180::init() {
+	bmp180_close(this->bmp);
+	this->bmp = bmp180_init(this->_address, this->_device.c_str());
+	if(this->bmp == NULL) return -1;
+	bmp180_set_temperature_reuse(this->bmp, this->_treuse);
+	bmp180_set_oss(this->bmp, this->_oss);
+	this->_error = false;
+	return 0;
+}
+
+size_t BMP180::saveState(void *buffer, size_t size) const {
+	if(this->bmp == NULL || size < sizeof(bmp180_eprom_t)) return 0;
+	bmp180_eprom_t eprom;
+	bmp180_dump_eprom(this->bmp, &eprom);
+	memcpy(buffer, &eprom, sizeof(eprom));
+	return sizeof(eprom);
+}
+
+int BMP180::restoreState(const void *state, size_t size) {
+	if(size != sizeof(bmp180_eprom_t)) return this->init();
+	bmp180_eprom_t eprom;
+	memcpy(&eprom, state, sizeof(eprom));
+	bmp180_close(this->bmp);
+	this->bmp = bmp180_init_eprom(this->_address, this->_device.c_str(), &eprom);
+	if(this->bmp == NULL) return -1;
+	bmp180_set_temperature_reuse(this->bmp, this->_treuse);
+	bmp180_set_oss(this->bmp, this->_oss);
+	this->_error = false;
+	return 0;
+}
+
 	
 int BMP180::read() {
 	if(this->bmp == NULL) return -1;
 	if(this->_error) return -1;
 
 	// Unfortunately, currently there is no error report for the BMP180	
-	this->t = bmp180_temperature(bmp);
-	this->p = bmp180_pressure(bmp);
-	this->alt = bmp180_altitude(bmp);
+	// Derive all values from one sample, so that only one temperature and
+	// one pressure conversion is required
+	long pressure;
+	bmp180_measure(bmp, &this->_readings[CH_T], &pressure, &this->_readings[CH_ALT]);
+	this->_readings[CH_P] = pressure;
 	
 	// XXX: Dirty hack. Those values appear on an error, and up to now this
 	//      is the best we can do to detect errors.
@@ -60,10 +104,58 @@ int BMP180::read() {
 	//      those values is almost zero, so it should work in practice without
 	//      any side-effects
 	// PS. Yes, this is lazy :-)
-	if(this->t == 12.8 && this->p == 99975.0) return -1;
+	if(this->_readings[CH_T] == 12.8 && this->_readings[CH_P] == 99975.0) return -1;
+	
+	return 0;
+}
+
+long BMP180::start() {
+	if(this->bmp == NULL) return -1;
+	if(this->_error) return -1;
+	
+	return bmp180_start(bmp);
+}
+
+long BMP180::collect() {
+	if(this->bmp == NULL) return -1;
+	
+	bmp180_raw_t raw;
+	const long ret = bmp180_collect(bmp, &raw);
+	if(ret != 0) return ret;
+	
+	long pressure;
+	bmp180_compensate(bmp, &raw, &this->_readings[CH_T], &pressure, &this->_readings[CH_ALT]);
+	this->_readings[CH_P] = pressure;
+	
+	// See read() for this error detection
+	if(this->_readings[CH_T] == 12.8 && this->_readings[CH_P] == 99975.0) return -1;
 	
 	return 0;
 }
 
+void BMP180::setTemperatureReuse(int n) {
+	this->_treuse = n;
+	if(this->bmp == NULL) return;
+	bmp180_set_temperature_reuse(this->bmp, n);
+}
+
+int BMP180::setPrecision(int level) {
+	if(level < BMP180_PRE_OSS0 || level > BMP180_PRE_OSS3) return -1;
+	this->_oss = level;
+	if(this->bmp != NULL) bmp180_set_oss(this->bmp, level);
+	return 0;
+}
+
+std::string BMP180::precisionName(int level) const {
+	std::stringstream ss;
+	ss << "oss=" << level;
+	return ss.str();
+}
+
+long BMP180::conversionTime(void) const {
+	if(this->bmp == NULL) return 0;
+	return bmp180_conversion_time(this->bmp);
+}
+
 }
 
@@ -30,17 +30,39 @@ typedef struct {
 	int md;
 } bmp180_eprom_t;
 
+typedef struct {
+	/* Uncompensated temperature and pressure */
+	long ut;
+	long up;
+} bmp180_raw_t;
+
 void *bmp180_init(int address, const char* i2c_device_filepath);
 
+void *bmp180_init_eprom(int address, const char* i2c_device_filepath, const bmp180_eprom_t *eprom);
+
 void bmp180_close(void *_bmp);
 
 long bmp180_pressure(void *_bmp);
 
 void bmp180_set_oss(void *_bmp, int oss);
 
+long bmp180_conversion_time(void *_bmp);
+
 float bmp180_temperature(void *_bmp);
 
 float bmp180_altitude(void *_bmp);
 
 void bmp180_dump_eprom(void *_bmp, bmp180_eprom_t *eprom);
 
+void bmp180_read_raw(void *_bmp, bmp180_raw_t *raw);
+
+long bmp180_start(void *_bmp);
+
+long bmp180_collect(void *_bmp, bmp180_raw_t *raw);
+
+void bmp180_compensate(void *_bmp, const bmp180_raw_t *raw, float *temperature, long *pressure, float *altitude);
+
+void bmp180_measure(void *_bmp, float *temperature, long *pressure, float *altitude);
+
+void bmp180_set_temperature_reuse(void *_bmp, int n);
+
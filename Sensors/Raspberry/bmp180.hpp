@@ -25,30 +25,59 @@
 namespace sensors {
 
 class BMP180 : public Sensor {
+public:
+	/** Channel indices */
+	enum { CH_ALT = 0, CH_P, CH_T, CHANNELS };
+	/** Channel descriptors, available at compile time */
+	static constexpr Channel CHANNEL_TABLE[CHANNELS] = {
+		{ "alt", "m", CHANNEL_ALTITUDE, CH_ALT },
+		{ "p", "Pa", CHANNEL_PRESSURE, CH_P },
+		{ "t", "C", CHANNEL_TEMPERATURE, CH_T },
+	};
 private:
 	// Last readings
-	float t,p,alt;
+	float _readings[CHANNELS];
 	
 	
 	void* bmp;
+	
+	/** Reads per temperature conversion, restored on init() */
+	int _treuse;
+	/** Oversampling setting of the pressure conversion, restored on init() */
+	int _oss;
 public:
 	BMP180(const char* i2c_device, int address=DEVICE_ADDRESS);
 	BMP180(const std::string i2c_device, int address=DEVICE_ADDRESS);
+	/** Initializes the sensor with the calibration data saved with saveState() */
+	BMP180(const std::string i2c_device, int address, const void *state, size_t size);
 	virtual ~BMP180();
 	
+	virtual int init(void);
+	/** Saves the calibration data */
+	virtual size_t saveState(void *buffer, size_t size) const;
+	/** Reinitializes the device with the saved calibration data, if it still matches */
+	virtual int restoreState(const void *state, size_t size);
 	int read(void);
+	virtual long start(void);
+	virtual long collect(void);
+	
+	/** Reuse one temperature conversion for n consecutive reads (default: 1) */
+	void setTemperatureReuse(int n);
+	
+	/** Sets the pressure oversampling setting (oss 0-3, default: 0) */
+	virtual int setPrecision(int level);
+	virtual int precision(void) const { return this->_oss; }
+	virtual int precisionLevels(void) const { return 4; }
+	virtual std::string precisionName(int level) const;
+	virtual long conversionTime(void) const;
+	
+	float temperature() { return this->_readings[CH_T]; }
+	float pressure() { return this->_readings[CH_P]; }
+	float altitude() { return this->_readings[CH_ALT]; }
 	
-	float temperature() { return this->t; }
-	float pressure() { return this->p; }
-	float altitude() { return this->alt; }
-	
-	virtual std::map<std::string,float> values(void) const {
-		std::map<std::string,float> ret;
-		ret["t"] = this->t;
-		ret["p"] = this->p;
-		ret["alt"] = this->alt;
-		return ret;
-	}
+	virtual size_t channelCount(void) const { return CHANNELS; }
+	virtual const Channel* channels(void) const { return CHANNEL_TABLE; }
+	virtual const float* readings(void) const { return this->_readings; }
 	
 	static const int DEVICE_ADDRESS = 0x77;
 };
@@ -823,6 +823,11 @@ public:
 	 */
 	std::vector<std::string> keys(void);
 
+	/**
+	 * @return name of this section or empty string, if the default section
+	 */
+	std::string name(void) const { return this->_name; }
+
 
 	/**
 	 * Checks if the given key exists in the config file
@@ -0,0 +1,112 @@
+/* =============================================================================
+ *
+ * Title:         Report by exception
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Per-channel deadbands and heartbeat, that decide whether
+ *                the readings of a sensor are worth publishing
+ *
+ * =============================================================================
+ */
+
+#include <sstream>
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "deadband.hpp"
+
+using namespace sensors;
+
+
+namespace meteo {
+
+/** Parses a non-negative float. Throws a const char* on error */
+static float parseBand(const std::string &value) {
+	char *endptr = NULL;
+	const float result = strtof(value.c_str(), &endptr);
+	if(value.empty() || endptr == NULL || *endptr != '\0') throw "Illegal deadband";
+	if(result < 0.0F) throw "Deadband must not be negative";
+	return result;
+}
+
+/** @returns the given option as band, the channel specific one if present */
+static float bandOf(const std::map<std::string, std::string> &options, const std::string &key, const char* channel) {
+	std::map<std::string, std::string>::const_iterator it = options.find(key + "." + channel);
+	if(it == options.end()) it = options.find(key);
+	return (it == options.end() ? 0.0F : parseBand(it->second));
+}
+
+Deadband::Deadband(const Sensor *sensor, const std::map<std::string, std::string> &options) {
+	this->_sensor = sensor;
+	this->_published = 0;
+	const Channel *channels = sensor->channels();
+	for(std::map<std::string, std::string>::const_iterator it = options.begin(); it != options.end(); ++it) {
+		const size_t dot = it->first.find('.');
+		if(dot == std::string::npos || !isOption(it->first)) continue;
+		bool found = false;
+		for(size_t i = 0; i < sensor->channelCount() && !found; i++)
+			found = (it->first.substr(dot + 1) == channels[i].name);
+		if(!found) throw "Deadband of unknown channel";
+	}
+	this->_bands.resize(sensor->channelCount());
+	for(size_t i = 0; i < sensor->channelCount(); i++) {
+		Band &band = this->_bands[i];
+		band.absolute = bandOf(options, "deadband", channels[i].name);
+		band.relative = bandOf(options, "deadband_rel", channels[i].name) / 100.0F;
+		band.last = 0.0F;
+	}
+	this->_readouts = 0;
+	this->_suppressed = 0;
+	std::map<std::string, std::string>::const_iterator it = options.find("heartbeat");
+	this->_heartbeat = (it == options.end() ? 0 : (long long)(parseBand(it->second) * 1e9F));
+}
+
+bool Deadband::changed(long long now) const {
+	// Nothing published yet or heartbeat expired
+	bool news = (this->_published == 0 || (this->_heartbeat > 0 && now - this->_published >= this->_heartbeat));
+	// Without any band every readout is news, otherwise channels without a band don't matter
+	if(!news && !this->active()) news = true;
+	const Channel *channels = this->_sensor->channels();
+	for(size_t i = 0; i < this->_bands.size() && !news; i++) {
+		const Band &band = this->_bands[i];
+		const float delta = fabsf(this->_sensor->reading(channels[i]) - band.last);
+		if(band.absolute > 0.0F && delta > band.absolute) news = true;
+		else if(band.relative > 0.0F && delta > band.relative * fabsf(band.last)) news = true;
+	}
+	return news;
+}
+
+void Deadband::published(long long now) {
+	const Channel *channels = this->_sensor->channels();
+	for(size_t i = 0; i < this->_bands.size(); i++)
+		this->_bands[i].last = this->_sensor->reading(channels[i]);
+	this->_published = now;
+	this->_readouts++;
+}
+
+bool Deadband::active(void) const {
+	for(std::vector<Band>::const_iterator it = this->_bands.begin(); it != this->_bands.end(); ++it)
+		if(it->absolute > 0.0F || it->relative > 0.0F) return true;
+	return false;
+}
+
+std::string Deadband::toString(void) const {
+	std::stringstream ss;
+	ss << this->_suppressed << " of " << this->_readouts << " readouts suppressed";
+	if(this->_readouts > 0) ss << " (" << (100.0 * this->_suppressed / this->_readouts) << " %)";
+	return ss.str();
+}
+
+void Deadband::check(const std::map<std::string, std::string> &options) {
+	for(std::map<std::string, std::string>::const_iterator it = options.begin(); it != options.end(); ++it)
+		if(isOption(it->first)) parseBand(it->second);
+}
+
+bool Deadband::isOption(const std::string &key) {
+	return key == "heartbeat" || key == "deadband" || key == "deadband_rel" ||
+		key.compare(0, 9, "deadband.") == 0 || key.compare(0, 13, "deadband_rel.") == 0;
+}
+
+}
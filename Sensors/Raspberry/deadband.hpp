@@ -0,0 +1,97 @@
+/* =============================================================================
+ *
+ * Title:         Report by exception
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Per-channel deadbands and heartbeat, that decide whether
+ *                the readings of a sensor are worth publishing
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_DEADBAND_HPP
+#define _METEO_DEADBAND_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sensor.hpp"
+
+
+namespace meteo {
+
+/**
+  * Deadbands of the channels of one sensor. A reading is only news, if it
+  * moved further than the absolute or the relative band away from the
+  * last published reading of its channel. The readings are news anyway,
+  * if they have not been published for longer than the heartbeat.
+  * Channels without bands are ignored, unless no channel of the sensor has
+  * a band, then every readout is news
+  */
+class Deadband {
+private:
+	struct Band {
+		/** Absolute band, 0 if none */
+		float absolute;
+		/** Relative band (fraction of the last published value), 0 if none */
+		float relative;
+		/** Last published reading */
+		float last;
+	};
+	const sensors::Sensor *_sensor;
+	std::vector<Band> _bands;
+	/** Maximum silence [ns], 0 if none */
+	long long _heartbeat;
+	/** Monotonic time of the last publication [ns], 0 if never */
+	long long _published;
+	/** Readouts in total and suppressed readouts */
+	long _readouts, _suppressed;
+public:
+	/**
+	  * @param sensor Sensor, whose channels are watched
+	  * @param options Options of the config section of the sensor, see check(). Throws a const char* on illegal
+	  *        values and on bands of channels, that the sensor does not have
+	  */
+	Deadband(const sensors::Sensor *sensor, const std::map<std::string, std::string> &options);
+
+	/**
+	  * Checks the current readings of the sensor against the bands
+	  * @param now Monotonic time [ns]
+	  * @returns true if a reading is news or the heartbeat expired
+	  */
+	bool changed(long long now) const;
+
+	/** Remembers the current readings as published */
+	void published(long long now);
+	/** Counts the current readings as suppressed */
+	void suppressed(void) { this->_readouts++; this->_suppressed++; }
+
+	/** @returns true if any channel has a band */
+	bool active(void) const;
+
+	/** @returns the number of readouts */
+	long readouts(void) const { return this->_readouts; }
+	/** @returns the suppression ratio */
+	std::string toString(void) const;
+
+	/**
+	  * Checks the deadband options of a config section. Throws a const char* on error:
+	  *
+	  *     deadband = X               Absolute band of all channels
+	  *     deadband.CHANNEL = X       Absolute band of a single channel
+	  *     deadband_rel = P           Relative band of all channels in percent
+	  *     deadband_rel.CHANNEL = P   Relative band of a single channel in percent
+	  *     heartbeat = T              Maximum time between publications in seconds
+	  */
+	static void check(const std::map<std::string, std::string> &options);
+
+	/** @returns true if the given option is a deadband option */
+	static bool isOption(const std::string &key);
+};
+
+}
+
+
+#endif
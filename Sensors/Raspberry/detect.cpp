@@ -0,0 +1,230 @@
+/* =============================================================================
+ *
+ * Title:         Sensor detection
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Parallel I2C bus scan, that identifies the supported
+ *                sensors by their ID registers
+ *
+ * =============================================================================
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+
+#include "detect.hpp"
+#include "scheduler.hpp"
+
+
+namespace meteo {
+
+/** Identifies the chip at the current slave address of the given bus */
+typedef bool (*Identify)(int fd);
+
+/** MCP9808: Manufacturer ID 0x0054 and device ID 0x04xx */
+static bool identifyMCP9808(int fd) {
+	const int manuf_id = i2c_smbus_read_word_data(fd, 0x06);
+	if(manuf_id < 0) return false;
+	const int device_id = i2c_smbus_read_word_data(fd, 0x07);
+	if(device_id < 0) return false;
+	// SMBus words are little endian, the MCP9808 sends the MSB first
+	return ((manuf_id & 0xFF) << 8 | (manuf_id >> 8)) == 0x0054 && (device_id & 0xFF) == 0x04;
+}
+
+/** BMP180: Chip ID 0x55 */
+static bool identifyBMP180(int fd) {
+	return i2c_smbus_read_byte_data(fd, 0xD0) == 0x55;
+}
+
+/** TSL2561: Part number 0x1 (CS package) or 0x5 (T/FN/CL package) in the ID register */
+static bool identifyTSL2561(int fd) {
+	const int id = i2c_smbus_read_byte_data(fd, 0x80 | 0x0A);
+	if(id < 0) return false;
+	return (id >> 4) == 0x1 || (id >> 4) == 0x5;
+}
+
+/** CRC-8 of the HTU21DF measurements, polynomial x^8 + x^5 + x^4 + 1 */
+static uint8_t crcHTU21DF(const uint8_t *data, size_t len) {
+	uint8_t crc = 0;
+	for(size_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for(int bit = 0; bit < 8; bit++)
+			crc = (uint8_t)((crc & 0x80) ? (crc << 1) ^ 0x31 : (crc << 1));
+	}
+	return crc;
+}
+
+static void sleepMs(long ms) {
+	struct timespec ts;
+	ts.tv_sec = ms / 1000L;
+	ts.tv_nsec = (ms % 1000L) * 1000000L;
+	nanosleep(&ts, NULL);
+}
+
+/** HTU21DF: It has no ID register. Other chips at 0x40 (INA219, PCA9685, ...)
+  * ACK a byte read as well, so the chip is soft reset and must report the
+  * reset value of its user register, and a temperature measurement must
+  * return a status bit and CRC, that match. The user register is restored
+  * afterwards, so that a running sensor keeps its resolution on a reload */
+static bool identifyHTU21DF(int fd) {
+	// The reserved bits 3-5 of the user register are always clear
+	const int user = i2c_smbus_read_byte_data(fd, 0xE7);
+	if(user < 0 || (user & 0x38) != 0) return false;
+	if(i2c_smbus_write_byte(fd, 0xFE) < 0) return false;		// Soft reset
+	sleepMs(15);
+	// Reset value 0x02, except for the end of battery status bit
+	const int reg = i2c_smbus_read_byte_data(fd, 0xE7);
+	if(reg < 0 || (reg & ~0x40) != 0x02) return false;
+
+	// Temperature measurement without clock stretching, 50 ms at 14 bit
+	bool identified = false;
+	if(i2c_smbus_write_byte(fd, 0xF3) < 0) return false;
+	uint8_t data[3];
+	for(int tries = 0; tries < 6; tries++) {
+		sleepMs(10);
+		// The chip NACKs the read until the measurement is done
+		if(::read(fd, data, sizeof(data)) != (ssize_t)sizeof(data)) continue;
+		// Bit 1 of the LSB is 0 for a temperature
+		identified = (crcHTU21DF(data, 2) == data[2] && (data[1] & 0x02) == 0);
+		break;
+	}
+	if(identified && (user & ~0x40) != 0x02)
+		i2c_smbus_write_byte_data(fd, 0xE6, (uint8_t)(user & ~0x40));
+	return identified;
+}
+
+/** Addresses, that a supported type can have */
+struct Probe {
+	const char* type;
+	int address;
+	Identify identify;
+};
+
+static const Probe PROBES[] = {
+	{ "mcp9808", 0x18, identifyMCP9808 },
+	{ "mcp9808", 0x19, identifyMCP9808 },
+	{ "mcp9808", 0x1A, identifyMCP9808 },
+	{ "mcp9808", 0x1B, identifyMCP9808 },
+	{ "mcp9808", 0x1C, identifyMCP9808 },
+	{ "mcp9808", 0x1D, identifyMCP9808 },
+	{ "mcp9808", 0x1E, identifyMCP9808 },
+	{ "mcp9808", 0x1F, identifyMCP9808 },
+	{ "tsl2561", 0x29, identifyTSL2561 },
+	{ "tsl2561", 0x39, identifyTSL2561 },
+	{ "htu21df", 0x40, identifyHTU21DF },
+	{ "tsl2561", 0x49, identifyTSL2561 },
+	{ "bmp180",  0x77, identifyBMP180 },
+};
+
+/** Result of the scan of one bus */
+struct BusScan {
+	std::string bus;
+	/** Addresses of known sensors, that are not probed */
+	std::set<int> skip;
+	std::vector<const Probe*> found;
+	bool opened;
+	bool complete;
+};
+
+/** Scans one bus. Every thread writes only its own BusScan */
+static void scanBus(BusScan *scan, long long deadline) {
+	const int fd = ::open(scan->bus.c_str(), O_RDWR);
+	size_t i = 0;
+	const size_t count = sizeof(PROBES) / sizeof(PROBES[0]);
+	if(fd >= 0) {
+		// Keep every transaction short and don't retry missing devices
+		ioctl(fd, I2C_TIMEOUT, 2);		// [10 ms]
+		ioctl(fd, I2C_RETRIES, 0);
+
+		for(i = 0; i < count; i++) {
+			if(monotonic_ns() >= deadline) break;
+			const Probe *probe = &PROBES[i];
+			// A known sensor may be running and must not be reset by a probe
+			if(scan->skip.find(probe->address) != scan->skip.end()) continue;
+			if(ioctl(fd, I2C_SLAVE, probe->address) < 0) continue;		// Address in use by a kernel driver
+			if(probe->identify(fd)) scan->found.push_back(probe);
+		}
+		::close(fd);
+	}
+	scan->opened = (fd >= 0);
+	scan->complete = (fd >= 0 && i == count);
+}
+
+
+std::vector<std::string> i2cBuses(void) {
+	std::vector<std::string> buses;
+	DIR *dir = opendir("/dev");
+	if(dir == NULL) return buses;
+	struct dirent *entry;
+	while((entry = readdir(dir)) != NULL) {
+		if(strncmp(entry->d_name, "i2c-", 4) == 0)
+			buses.push_back(std::string("/dev/") + entry->d_name);
+	}
+	closedir(dir);
+	std::sort(buses.begin(), buses.end());
+	return buses;
+}
+
+int detectSensors(const std::vector<std::string> &buses, const std::vector<SensorSpec> &known, std::vector<SensorSpec> &specs, long timeout_ms) {
+	const long long deadline = monotonic_ns() + timeout_ms * 1000000LL;
+	std::vector<BusScan> scans(buses.size());
+	for(size_t i = 0; i < buses.size(); i++) {
+		BusScan &scan = scans[i];
+		scan.bus = buses[i];
+		scan.opened = scan.complete = false;
+		for(std::vector<SensorSpec>::const_iterator it = known.begin(); it != known.end(); ++it)
+			if(it->bus == buses[i]) scan.skip.insert(SensorRegistry::address(*it));
+	}
+	// The threads stop probing at the deadline. They are joined, so that no
+	// probe touches a bus after the scan, e.g. while the sensors are sampled
+	std::vector<std::thread> threads;
+	threads.reserve(scans.size());
+	for(size_t i = 0; i < scans.size(); i++)
+		threads.push_back(std::thread(scanBus, &scans[i], deadline));
+	for(size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	// Multiple sensors of the same type need prefixes to be distinguished
+	std::map<std::string, int> types;
+	for(std::vector<BusScan>::const_iterator scan = scans.begin(); scan != scans.end(); ++scan)
+		for(std::vector<const Probe*>::const_iterator it = scan->found.begin(); it != scan->found.end(); ++it)
+			types[(*it)->type]++;
+
+	int detected = 0;
+	for(std::vector<BusScan>::const_iterator scan = scans.begin(); scan != scans.end(); ++scan) {
+		if(!scan->opened) std::cerr << "Cannot open " << scan->bus << std::endl;
+		else if(!scan->complete) std::cerr << "Scan of " << scan->bus << " timed out" << std::endl;
+		for(std::vector<const Probe*>::const_iterator it = scan->found.begin(); it != scan->found.end(); ++it) {
+			const Probe *probe = *it;
+			SensorSpec spec;
+			std::stringstream name;
+			const size_t dash = scan->bus.rfind('-');
+			name << probe->type << '_' << (dash == std::string::npos ? scan->bus : scan->bus.substr(dash + 1));
+			name << '_' << std::hex << probe->address;
+			spec.name = name.str();
+			spec.type = probe->type;
+			spec.bus = scan->bus;
+			spec.address = probe->address;
+			if(types[probe->type] > 1) spec.prefix = spec.name + "_";
+			specs.push_back(spec);
+			detected++;
+		}
+	}
+	return detected;
+}
+
+}
@@ -0,0 +1,51 @@
+/* =============================================================================
+ *
+ * Title:         Sensor detection
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Parallel I2C bus scan, that identifies the supported
+ *                sensors by their ID registers
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_DETECT_HPP
+#define _METEO_DETECT_HPP
+
+#include <string>
+#include <vector>
+
+#include "registry.hpp"
+
+
+namespace meteo {
+
+/** @returns the device names of all I2C buses of the system (/dev/i2c-*), sorted */
+std::vector<std::string> i2cBuses(void);
+
+/**
+  * Scans the given I2C buses for supported sensors. Every bus is scanned by
+  * its own thread. Only the addresses the supported types can have are
+  * probed and a chip is identified by its ID registers, where it has one.
+  * The addresses of known sensors are not probed, so that a running sensor
+  * is not reset by the identification of the HTU21DF.
+  * Every bus transaction is limited by the I2C adapter timeout. The threads
+  * stop probing after the given time and a bus, that is not done by then,
+  * is reported with the sensors found so far. The scan returns only after
+  * all threads finished their last probe, so that no thread touches a bus
+  * afterwards.
+  * The found sensors are appended as specs named TYPE_BUS_ADDRESS. Their
+  * channels are prefixed by their name, if a type has been found more than once
+  * @param buses Buses to scan
+  * @param known Configured or running sensors, whose addresses are skipped. Their bus must be set
+  * @param specs The detected sensors are appended here
+  * @param timeout_ms Time limit for the scan in milliseconds
+  * @returns the number of detected sensors
+  */
+int detectSensors(const std::vector<std::string> &buses, const std::vector<SensorSpec> &known, std::vector<SensorSpec> &specs, long timeout_ms = 500);
+
+}
+
+
+#endif
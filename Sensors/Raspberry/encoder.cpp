@@ -0,0 +1,140 @@
+/* =============================================================================
+ *
+ * Title:         JSON encoder
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   In-place JSON encoder on a preallocated buffer
+ *
+ * =============================================================================
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "encoder.hpp"
+
+
+namespace meteo {
+
+JsonEncoder::JsonEncoder(size_t capacity) {
+	this->_capacity = (capacity < 2 ? 2 : capacity);
+	this->_buf = (char*)malloc(this->_capacity);
+	if(this->_buf == NULL) throw "Out of memory";
+	this->begin();
+}
+
+JsonEncoder::~JsonEncoder() {
+	free(this->_buf);
+}
+
+void JsonEncoder::append(const char* str, size_t len) {
+	if(this->_len + len >= this->_capacity) {
+		len = this->_capacity - this->_len - 1;
+		this->_overflow = true;
+	}
+	memcpy(this->_buf + this->_len, str, len);
+	this->_len += len;
+	this->_buf[this->_len] = '\0';
+}
+
+void JsonEncoder::append(const char* str) {
+	this->append(str, strlen(str));
+}
+
+void JsonEncoder::key(const char* prefix, const char* key, const char* suffix) {
+	if(this->_first) this->_first = false;
+	else this->append(",", 1);
+	this->append("\"", 1);
+	if(prefix != NULL) this->append(prefix);
+	this->append(key);
+	if(suffix != NULL) this->append(suffix);
+	this->append("\":", 2);
+}
+
+void JsonEncoder::begin(void) {
+	this->_len = 0;
+	this->_first = true;
+	this->_overflow = false;
+	this->_buf[0] = '\0';
+	this->append("{", 1);
+}
+
+void JsonEncoder::field(const char* key, long value) {
+	char buf[32];
+	const int len = snprintf(buf, sizeof(buf), "%ld", value);
+	this->key(NULL, key);
+	this->append(buf, (size_t)len);
+}
+
+void JsonEncoder::field(const char* key, long long value) {
+	char buf[32];
+	const int len = snprintf(buf, sizeof(buf), "%lld", value);
+	this->key(NULL, key);
+	this->append(buf, (size_t)len);
+}
+
+void JsonEncoder::field(const char* key, float value, const char* suffix) {
+	this->field(key, (double)value, suffix);
+}
+
+void JsonEncoder::field(const char* key, double value, const char* suffix) {
+	this->field(NULL, key, value, suffix);
+}
+
+void JsonEncoder::field(const char* prefix, const char* key, double value, const char* suffix) {
+	// Same format as the default formatting of iostreams
+	char buf[32];
+	const int len = snprintf(buf, sizeof(buf), "%g", value);
+	this->key(prefix, key, suffix);
+	this->append(buf, (size_t)len);
+}
+
+void JsonEncoder::field(const char* key, const char* value) {
+	this->key(NULL, key);
+	this->append("\"", 1);
+	this->append(value);
+	this->append("\"", 1);
+}
+
+void JsonEncoder::field(const char* key, const long long *values, size_t count) {
+	char buf[32];
+	this->key(NULL, key);
+	this->append("[", 1);
+	for(size_t i = 0; i < count; i++) {
+		if(i > 0) this->append(",", 1);
+		const int len = snprintf(buf, sizeof(buf), "%lld", values[i]);
+		this->append(buf, (size_t)len);
+	}
+	this->append("]", 1);
+}
+
+void JsonEncoder::end(void) {
+	this->append("}", 1);
+}
+
+void JsonEncoder::beginArray(const char* key) {
+	this->key(NULL, key);
+	this->append("[", 1);
+	this->_first = true;
+}
+
+void JsonEncoder::beginObject(void) {
+	if(this->_first) this->_first = false;
+	else this->append(",", 1);
+	this->append("{", 1);
+	this->_first = true;
+}
+
+void JsonEncoder::endObject(void) {
+	this->append("}", 1);
+	this->_first = false;
+}
+
+void JsonEncoder::endArray(void) {
+	this->append("]", 1);
+	this->_first = false;
+}
+
+}
@@ -0,0 +1,89 @@
+/* =============================================================================
+ *
+ * Title:         JSON encoder
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   In-place JSON encoder on a preallocated buffer
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_ENCODER_HPP
+#define _METEO_ENCODER_HPP
+
+#include <stddef.h>
+
+
+namespace meteo {
+
+/**
+  * Encodes a JSON object into a buffer, that is allocated once. The object
+  * is flat, except for one array of objects (see beginArray()).
+  * Encoding does not allocate memory. If the buffer is too small, the
+  * packet is truncated and overflow() returns true
+  */
+class JsonEncoder {
+private:
+	char *_buf;
+	size_t _capacity;
+	size_t _len;
+	bool _first;
+	bool _overflow;
+
+	void append(const char* str, size_t len);
+	void append(const char* str);
+	void key(const char* prefix, const char* key, const char* suffix = NULL);
+
+	JsonEncoder(const JsonEncoder&);
+	JsonEncoder& operator=(const JsonEncoder&);
+public:
+	/** Allocates the buffer. Throws a const char* on error
+	  * @param capacity Maximum packet size in bytes */
+	JsonEncoder(size_t capacity = 1024);
+	virtual ~JsonEncoder();
+
+	/** Starts a new object */
+	void begin(void);
+	/** Adds an integer field */
+	void field(const char* key, long value);
+	/** Adds an integer field */
+	void field(const char* key, long long value);
+	/** Adds a float field. The key is followed by the optional suffix */
+	void field(const char* key, float value, const char* suffix = NULL);
+	/** Adds a float field. The key is followed by the optional suffix */
+	void field(const char* key, double value, const char* suffix = NULL);
+	/** Adds a float field. The key is preceded by the prefix and followed by the optional suffix */
+	void field(const char* prefix, const char* key, double value, const char* suffix = NULL);
+	/** Adds a string field. The value is not escaped */
+	void field(const char* key, const char* value);
+	/** Adds an array of integers */
+	void field(const char* key, const long long *values, size_t count);
+	/** Closes the object */
+	void end(void);
+
+	/** Starts an array of objects as field of the current object */
+	void beginArray(const char* key);
+	/** Starts a new object in the array */
+	void beginObject(void);
+	/** Closes the object in the array */
+	void endObject(void);
+	/** Closes the array */
+	void endArray(void);
+
+	/** @returns the encoded packet, null-terminated */
+	const char* data(void) const { return this->_buf; }
+	/** @returns the size of the encoded packet in bytes */
+	size_t size(void) const { return this->_len; }
+	/** @returns the number of bytes, that can still be appended */
+	size_t remaining(void) const { return this->_capacity - this->_len - 1; }
+	/** @returns the maximum packet size in bytes */
+	size_t capacity(void) const { return this->_capacity - 1; }
+	/** @returns true if the packet did not fit into the buffer */
+	bool overflow(void) const { return this->_overflow; }
+};
+
+}
+
+
+#endif
@@ -0,0 +1,260 @@
+/* =============================================================================
+ *
+ * Title:         Event loop
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Single-threaded epoll event loop with timerfd, signalfd,
+ *                inotify and GPIO line event helpers
+ *
+ * =============================================================================
+ */
+
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/inotify.h>
+#include <linux/gpio.h>
+
+#include "eventloop.hpp"
+
+#define MAX_EVENTS 16
+#define NS_PER_SEC 1000000000LL
+
+
+namespace meteo {
+
+EventLoop::EventLoop() {
+	this->_running = false;
+	this->_epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(this->_epfd < 0) throw "Error creating epoll instance";
+}
+
+EventLoop::~EventLoop() {
+	::close(this->_epfd);
+}
+
+void EventLoop::add(int fd, uint32_t events, Callback callback) {
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	if(epoll_ctl(this->_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		throw "Error adding file descriptor to epoll";
+	this->_callbacks[fd] = std::make_shared<Callback>(callback);
+}
+
+void EventLoop::modify(int fd, uint32_t events) {
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	if(epoll_ctl(this->_epfd, EPOLL_CTL_MOD, fd, &ev) < 0)
+		throw "Error modifying epoll events";
+}
+
+void EventLoop::remove(int fd) {
+	epoll_ctl(this->_epfd, EPOLL_CTL_DEL, fd, NULL);
+	this->_callbacks.erase(fd);
+}
+
+bool EventLoop::contains(int fd) const {
+	return this->_callbacks.find(fd) != this->_callbacks.end();
+}
+
+int EventLoop::poll(int timeout) {
+	struct epoll_event events[MAX_EVENTS];
+
+	const int n = epoll_wait(this->_epfd, events, MAX_EVENTS, timeout);
+	if(n < 0) {
+		if(errno == EINTR) return 0;
+		return -1;
+	}
+
+	for(int i = 0; i < n; i++) {
+		// A previous callback might have removed this file descriptor
+		std::map<int, std::shared_ptr<Callback> >::iterator it = this->_callbacks.find(events[i].data.fd);
+		if(it == this->_callbacks.end()) continue;
+		std::shared_ptr<Callback> callback = it->second;
+		(*callback)(events[i].events);
+	}
+	return n;
+}
+
+int EventLoop::run(void) {
+	this->_running = true;
+	while(this->_running) {
+		if(this->poll(-1) < 0) return -1;
+	}
+	return 0;
+}
+
+void EventLoop::stop(void) {
+	this->_running = false;
+}
+
+
+
+Timer::Timer() {
+	this->_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(this->_fd < 0) throw "Error creating timerfd";
+}
+
+Timer::~Timer() {
+	::close(this->_fd);
+}
+
+void Timer::setAbsolute(long long deadline) {
+	if(deadline < 0) {
+		this->disarm();
+		return;
+	}
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	spec.it_value.tv_sec = (time_t)(deadline / NS_PER_SEC);
+	spec.it_value.tv_nsec = (long)(deadline % NS_PER_SEC);
+	// A zero it_value would disarm the timer
+	if(spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) spec.it_value.tv_nsec = 1;
+	timerfd_settime(this->_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+void Timer::setPeriodic(long period) {
+	struct itimerspec spec;
+	spec.it_interval.tv_sec = period / 1000L;
+	spec.it_interval.tv_nsec = (period % 1000L) * 1000000L;
+	spec.it_value = spec.it_interval;
+	timerfd_settime(this->_fd, 0, &spec, NULL);
+}
+
+void Timer::disarm(void) {
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	timerfd_settime(this->_fd, 0, &spec, NULL);
+}
+
+uint64_t Timer::acknowledge(void) {
+	uint64_t expirations = 0;
+	if(::read(this->_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+		return 0;
+	return expirations;
+}
+
+
+
+SignalFd::SignalFd(const std::vector<int> &signals) {
+	sigset_t mask;
+	sigemptyset(&mask);
+	for(std::vector<int>::const_iterator it = signals.begin(); it != signals.end(); ++it)
+		sigaddset(&mask, *it);
+	if(sigprocmask(SIG_BLOCK, &mask, NULL) < 0) throw "Error blocking signals";
+
+	this->_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if(this->_fd < 0) throw "Error creating signalfd";
+}
+
+SignalFd::~SignalFd() {
+	::close(this->_fd);
+}
+
+int SignalFd::next(void) {
+	struct signalfd_siginfo info;
+	if(::read(this->_fd, &info, sizeof(info)) != sizeof(info))
+		return -1;
+	return (int)info.ssi_signo;
+}
+
+
+
+FileWatch::FileWatch(const std::string &path) {
+	const size_t slash = path.rfind('/');
+	const std::string dir = (slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash)));
+	this->_name = (slash == std::string::npos ? path : path.substr(slash + 1));
+
+	this->_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(this->_fd < 0) throw "Error creating inotify instance";
+	if(inotify_add_watch(this->_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		::close(this->_fd);
+		throw "Error watching directory";
+	}
+}
+
+FileWatch::~FileWatch() {
+	::close(this->_fd);
+}
+
+bool FileWatch::changed(void) {
+	bool changed = false;
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	for(;;) {
+		const ssize_t len = ::read(this->_fd, buffer, sizeof(buffer));
+		if(len <= 0) break;
+		for(ssize_t offset = 0; offset < len; ) {
+			const struct inotify_event *event = (const struct inotify_event*)(buffer + offset);
+			if(event->len > 0 && this->_name == event->name) changed = true;
+			offset += sizeof(struct inotify_event) + event->len;
+		}
+	}
+	return changed;
+}
+
+
+
+GpioLine::GpioLine(const std::string &chip, int line) {
+	this->_chip = chip;
+	this->_line = line;
+	const int chipfd = ::open(chip.c_str(), O_RDONLY | O_CLOEXEC);
+	if(chipfd < 0) throw "Error opening GPIO chip";
+
+	// The alert outputs are open-drain and active-low
+	struct gpioevent_request request;
+	memset(&request, 0, sizeof(request));
+	request.lineoffset = line;
+	request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	request.eventflags = GPIOEVENT_REQUEST_FALLING_EDGE;
+	strncpy(request.consumer_label, "meteo", sizeof(request.consumer_label) - 1);
+	const int ret = ioctl(chipfd, GPIO_GET_LINEEVENT_IOCTL, &request);
+	::close(chipfd);
+	if(ret < 0) throw "Error requesting GPIO line";
+	this->_fd = request.fd;
+	fcntl(this->_fd, F_SETFL, fcntl(this->_fd, F_GETFL) | O_NONBLOCK);
+	fcntl(this->_fd, F_SETFD, FD_CLOEXEC);
+}
+
+GpioLine::~GpioLine() {
+	::close(this->_fd);
+}
+
+int GpioLine::acknowledge(void) {
+	int edges = 0;
+	struct gpioevent_data event;
+	while(::read(this->_fd, &event, sizeof(event)) == (ssize_t)sizeof(event)) edges++;
+	return edges;
+}
+
+int GpioLine::value(void) const {
+	struct gpiohandle_data data;
+	memset(&data, 0, sizeof(data));
+	if(ioctl(this->_fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0) return -1;
+	return data.values[0];
+}
+
+bool GpioLine::parse(const std::string &spec, std::string &chip, int &line) {
+	const size_t colon = spec.rfind(':');
+	if(colon == std::string::npos || colon == 0 || colon + 1 >= spec.size()) return false;
+	char *endptr = NULL;
+	const long offset = strtol(spec.c_str() + colon + 1, &endptr, 10);
+	if(endptr == NULL || *endptr != '\0' || offset < 0) return false;
+	chip = spec.substr(0, colon);
+	if(chip.find('/') == std::string::npos) chip = "/dev/" + chip;
+	line = (int)offset;
+	return true;
+}
+
+}
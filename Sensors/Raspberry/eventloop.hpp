@@ -0,0 +1,186 @@
+/* =============================================================================
+ *
+ * Title:         Event loop
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Single-threaded epoll event loop with timerfd and signalfd
+ *                helpers
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_EVENTLOOP_HPP
+#define _METEO_EVENTLOOP_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+
+namespace meteo {
+
+/**
+  * epoll based event loop. File descriptors are registered together with a
+  * callback, that is called with the epoll events whenever the descriptor
+  * becomes ready. All callbacks run on the thread that calls run()
+  */
+class EventLoop {
+public:
+	typedef std::function<void(uint32_t events)> Callback;
+private:
+	/** epoll file descriptor */
+	int _epfd;
+	/** Registered callbacks. They are shared, so that a callback can be
+	  * removed while it runs without copying it for every event */
+	std::map<int, std::shared_ptr<Callback> > _callbacks;
+	/** Loop is running */
+	volatile bool _running;
+public:
+	/** Creates the epoll instance. Throws a const char* on error */
+	EventLoop();
+	virtual ~EventLoop();
+
+	/** Registers the given file descriptor. Throws a const char* on error
+	  * @param fd File descriptor to watch
+	  * @param events epoll events (e.g. EPOLLIN)
+	  * @param callback Called when the file descriptor is ready
+	  */
+	void add(int fd, uint32_t events, Callback callback);
+	/** Changes the events of an already registered file descriptor */
+	void modify(int fd, uint32_t events);
+	/** Unregisters the given file descriptor. The descriptor is not closed */
+	void remove(int fd);
+	/** @returns true if the given file descriptor is registered */
+	bool contains(int fd) const;
+
+	/** Dispatches events until stop() is called
+	  * @returns 0 on regular termination, -1 on error
+	  */
+	int run(void);
+	/** Waits at most timeout milliseconds for events and dispatches them
+	  * @returns number of dispatched events or -1 on error
+	  */
+	int poll(int timeout = -1);
+	/** Stops the loop after the current iteration */
+	void stop(void);
+};
+
+
+/**
+  * timerfd on CLOCK_MONOTONIC, that can be armed on absolute deadlines
+  */
+class Timer {
+private:
+	int _fd;
+public:
+	/** Creates the timerfd. Throws a const char* on error */
+	Timer();
+	virtual ~Timer();
+
+	/** @returns the file descriptor to watch for EPOLLIN */
+	int fd(void) const { return this->_fd; }
+
+	/** Arms the timer for the given absolute CLOCK_MONOTONIC time in nanoseconds.
+	  * A negative time disarms the timer */
+	void setAbsolute(long long deadline);
+	/** Arms the timer to fire periodically every period milliseconds */
+	void setPeriodic(long period);
+	/** Disarms the timer */
+	void disarm(void);
+	/** Reads the expiration counter. Must be called when the timer fired
+	  * @returns number of expirations since the last call */
+	uint64_t acknowledge(void);
+};
+
+
+/**
+  * signalfd for the given signals. The signals are blocked for the calling
+  * thread, so they are only delivered through the file descriptor.
+  * This must be done before any other thread is created
+  */
+class SignalFd {
+private:
+	int _fd;
+public:
+	/** Blocks the given signals and creates the signalfd. Throws a const char* on error */
+	SignalFd(const std::vector<int> &signals);
+	virtual ~SignalFd();
+
+	/** @returns the file descriptor to watch for EPOLLIN */
+	int fd(void) const { return this->_fd; }
+
+	/** Reads the next pending signal
+	  * @returns the signal number or -1 if no signal is pending */
+	int next(void);
+};
+
+
+/**
+  * inotify watch of a single file. Its directory is watched, so that a
+  * file replaced by rename (as editors and deployment tools do) is noticed
+  * as well as a file written in place
+  */
+class FileWatch {
+private:
+	int _fd;
+	/** Name of the file within the directory */
+	std::string _name;
+public:
+	/** Creates the watch. Throws a const char* on error */
+	FileWatch(const std::string &path);
+	virtual ~FileWatch();
+
+	/** @returns the file descriptor to watch for EPOLLIN */
+	int fd(void) const { return this->_fd; }
+
+	/** Reads all pending events
+	  * @returns true if the file has been written or replaced */
+	bool changed(void);
+};
+
+
+/**
+  * Edge events of one GPIO line through the GPIO character device
+  * (/dev/gpiochipN). The line is requested as input and every falling edge
+  * is queued by the kernel, so no edge is lost while the loop is busy.
+  * The alert outputs of the sensors are open-drain and active-low, the line
+  * needs a pull-up
+  */
+class GpioLine {
+private:
+	int _fd;
+	/** Chip device, e.g. /dev/gpiochip0 */
+	std::string _chip;
+	/** Line offset on the chip */
+	int _line;
+public:
+	/** Requests the line. Throws a const char* on error */
+	GpioLine(const std::string &chip, int line);
+	virtual ~GpioLine();
+
+	/** @returns the file descriptor to watch for EPOLLIN */
+	int fd(void) const { return this->_fd; }
+	const std::string& chip(void) const { return this->_chip; }
+	int line(void) const { return this->_line; }
+
+	/** Reads all pending events
+	  * @returns number of edges since the last call */
+	int acknowledge(void);
+	/** @returns the current level of the line (0 = alert asserted) or -1 on error */
+	int value(void) const;
+
+	/** Parses a line description CHIP:LINE, e.g. gpiochip0:17 or /dev/gpiochip0:17
+	  * @returns false if the description is illegal */
+	static bool parse(const std::string &spec, std::string &chip, int &line);
+};
+
+}
+
+
+#endif
@@ -0,0 +1,235 @@
+/* =============================================================================
+ *
+ * Title:         Reading filters
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Burst oversampling and per-channel filter stages (median,
+ *                exponential moving average, outlier clipping)
+ *
+ * =============================================================================
+ */
+
+#include <algorithm>
+#include <sstream>
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "filter.hpp"
+
+
+namespace sensors {
+
+/** @returns the median of the given values. The values are reordered */
+static float median(float *values, size_t count) {
+	const size_t middle = count / 2;
+	std::nth_element(values, values + middle, values + count);
+	if(count % 2 == 1) return values[middle];
+	const float upper = values[middle];
+	return (*std::max_element(values, values + middle) + upper) / 2.0F;
+}
+
+float MedianStage::process(float value) {
+	float values[15];
+	this->_ring.push(value);
+	this->_ring.copy(values);
+	return median(values, this->_ring.size());
+}
+
+float EmaStage::process(float value) {
+	if(this->_empty) {
+		this->_value = value;
+		this->_empty = false;
+	} else
+		this->_value = this->_alpha * this->_value + (1.0F - this->_alpha) * value;
+	return this->_value;
+}
+
+float ClipStage::process(float value) {
+	// Median and median absolute deviation of the previous values
+	float values[15];
+	const size_t n = this->_ring.size();
+	this->_ring.copy(values);
+	this->_ring.push(value);
+	if(n < 3) return value;		// Too few values for an estimate
+	
+	const float center = median(values, n);
+	for(size_t i = 0; i < n; i++) values[i] = fabsf(values[i] - center);
+	const float sigma = 1.4826F * median(values, n);		// MAD of a normal distribution
+	if(sigma <= 0.0F) return value;
+
+	const float bound = this->_k * sigma;
+	if(value > center + bound) return center + bound;
+	if(value < center - bound) return center - bound;
+	return value;
+}
+
+
+/** Parses a float. Throws a const char* on error */
+static float parseFloat(const std::string &value) {
+	char *endptr = NULL;
+	const float result = strtof(value.c_str(), &endptr);
+	if(value.empty() || endptr == NULL || *endptr != '\0') throw "Illegal filter parameter";
+	return result;
+}
+
+/** Removes leading and trailing whitespace */
+static std::string strip(const std::string &value) {
+	const size_t first = value.find_first_not_of(" \t");
+	if(first == std::string::npos) return "";
+	return value.substr(first, value.find_last_not_of(" \t") - first + 1);
+}
+
+FilterChain::~FilterChain() {
+	for(std::vector<Stage*>::iterator it = this->_stages.begin(); it != this->_stages.end(); ++it)
+		delete *it;
+}
+
+void FilterChain::parse(const std::string &description) {
+	std::stringstream stages(description);
+	std::string stage;
+	while(std::getline(stages, stage, ',')) {
+		stage = strip(stage);
+		if(stage.empty()) continue;
+		if(this->_stages.size() >= MAX_STAGES) throw "Too many filter stages";
+
+		std::vector<std::string> args;
+		std::stringstream ss(stage);
+		std::string arg;
+		while(std::getline(ss, arg, ':')) args.push_back(strip(arg));
+
+		const std::string &type = args[0];
+		if(type == "median") {
+			if(args.size() != 2) throw "Usage: median:N";
+			const float window = parseFloat(args[1]);
+			if(window < 1.0F || window > 15.0F) throw "Median window must be 1-15";
+			this->_stages.push_back(new MedianStage((size_t)window));
+		} else if(type == "ema") {
+			if(args.size() != 2) throw "Usage: ema:ALPHA";
+			const float alpha = parseFloat(args[1]);
+			if(alpha < 0.0F || alpha >= 1.0F) throw "EMA alpha must be in [0,1)";
+			this->_stages.push_back(new EmaStage(alpha));
+		} else if(type == "clip") {
+			if(args.size() != 2 && args.size() != 3) throw "Usage: clip:K[:N]";
+			const float k = parseFloat(args[1]);
+			if(k <= 0.0F) throw "Clip bound must be positive";
+			const float window = (args.size() == 3 ? parseFloat(args[2]) : 8.0F);
+			if(window < 4.0F || window > 15.0F) throw "Clip window must be 4-15";
+			this->_stages.push_back(new ClipStage(k, (size_t)window));
+		} else
+			throw "Unknown filter stage";
+	}
+}
+
+float FilterChain::process(float value) {
+	for(std::vector<Stage*>::iterator it = this->_stages.begin(); it != this->_stages.end(); ++it)
+		value = (*it)->process(value);
+	return value;
+}
+
+void FilterChain::reset(void) {
+	for(std::vector<Stage*>::iterator it = this->_stages.begin(); it != this->_stages.end(); ++it)
+		(*it)->reset();
+}
+
+
+Filter::Filter(size_t channels, int burst) {
+	this->_channels = channels;
+	this->_chains.assign(channels, (FilterChain*)NULL);
+	this->_burst = (burst < 1 ? 1 : (burst > MAX_BURST ? MAX_BURST : burst));
+	this->_count = 0;
+	this->_sum.assign(channels, 0.0F);
+	this->_values.assign(channels, 0.0F);
+}
+
+Filter::~Filter() {
+	for(std::vector<FilterChain*>::iterator it = this->_chains.begin(); it != this->_chains.end(); ++it)
+		delete *it;
+}
+
+void Filter::setChain(size_t channel, FilterChain *chain) {
+	if(channel >= this->_channels) {
+		delete chain;
+		return;
+	}
+	delete this->_chains[channel];
+	this->_chains[channel] = chain;
+}
+
+bool Filter::add(const float *readings) {
+	if(this->_count == 0)
+		std::fill(this->_sum.begin(), this->_sum.end(), 0.0F);
+	for(size_t i = 0; i < this->_channels; i++)
+		this->_sum[i] += readings[i];
+	if(++this->_count < this->_burst) return false;
+
+	for(size_t i = 0; i < this->_channels; i++) {
+		const float mean = this->_sum[i] / (float)this->_count;
+		this->_values[i] = (this->_chains[i] == NULL ? mean : this->_chains[i]->process(mean));
+	}
+	this->_count = 0;
+	return true;
+}
+
+void Filter::reset(void) {
+	this->_count = 0;
+	for(std::vector<FilterChain*>::iterator it = this->_chains.begin(); it != this->_chains.end(); ++it)
+		if(*it != NULL) (*it)->reset();
+}
+
+/** @returns the burst option or 1 */
+static int burstOf(const std::map<std::string, std::string> &options) {
+	std::map<std::string, std::string>::const_iterator it = options.find("burst");
+	if(it == options.end()) return 1;
+	const float burst = parseFloat(strip(it->second));
+	if(burst < 1.0F || burst > (float)Filter::MAX_BURST) throw "Burst must be 1-64";
+	return (int)burst;
+}
+
+void Filter::check(const std::map<std::string, std::string> &options) {
+	burstOf(options);
+	for(std::map<std::string, std::string>::const_iterator it = options.begin(); it != options.end(); ++it) {
+		if(it->first != "filter" && it->first.compare(0, 7, "filter.") != 0) continue;
+		FilterChain chain;
+		chain.parse(it->second);
+	}
+}
+
+Filter* Filter::create(const Sensor *sensor, const std::map<std::string, std::string> &options) {
+	const int burst = burstOf(options);
+	std::map<std::string, std::string>::const_iterator all = options.find("filter");
+	bool filtered = (burst > 1 || all != options.end());
+
+	const Channel *channels = sensor->channels();
+	const size_t count = sensor->channelCount();
+	for(std::map<std::string, std::string>::const_iterator it = options.begin(); it != options.end() && !filtered; ++it)
+		filtered = (it->first.compare(0, 7, "filter.") == 0);
+	if(!filtered) return NULL;
+
+	Filter *filter = new Filter(count, burst);
+	try {
+		for(size_t i = 0; i < count; i++) {
+			// A filter of the channel replaces the one of all channels
+			std::map<std::string, std::string>::const_iterator it = options.find(std::string("filter.") + channels[i].name);
+			if(it == options.end()) it = all;
+			if(it == options.end()) continue;
+			FilterChain *chain = new FilterChain();
+			filter->setChain(channels[i].index, chain);
+			chain->parse(it->second);
+		}
+		for(std::map<std::string, std::string>::const_iterator it = options.begin(); it != options.end(); ++it) {
+			if(it->first.compare(0, 7, "filter.") != 0) continue;
+			bool found = false;
+			for(size_t i = 0; i < count && !found; i++)
+				found = (it->first.substr(7) == channels[i].name);
+			if(!found) throw "Filter of unknown channel";
+		}
+	} catch (...) {
+		delete filter;
+		throw;
+	}
+	return filter;
+}
+
+}
@@ -0,0 +1,219 @@
+/* =============================================================================
+ *
+ * Title:         Reading filters
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Burst oversampling and per-channel filter stages (median,
+ *                exponential moving average, outlier clipping)
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_FILTER_HPP
+#define _METEO_FILTER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sensor.hpp"
+
+
+namespace sensors {
+
+/**
+  * Ring buffer of the last N values with a fixed capacity.
+  * It never allocates memory
+  */
+template <size_t N> class Ring {
+private:
+	float _values[N];
+	/** Number of values, at most the window */
+	size_t _size;
+	/** Position of the next value */
+	size_t _next;
+	/** Number of values kept (<= N) */
+	size_t _window;
+public:
+	Ring(size_t window = N) : _size(0), _next(0), _window(window < 1 ? 1 : (window > N ? N : window)) {}
+
+	void push(float value) {
+		this->_values[this->_next] = value;
+		this->_next = (this->_next + 1) % this->_window;
+		if(this->_size < this->_window) this->_size++;
+	}
+	void clear(void) { this->_size = 0; this->_next = 0; }
+
+	/** @returns the number of values */
+	size_t size(void) const { return this->_size; }
+	/** @returns the number of values kept */
+	size_t window(void) const { return this->_window; }
+	/** Copies the values into the given array (unordered) */
+	void copy(float *dst) const {
+		for(size_t i = 0; i < this->_size; i++) dst[i] = this->_values[i];
+	}
+};
+
+/** One processing step of a filter chain */
+class Stage {
+public:
+	virtual ~Stage() {}
+	/** Processes the next input value
+	  * @returns the output value */
+	virtual float process(float value) = 0;
+	/** Forgets all previous values */
+	virtual void reset(void) = 0;
+};
+
+/** Median of the last N values. Removes single spikes without lagging behind steps */
+class MedianStage : public Stage {
+private:
+	Ring<15> _ring;
+public:
+	/** @param window Number of values (at most 15) */
+	MedianStage(size_t window) : _ring(window) {}
+	virtual float process(float value);
+	virtual void reset(void) { this->_ring.clear(); }
+};
+
+/** Exponential moving average: y = alpha * y + (1 - alpha) * x.
+  * alpha has the same meaning as SAMPLE_ALPHA of the ESP32 nodes */
+class EmaStage : public Stage {
+private:
+	float _alpha;
+	float _value;
+	bool _empty;
+public:
+	/** @param alpha Weight of the previous output (0 <= alpha < 1) */
+	EmaStage(float alpha) : _alpha(alpha), _value(0.0F), _empty(true) {}
+	virtual float process(float value);
+	virtual void reset(void) { this->_empty = true; }
+};
+
+/**
+  * Outlier clipping: Values further than k standard deviations away from the
+  * median of the last N inputs are clipped to that bound. The standard deviation
+  * is estimated by the median absolute deviation, so that the outliers
+  * themselves do not widen the bound. Raw inputs are kept, so a real step is
+  * followed once it makes up half of the window
+  */
+class ClipStage : public Stage {
+private:
+	Ring<15> _ring;
+	float _k;
+public:
+	/** @param k Bound in standard deviations
+	  * @param window Number of values (at most 15) */
+	ClipStage(float k, size_t window = 8) : _ring(window), _k(k) {}
+	virtual float process(float value);
+	virtual void reset(void) { this->_ring.clear(); }
+};
+
+/**
+  * Chain of filter stages for one channel. The stages are created once by
+  * parse(), processing a value does not allocate memory
+  */
+class FilterChain {
+private:
+	std::vector<Stage*> _stages;
+
+	FilterChain(const FilterChain&);
+	FilterChain& operator=(const FilterChain&);
+public:
+	FilterChain() {}
+	virtual ~FilterChain();
+
+	/**
+	  * Appends the stages of the given description, a comma separated list of
+	  *
+	  *     median:N     Median of the last N values
+	  *     ema:ALPHA    Exponential moving average
+	  *     clip:K[:N]   Clip values further than K standard deviations from the median of N values (default: 8)
+	  *
+	  * e.g. "clip:3, median:5, ema:0.75". Throws a const char* on error
+	  */
+	void parse(const std::string &description);
+
+	/** @returns the output of the chain for the given input */
+	float process(float value);
+	void reset(void);
+	/** @returns the number of stages */
+	size_t size(void) const { return this->_stages.size(); }
+
+	/** Maximum number of stages per chain */
+	static const size_t MAX_STAGES = 8;
+};
+
+/**
+  * Filter of all channels of a sensor. A sensor with a filter is read burst
+  * times per readout and the mean of the burst is fed through the chain of
+  * every channel. Sensor::reading() returns the output of the chains
+  */
+class Filter {
+private:
+	size_t _channels;
+	/** Chain of each channel, NULL if unfiltered */
+	std::vector<FilterChain*> _chains;
+	/** Readings per readout */
+	int _burst;
+	/** Number of readings of the current burst */
+	int _count;
+	/** Sum of the readings of the current burst */
+	std::vector<float> _sum;
+	/** Output of each channel */
+	std::vector<float> _values;
+
+	Filter(const Filter&);
+	Filter& operator=(const Filter&);
+public:
+	/** @param channels Number of channels
+	  * @param burst Readings per readout */
+	Filter(size_t channels, int burst = 1);
+	virtual ~Filter();
+
+	/** Sets the chain of the given channel. The filter takes ownership */
+	void setChain(size_t channel, FilterChain *chain);
+
+	/** @returns the readings per readout */
+	int burst(void) const { return this->_burst; }
+
+	/** Discards a started burst */
+	void discard(void) { this->_count = 0; }
+
+	/**
+	  * Adds the readings of the sensor to the current burst. If the burst is
+	  * complete, its mean is fed through the chains
+	  * @returns true if the burst is complete, false if more readings are needed
+	  */
+	bool add(const float *readings);
+
+	/** @returns the filtered readings, at the same index as the raw readings */
+	const float* values(void) const { return &this->_values[0]; }
+
+	/** Forgets all previous readings */
+	void reset(void);
+
+	/**
+	  * Creates the filter for the given sensor from the options of its config section:
+	  *
+	  *     burst = N              Readings per readout (default: 1)
+	  *     filter = STAGES        Filter chain of all channels, see FilterChain::parse()
+	  *     filter.CHANNEL = STAGES  Filter chain of a single channel, e.g. filter.p
+	  *
+	  * Throws a const char* on error
+	  * @returns the filter or NULL, if the options do not define one
+	  */
+	static Filter* create(const Sensor *sensor, const std::map<std::string, std::string> &options);
+
+	/** Checks the filter options without a sensor. Throws a const char* on error */
+	static void check(const std::map<std::string, std::string> &options);
+
+	/** Maximum readings per readout */
+	static const int MAX_BURST = 64;
+};
+
+}
+
+
+#endif
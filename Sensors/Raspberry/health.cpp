@@ -0,0 +1,180 @@
+/* =============================================================================
+ *
+ * Title:         Sensor health
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Circuit breaker with exponential backoff for failing sensors
+ *
+ * =============================================================================
+ */
+
+#include <sstream>
+#include <iostream>
+
+#include "health.hpp"
+#include "scheduler.hpp"
+#include "publisher.hpp"
+
+#define NS_PER_MS 1000000LL
+
+
+namespace meteo {
+
+SensorHealth::SensorHealth(sensors::Sensor *sensor, int threshold, long backoff_ms, long backoff_max_ms) {
+	this->_sensor = sensor;
+	this->_state = CLOSED;
+	this->_since = monotonic_ns();
+	for(int i = 0; i < 3; i++) this->_time[i] = 0;
+	this->_retry = 0;
+	this->_consecutive = 0;
+	this->_failures = 0;
+	this->_skipped = 0;
+	this->_probes = 0;
+	this->_late = 0;
+	this->_last_good = 0;
+	this->_threshold = (threshold < 1 ? 1 : threshold);
+	this->_backoff_min = backoff_ms * NS_PER_MS;
+	this->_backoff_max = backoff_max_ms * NS_PER_MS;
+	if(this->_backoff_max < this->_backoff_min) this->_backoff_max = this->_backoff_min;
+	this->_backoff = this->_backoff_min;
+}
+
+SensorHealth::~SensorHealth() {}
+
+void SensorHealth::transition(State state, long long now) {
+	if(state == this->_state) return;
+	this->_time[this->_state] += now - this->_since;
+	this->_since = now;
+	this->_state = state;
+}
+
+bool SensorHealth::allow(long long now) {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	if(this->_state != OPEN) return true;
+	if(now < this->_retry) {
+		this->_skipped++;
+		return false;
+	}
+	this->transition(HALF_OPEN, now);
+	this->_probes++;
+	return true;
+}
+
+bool SensorHealth::probing(void) const {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	return this->_state == HALF_OPEN;
+}
+
+void SensorHealth::success(long long now) {
+	bool recovered;
+	{
+		std::lock_guard<std::mutex> lock(this->_mutex);
+		recovered = (this->_state != CLOSED);
+		this->_consecutive = 0;
+		this->_backoff = this->_backoff_min;
+		this->_last_good = now;
+		this->transition(CLOSED, now);
+	}
+	// Printed without holding the state lock, the main thread might wait for
+	// it while holding the console
+	if(recovered) {
+		std::lock_guard<std::mutex> lock(Publisher::console());
+		std::cerr << "Sensor 0x" << std::hex << this->_sensor->address() << std::dec << " on " << this->_sensor->device() << " recovered" << std::endl;
+	}
+}
+
+void SensorHealth::late(long long now) {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	this->_late++;
+	// A probe that ran out of time is tried again in the next cycle
+	if(this->_state == HALF_OPEN) {
+		this->transition(OPEN, now);
+		this->_retry = now;
+	}
+}
+
+void SensorHealth::failure(long long now) {
+	int consecutive;
+	long long backoff;
+	{
+		std::lock_guard<std::mutex> lock(this->_mutex);
+		this->_failures++;
+		this->_consecutive++;
+		if(this->_state == HALF_OPEN) {
+			// Probe failed. Exponential backoff
+			this->_backoff *= 2;
+			if(this->_backoff > this->_backoff_max) this->_backoff = this->_backoff_max;
+		} else if(this->_state == CLOSED && this->_consecutive < this->_threshold)
+			return;
+
+		this->transition(OPEN, now);
+		this->_retry = now + this->_backoff;
+		consecutive = this->_consecutive;
+		backoff = this->_backoff;
+	}
+	std::lock_guard<std::mutex> lock(Publisher::console());
+	std::cerr << "Sensor 0x" << std::hex << this->_sensor->address() << std::dec << " on " << this->_sensor->device() << " failed " << consecutive << " times. Next probe in " << (backoff / NS_PER_MS) / 1000.0 << " s" << std::endl;
+}
+
+SensorHealth::State SensorHealth::state(void) const {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	return this->_state;
+}
+
+long SensorHealth::failures(void) const {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	return this->_failures;
+}
+
+long SensorHealth::skipped(void) const {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	return this->_skipped;
+}
+
+long SensorHealth::probes(void) const {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	return this->_probes;
+}
+
+long SensorHealth::lateReads(void) const {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	return this->_late;
+}
+
+long long SensorHealth::lastGood(void) const {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	return this->_last_good;
+}
+
+double SensorHealth::age(long long now) const {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	if(this->_last_good == 0) return -1.0;
+	return (now - this->_last_good) / 1e9;
+}
+
+double SensorHealth::time(State state) const {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	long long result = this->_time[state];
+	if(state == this->_state) result += monotonic_ns() - this->_since;
+	return result / 1e9;
+}
+
+std::string SensorHealth::toString(void) const {
+	std::stringstream ss;
+	ss << "0x" << std::hex << this->_sensor->address() << std::dec << " on " << this->_sensor->device() << ": ";
+	ss << stateName(this->state()) << ", " << this->failures() << " failures, " << this->skipped() << " skipped, " << this->probes() << " probes, " << this->lateReads() << " late";
+	ss << " (closed " << this->time(CLOSED) << " s, open " << this->time(OPEN) << " s, half-open " << this->time(HALF_OPEN) << " s)";
+	return ss.str();
+}
+
+const char* SensorHealth::stateName(State state) {
+	switch(state) {
+	case CLOSED: return "closed";
+	case OPEN: return "open";
+	case HALF_OPEN: return "half-open";
+	default: return "unknown";
+	}
+}
+
+}
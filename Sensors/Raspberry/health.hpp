@@ -0,0 +1,118 @@
+/* =============================================================================
+ *
+ * Title:         Sensor health
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Circuit breaker with exponential backoff for failing sensors
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_HEALTH_HPP
+#define _METEO_HEALTH_HPP
+
+#include <string>
+#include <mutex>
+
+#include "sensor.hpp"
+
+
+namespace meteo {
+
+/**
+  * Health of a single sensor, tracked as circuit breaker.
+  * While the sensor works the breaker is CLOSED. After a number of
+  * consecutive failures it goes OPEN and the sensor is skipped without
+  * touching the bus. When the backoff time is over, the breaker becomes
+  * HALF_OPEN and the next read is a probe, that re-initializes the sensor.
+  * A successful probe closes the breaker again, a failed probe re-opens it
+  * with twice the backoff time.
+  *
+  * The breaker is driven by the thread that reads the sensor, the statistics
+  * may be read from any thread.
+  */
+class SensorHealth {
+public:
+	enum State { CLOSED = 0, OPEN = 1, HALF_OPEN = 2 };
+private:
+	sensors::Sensor *_sensor;
+
+	mutable std::mutex _mutex;
+	State _state;
+	/** Monotonic time of the last state change [ns] */
+	long long _since;
+	/** Time spent in each state, without the current one [ns] */
+	long long _time[3];
+	/** Monotonic time, when the breaker becomes half-open [ns] */
+	long long _retry;
+	/** Current backoff [ns] */
+	long long _backoff;
+
+	/** Consecutive failures */
+	int _consecutive;
+	/** Total failures, skipped reads and probes */
+	long _failures, _skipped, _probes;
+	/** Reads abandoned due to the cycle budget */
+	long _late;
+	/** Monotonic time of the last successful read [ns], 0 if never */
+	long long _last_good;
+
+	/** Consecutive failures that open the breaker */
+	int _threshold;
+	/** First and maximum backoff [ns] */
+	long long _backoff_min, _backoff_max;
+
+	/** Changes the state. Must be called with the mutex held */
+	void transition(State state, long long now);
+public:
+	/**
+	  * @param sensor Sensor to be tracked
+	  * @param threshold Consecutive failures that open the breaker
+	  * @param backoff_ms Backoff after the breaker opened in milliseconds
+	  * @param backoff_max_ms Maximum backoff in milliseconds
+	  */
+	SensorHealth(sensors::Sensor *sensor, int threshold = 3, long backoff_ms = 5000L, long backoff_max_ms = 300000L);
+	virtual ~SensorHealth();
+
+	sensors::Sensor* sensor(void) const { return this->_sensor; }
+
+	/**
+	  * Checks if the sensor should be read now. An open breaker whose
+	  * backoff is over becomes half-open and the read is a probe
+	  * @returns false if the sensor is skipped
+	  */
+	bool allow(long long now);
+	/** @returns true if the current read is a probe */
+	bool probing(void) const;
+
+	/** Reports a successful read */
+	void success(long long now);
+	/** Reports a failed read */
+	void failure(long long now);
+	/** Reports a read, that has been abandoned because it exceeded the cycle budget.
+	  * This is not counted as failure */
+	void late(long long now);
+
+	State state(void) const;
+	long failures(void) const;
+	long skipped(void) const;
+	long probes(void) const;
+	long lateReads(void) const;
+	/** @returns monotonic time of the last successful read in nanoseconds or 0 if never */
+	long long lastGood(void) const;
+	/** @returns the age of the last successful read in seconds or a negative value if never */
+	double age(long long now) const;
+	/** @returns time spent in the given state in seconds */
+	double time(State state) const;
+
+	/** @returns a one-line summary of the statistics */
+	std::string toString(void) const;
+
+	static const char* stateName(State state);
+};
+
+}
+
+
+#endif
@@ -0,0 +1,74 @@
+/* =============================================================================
+ *
+ * Title:         Latency histogram
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Fixed-size histogram of durations with power-of-two
+ *                buckets
+ *
+ * =============================================================================
+ */
+
+#include <sstream>
+
+#include "histogram.hpp"
+
+
+namespace meteo {
+
+Histogram::Histogram() {
+	this->clear();
+}
+
+void Histogram::add(long long duration) {
+	if(duration < 0) return;
+	long long micros = duration / 1000LL;
+	int bucket = 0;
+	while(micros > 0 && bucket < BUCKETS - 1) {
+		micros >>= 1;
+		bucket++;
+	}
+	this->_counts[bucket]++;
+	this->_count++;
+	this->_sum += duration;
+	if(duration > this->_max) this->_max = duration;
+}
+
+void Histogram::clear(void) {
+	for(int i = 0; i < BUCKETS; i++) this->_counts[i] = 0;
+	this->_count = 0;
+	this->_sum = 0;
+	this->_max = 0;
+}
+
+double Histogram::mean(void) const {
+	if(this->_count == 0) return 0.0;
+	return (double)this->_sum / this->_count / 1e6;
+}
+
+double Histogram::percentile(double p) const {
+	if(this->_count == 0) return 0.0;
+	const double rank = p / 100.0 * this->_count;
+	long seen = 0;
+	for(int i = 0; i < BUCKETS; i++) {
+		seen += this->_counts[i];
+		if(seen >= rank && seen > 0) {
+			// The maximum is a tighter bound for the last bucket
+			const double bound = (double)(1LL << i) / 1e3;
+			return (bound < this->max() ? bound : this->max());
+		}
+	}
+	return this->max();
+}
+
+std::string Histogram::toString(void) const {
+	std::stringstream ss;
+	ss << "count " << this->_count;
+	if(this->_count == 0) return ss.str();
+	ss << ", mean " << this->mean() << " ms, p50 " << this->percentile(50.0) << " ms, p90 " << this->percentile(90.0);
+	ss << " ms, p99 " << this->percentile(99.0) << " ms, max " << this->max() << " ms";
+	return ss.str();
+}
+
+}
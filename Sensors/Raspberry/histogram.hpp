@@ -0,0 +1,58 @@
+/* =============================================================================
+ *
+ * Title:         Latency histogram
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Fixed-size histogram of durations with power-of-two
+ *                buckets
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_HISTOGRAM_HPP
+#define _METEO_HISTOGRAM_HPP
+
+#include <string>
+
+
+namespace meteo {
+
+/**
+  * Histogram of durations. Bucket i counts the durations below 2^i
+  * microseconds, that did not fit into bucket i-1. Adding a duration does
+  * not allocate memory, percentiles are reported as the upper bound of
+  * their bucket
+  */
+class Histogram {
+public:
+	static const int BUCKETS = 32;
+private:
+	long _counts[BUCKETS];
+	long _count;
+	/** Sum and maximum of all durations [ns] */
+	long long _sum, _max;
+public:
+	Histogram();
+
+	/** Adds a duration in nanoseconds. Negative durations are ignored */
+	void add(long long duration);
+	void clear(void);
+
+	/** @returns the number of durations */
+	long count(void) const { return this->_count; }
+	/** @returns the mean duration in milliseconds */
+	double mean(void) const;
+	/** @returns the maximum duration in milliseconds */
+	double max(void) const { return this->_max / 1e6; }
+	/** @returns the upper bound of the given percentile (0-100) in milliseconds */
+	double percentile(double p) const;
+
+	/** @returns count, mean, p50, p90, p99 and maximum */
+	std::string toString(void) const;
+};
+
+}
+
+
+#endif
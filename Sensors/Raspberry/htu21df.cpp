@@ -23,26 +23,38 @@
 
 namespace sensors {
 
+constexpr Channel HTU21DF::CHANNEL_TABLE[];
+
+/** User register resolution bits of the precision levels, fastest first
+  * (temperature and humidity conversion 7+8, 13+3, 25+5 and 50+16 ms) */
+static const uint8_t RESOLUTIONS[] = { HTU21DF_RES_RH11_T11, HTU21DF_RES_RH8_T12, HTU21DF_RES_RH10_T13, HTU21DF_RES_RH12_T14 };
+/** Level after a reset */
+static const int DEFAULT_LEVEL = 3;
+
 
 HTU21DF::HTU21DF(const char* i2c_device, int address) : Sensor(i2c_device, address) {
 	this->i2cfd = 0;
+	this->_phase = 0;
+	this->_level = DEFAULT_LEVEL;
 	int ret = init();
 	if(ret < 0) {
 		this->_error = true;
 	}
-	this->t = 0.0;
-	this->h = 0.0;
+	this->_readings[CH_T] = 0.0F;
+	this->_readings[CH_HUM] = 0.0F;
 }
 
 
 HTU21DF::HTU21DF(const std::string i2c_device, int address)  : Sensor(i2c_device, address) {
 	this->i2cfd = 0;
+	this->_phase = 0;
+	this->_level = DEFAULT_LEVEL;
 	int ret = init();
 	if(ret < 0) {
 		this->_error = true;
 	}
-	this->t = 0.0;
-	this->h = 0.0;
+	this->_readings[CH_T] = 0.0F;
+	this->_readings[CH_HUM] = 0.0F;
 }
 
 
@@ -55,6 +67,11 @@ int HTU21DF::init() {
 	int fd;
 	int rc;
 	
+	if(this->i2cfd > 0) {
+		i2c_close(this->i2cfd);
+		this->i2cfd = 0;
+	}
+	this->_phase = 0;
 	fd = i2c_open(this->_device.c_str());
 	if(fd < 0)
 		return -1;		// i2c_open failed
@@ -63,8 +80,14 @@ int HTU21DF::init() {
 		i2c_close(fd);
 		return -2;		// i2c_init failed
 	}
+	// The reset in htu21df_init restored the default resolution
+	if(this->_level != DEFAULT_LEVEL && htu21df_set_resolution(fd, RESOLUTIONS[this->_level]) < 0) {
+		i2c_close(fd);
+		return -3;
+	}
 	
 	this->i2cfd = fd;
+	this->_error = false;
 	return 0;
 }
 	
@@ -72,14 +95,67 @@ int HTU21DF::read() {
 	int rc;
 	int ret = 0;
 	
-	rc = htu21df_read_temperature(this->i2cfd, &this->t);
+	if(this->i2cfd <= 0) return -1;
+	rc = htu21df_read_temperature(this->i2cfd, &this->_readings[CH_T]);
 	if(rc != 0) ret = -1;
-	rc = htu21df_read_humidity(this->i2cfd, &this->h);
+	rc = htu21df_read_humidity(this->i2cfd, &this->_readings[CH_HUM]);
 	if(rc != 0) ret += -2;
 	
 	return ret;
 }
 
+long HTU21DF::start() {
+	if(this->i2cfd <= 0) return -1;
+	
+	if(htu21df_start_temperature(this->i2cfd) < 0) return -1;
+	this->_phase = 1;
+	return htu21df_resolution_temperature_ms(RESOLUTIONS[this->_level]) * 1000L;
+}
+
+long HTU21DF::collect() {
+	switch(this->_phase) {
+	case 1:
+		// Temperature is ready. Continue with humidity
+		this->_phase = 0;
+		if(htu21df_fetch_temperature(this->i2cfd, &this->_readings[CH_T]) != 0) return -1;
+		if(htu21df_start_humidity(this->i2cfd) < 0) return -2;
+		this->_phase = 2;
+		return htu21df_resolution_humidity_ms(RESOLUTIONS[this->_level]) * 1000L;
+	case 2:
+		this->_phase = 0;
+		if(htu21df_fetch_humidity(this->i2cfd, &this->_readings[CH_HUM]) != 0) return -2;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+void HTU21DF::abort() {
+	// The pending result is discarded by the next start()
+	this->_phase = 0;
+}
+
+int HTU21DF::setPrecision(int level) {
+	if(level < 0 || level > DEFAULT_LEVEL) return -1;
+	if(this->i2cfd > 0) {
+		this->_phase = 0;
+		if(htu21df_set_resolution(this->i2cfd, RESOLUTIONS[level]) < 0) return -2;
+	}
+	this->_level = level;
+	return 0;
+}
+
+std::string HTU21DF::precisionName(int level) const {
+	static const char* names[] = { "RH 11/T 11 bit", "RH 8/T 12 bit", "RH 10/T 13 bit", "RH 12/T 14 bit" };
+	if(level < 0 || level > DEFAULT_LEVEL) return "";
+	return names[level];
+}
+
+long HTU21DF::conversionTime(void) const {
+	const uint8_t resolution = RESOLUTIONS[this->_level];
+	return (htu21df_resolution_temperature_ms(resolution) + htu21df_resolution_humidity_ms(resolution)) * 1000L;
+}
+
 
 }
 
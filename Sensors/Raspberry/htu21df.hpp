@@ -26,30 +26,49 @@
 namespace sensors {
 
 class HTU21DF : public Sensor {
+public:
+	/** Channel indices */
+	enum { CH_HUM = 0, CH_T, CHANNELS };
+	/** Channel descriptors, available at compile time */
+	static constexpr Channel CHANNEL_TABLE[CHANNELS] = {
+		{ "hum", "%", CHANNEL_HUMIDITY, CH_HUM },
+		{ "t", "C", CHANNEL_TEMPERATURE, CH_T },
+	};
 private:
 	// Last readings
-	float t, h;
+	float _readings[CHANNELS];
 	
 	
 	int i2cfd;
 	
-	int init();
+	/** Running conversion (0 = none, 1 = temperature, 2 = humidity) */
+	int _phase;
+	/** Precision level, restored on init() */
+	int _level;
 public:
 	HTU21DF(const char* i2c_device, int address=DEVICE_ADDRESS);
 	HTU21DF(const std::string i2c_device, int address=DEVICE_ADDRESS);
 	virtual ~HTU21DF();
 	
+	virtual int init(void);
 	int read(void);
+	virtual long start(void);
+	virtual long collect(void);
+	virtual void abort(void);
+	
+	/** Sets the resolution (0 = RH 11/T 11 bit, 1 = 8/12, 2 = 10/13, 3 = 12/14 bit, default: 3) */
+	virtual int setPrecision(int level);
+	virtual int precision(void) const { return this->_level; }
+	virtual int precisionLevels(void) const { return 4; }
+	virtual std::string precisionName(int level) const;
+	virtual long conversionTime(void) const;
 	
-	float temperature() { return this->t; }
-	float humidity() { return this->h; }
+	float temperature() { return this->_readings[CH_T]; }
+	float humidity() { return this->_readings[CH_HUM]; }
 	
-	virtual std::map<std::string,float> values(void) const {
-		std::map<std::string,float> ret;
-		ret["t"] = this->t;
-		ret["hum"] = this->h;
-		return ret;
-	}
+	virtual size_t channelCount(void) const { return CHANNELS; }
+	virtual const Channel* channels(void) const { return CHANNEL_TABLE; }
+	virtual const float* readings(void) const { return this->_readings; }
 	
 	static const int DEVICE_ADDRESS = 0x40;
 };
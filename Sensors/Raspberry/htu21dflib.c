@@ -40,7 +40,7 @@ static const int MAX_RESET_DELAY        = 15;   // ms
 
 static uint8_t HTU21DF_READTEMP_NH      = 0xF3; // NH = no hold
 static uint8_t HTU21DF_READHUMI_NH      = 0xF5;
-//static uint8_t HTU21DF_WRITEREG         = 0xE6;
+static uint8_t HTU21DF_WRITEREG         = 0xE6;
 static uint8_t HTU21DF_READREG          = 0xE7;
 static uint8_t HTU21DF_RESET            = 0xFE;
 
@@ -206,6 +206,132 @@ int htu21df_read_humidity(int i2cfd, float *humidity)
     return 0;
 }
 
+// Starts a conversion with the given no hold command without waiting for it
+static int htu21df_start(int i2cfd, uint8_t *cmd)
+{
+    struct i2c_rdwr_ioctl_data msgbuf;
+    struct i2c_msg start[1] = {
+        {I2Caddr, 0, 1, (char*)cmd}
+    };
+
+    msgbuf.nmsgs = 1;
+    msgbuf.msgs = start;
+    return ioctl(i2cfd, I2C_RDWR, &msgbuf);
+}
+
+// Fetches the raw value of a completed conversion
+static int htu21df_fetch(int i2cfd, uint16_t *raw)
+{
+    uint8_t buf[32];    // i2c messages
+    int rc;             // return code
+    struct i2c_rdwr_ioctl_data msgbuf;
+    struct i2c_msg read3[1] = {
+        {I2Caddr, I2C_M_RD, 3, (char*)buf}
+    };
+
+    msgbuf.nmsgs = 1;
+    msgbuf.msgs = read3;
+    rc = ioctl(i2cfd, I2C_RDWR, &msgbuf);
+    if (rc < 0) return rc;
+    if (calc_crc8(buf, 3) != 0) return -1;
+    // Remove low 2 bits because they are status
+    *raw = ((buf[0] << 8) | buf[1]) & 0xFFFC;
+    return 0;
+}
+
+// Starts a temperature conversion. The result can be fetched after
+// htu21df_temperature_conversion_ms() with htu21df_fetch_temperature
+int htu21df_start_temperature(int i2cfd)
+{
+    return htu21df_start(i2cfd, &HTU21DF_READTEMP_NH);
+}
+
+int htu21df_fetch_temperature(int i2cfd, float *temperature)
+{
+    uint16_t rawtemp;
+    int rc = htu21df_fetch(i2cfd, &rawtemp);
+    if (rc < 0) return rc;
+    *temperature = ((rawtemp / 65536.0) * 175.72) - 46.85;
+    return 0;
+}
+
+// Starts a humidity conversion. The result can be fetched after
+// htu21df_humidity_conversion_ms() with htu21df_fetch_humidity
+int htu21df_start_humidity(int i2cfd)
+{
+    return htu21df_start(i2cfd, &HTU21DF_READHUMI_NH);
+}
+
+int htu21df_fetch_humidity(int i2cfd, float *humidity)
+{
+    uint16_t rawhumi;
+    int rc = htu21df_fetch(i2cfd, &rawhumi);
+    if (rc < 0) return rc;
+    *humidity = ((rawhumi / 65536.0) * 125.0) - 6.0;
+    return 0;
+}
+
+int htu21df_temperature_conversion_ms(void)
+{
+    return MAX_TEMP_CONVERSION;
+}
+
+int htu21df_humidity_conversion_ms(void)
+{
+    return MAX_HUMI_CONVERSION;
+}
+
+// Sets the measurement resolution (one of HTU21DF_RES_*) in the user
+// register. The other bits of the register are kept. A reset restores
+// the default resolution HTU21DF_RES_RH12_T14
+int htu21df_set_resolution(int i2cfd, uint8_t resolution)
+{
+    uint8_t buf[2];     // i2c messages
+    int rc;             // return code
+    struct i2c_rdwr_ioctl_data msgbuf;
+    struct i2c_msg read_user_reg[2] = {
+        {I2Caddr, 0, 1, (char*)&HTU21DF_READREG},
+        {I2Caddr, I2C_M_RD, 1, (char*)buf}
+    };
+    struct i2c_msg write_user_reg[1] = {
+        {I2Caddr, 0, 2, (char*)buf}
+    };
+
+    msgbuf.nmsgs = 2;
+    msgbuf.msgs = read_user_reg;
+    rc = ioctl(i2cfd, I2C_RDWR, &msgbuf);
+    if (rc < 0) return rc;
+
+    buf[1] = (buf[0] & ~HTU21DF_RES_MASK) | (resolution & HTU21DF_RES_MASK);
+    buf[0] = HTU21DF_WRITEREG;
+    msgbuf.nmsgs = 1;
+    msgbuf.msgs = write_user_reg;
+    rc = ioctl(i2cfd, I2C_RDWR, &msgbuf);
+    if (rc < 0) return rc;
+    return 0;
+}
+
+// Maximum conversion times at the given resolution, see datasheet
+int htu21df_resolution_temperature_ms(uint8_t resolution)
+{
+    switch (resolution & HTU21DF_RES_MASK) {
+    case HTU21DF_RES_RH8_T12:   return 13;
+    case HTU21DF_RES_RH10_T13:  return 25;
+    case HTU21DF_RES_RH11_T11:  return 7;
+    default:                    return MAX_TEMP_CONVERSION;
+    }
+}
+
+int htu21df_resolution_humidity_ms(uint8_t resolution)
+{
+    switch (resolution & HTU21DF_RES_MASK) {
+    case HTU21DF_RES_RH8_T12:   return 3;
+    case HTU21DF_RES_RH10_T13:  return 5;
+    case HTU21DF_RES_RH11_T11:  return 8;
+    default:                    return MAX_HUMI_CONVERSION;
+    }
+}
+
 // buf = 3 bytes from the HTU21DF for temperature or humidity
 //       2 data bytes and 1 crc8 byte
 // len = number of bytes in buf but it must be 3.
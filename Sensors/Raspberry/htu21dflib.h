@@ -22,6 +22,13 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
  */
 
+// Resolution bits of the user register (humidity/temperature bits)
+#define HTU21DF_RES_MASK        0x81
+#define HTU21DF_RES_RH12_T14    0x00
+#define HTU21DF_RES_RH8_T12     0x01
+#define HTU21DF_RES_RH10_T13    0x80
+#define HTU21DF_RES_RH11_T11    0x81
+
 int i2c_open(const char *i2cdevname);
 
 int i2c_close(int i2cfd);
@@ -31,3 +38,21 @@ int htu21df_init(int i2cfd, uint8_t i2caddr);
 int htu21df_read_temperature(int i2cfd, float *temperature);
 
 int htu21df_read_humidity(int i2cfd, float *humidity);
+
+int htu21df_start_temperature(int i2cfd);
+
+int htu21df_fetch_temperature(int i2cfd, float *temperature);
+
+int htu21df_start_humidity(int i2cfd);
+
+int htu21df_fetch_humidity(int i2cfd, float *humidity);
+
+int htu21df_temperature_conversion_ms(void);
+
+int htu21df_humidity_conversion_ms(void);
+
+int htu21df_set_resolution(int i2cfd, uint8_t resolution);
+
+int htu21df_resolution_temperature_ms(uint8_t resolution);
+
+int htu21df_resolution_humidity_ms(uint8_t resolution);
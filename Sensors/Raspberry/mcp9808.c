@@ -29,6 +29,16 @@
 #define MCP9808_REG_TMP_MSB		0x02
 #define MCP9808_REG_TMP_LSB		0x03
 #define MCP9808_REG_TMP 		0x05
+#define MCP9808_REG_RESOLUTION	0x08
+
+#define MCP9808_REG_CONFIG		0x01
+#define MCP9808_REG_UPPER		0x02
+#define MCP9808_REG_LOWER		0x03
+#define MCP9808_REG_CRIT		0x04
+
+/* Alert output control, comparator mode, active-low, all limits */
+#define MCP9808_CONFIG_ALERT_CNT	0x0008
+#define MCP9808_CONFIG_ALERT_MASK	0x000F
 
 typedef struct {
 	/* file descriptor */
@@ -220,3 +230,128 @@ float mcp9808_temperature(void *_s) {
 	return temperature;
 }
 
+
+
+/**
+ * Sets the resolution of the temperature conversion:
+ * 	0: 0.5 C (30 ms)
+ * 	1: 0.25 C (65 ms)
+ * 	2: 0.125 C (130 ms)
+ * 	3: 0.0625 C (250 ms, power-up default)
+ * 
+ * @param mcp8909 sensor
+ * @param resolution resolution
+ * @return 0 on success, a negative value on error
+ */
+int mcp9808_set_resolution(void *_s, int resolution) {
+	mcp9808_t *s = TO_S(_s);
+	if(resolution < 0 || resolution > 3) return -1;
+	if(i2c_smbus_write_byte_data(s->file, MCP9808_REG_RESOLUTION, resolution) < 0) {
+		DEBUG("error: i2c_smbus_write_byte_data failed\n");
+		return -1;
+	}
+	return 0;
+}
+
+
+
+/**
+ * Returns the time of one temperature conversion at the given resolution.
+ * 
+ * @param resolution resolution, see mcp9808_set_resolution
+ * @return conversion time in microseconds
+ */
+long mcp9808_conversion_time(int resolution) {
+	switch(resolution) {
+		case 0: return 30000;
+		case 1: return 65000;
+		case 2: return 130000;
+		default: return 250000;
+	}
+}
+
+
+
+/*
+ * Reads a register word. The device sends the msb first.
+ * 
+ * @param mcp8909 sensor
+ * @return register value or a negative value on error
+ */
+int mcp9808_read_register(void *_s, uint8_t reg) {
+	mcp9808_t *s = TO_S(_s);
+	int word = i2c_smbus_read_word_data(s->file, reg);
+	if(word < 0) return word;
+	return ((word & 0x00FF)<<8) | ((word & 0xFF00)>>8);
+}
+
+
+
+/*
+ * Writes a register word. The device expects the msb first.
+ * 
+ * @param mcp8909 sensor
+ * @return 0 on success, a negative value on error
+ */
+int mcp9808_write_register(void *_s, uint8_t reg, uint16_t value) {
+	mcp9808_t *s = TO_S(_s);
+	uint16_t word = ((value & 0x00FF)<<8) | ((value & 0xFF00)>>8);
+	if(i2c_smbus_write_word_data(s->file, reg, word) < 0) {
+		DEBUG("error: i2c_smbus_write_word_data failed\n");
+		return -1;
+	}
+	return 0;
+}
+
+
+
+/*
+ * Converts a temperature into the format of the limit registers
+ * (two's complement in 0.25 C, bit 12 is the sign).
+ */
+uint16_t mcp9808_limit(float temperature) {
+	if(temperature > 255.75) temperature = 255.75;
+	if(temperature < -256.0) temperature = -256.0;
+	int quarters = (int)lroundf(temperature * 4.0);
+	return (uint16_t)((quarters << 2) & 0x1FFC);
+}
+
+
+
+/**
+ * Programs the alert window and enables the alert output in comparator
+ * mode. The ALERT pin (active-low) is asserted as long as the temperature
+ * is below lower or above upper. T_CRIT is set to upper, so that it does
+ * not assert the pin by itself.
+ * 
+ * @param mcp8909 sensor
+ * @param lower lower limit in celsius
+ * @param upper upper limit in celsius
+ * @return 0 on success, a negative value on error
+ */
+int mcp9808_set_alert(void *_s, float lower, float upper) {
+	int config = mcp9808_read_register(_s, MCP9808_REG_CONFIG);
+	if(config < 0) return -1;
+	
+	// Limits can only be written with the alert output disabled
+	config &= ~MCP9808_CONFIG_ALERT_MASK;
+	if(mcp9808_write_register(_s, MCP9808_REG_CONFIG, config) < 0) return -1;
+	if(mcp9808_write_register(_s, MCP9808_REG_UPPER, mcp9808_limit(upper)) < 0) return -1;
+	if(mcp9808_write_register(_s, MCP9808_REG_LOWER, mcp9808_limit(lower)) < 0) return -1;
+	if(mcp9808_write_register(_s, MCP9808_REG_CRIT, mcp9808_limit(upper)) < 0) return -1;
+	return mcp9808_write_register(_s, MCP9808_REG_CONFIG, config | MCP9808_CONFIG_ALERT_CNT);
+}
+
+
+
+/**
+ * Disables the alert output.
+ * 
+ * @param mcp8909 sensor
+ * @return 0 on success, a negative value on error
+ */
+int mcp9808_disable_alert(void *_s) {
+	int config = mcp9808_read_register(_s, MCP9808_REG_CONFIG);
+	if(config < 0) return -1;
+	return mcp9808_write_register(_s, MCP9808_REG_CONFIG, config & ~MCP9808_CONFIG_ALERT_MASK);
+}
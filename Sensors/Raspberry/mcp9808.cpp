@@ -23,18 +23,22 @@
 
 namespace sensors {
 
+constexpr Channel MCP9808::CHANNEL_TABLE[];
+
 
 MCP9808::MCP9808(const char* i2c_device, int address) : Sensor(i2c_device, address) {
-	this->mcp9808 = mcp9808_init(address, i2c_device);
-	if(this->mcp9808 == NULL) this->_error = true;
-	this->t = 0.0F;
+	this->mcp9808 = NULL;
+	this->_resolution = DEFAULT_RESOLUTION;
+	if(this->init() != 0) this->_error = true;
+	this->_readings[CH_T] = 0.0F;
 }
 
 
 MCP9808::MCP9808(const std::string i2c_device, int address)  : Sensor(i2c_device, address) {
-	this->mcp9808 = mcp9808_init(address, i2c_device.c_str());
-	if(this->mcp9808 == NULL) this->_error = true;
-	this->t = 0.0F;
+	this->mcp9808 = NULL;
+	this->_resolution = DEFAULT_RESOLUTION;
+	if(this->init() != 0) this->_error = true;
+	this->_readings[CH_T] = 0.0F;
 }
 
 
@@ -42,15 +46,50 @@ MCP9808::~MCP9808() {
 	mcp9808_close(this->mcp9808);
 }
 
+int MCP9808::init() {
+	mcp9808_close(this->mcp9808);
+	this->mcp9808 = mcp9808_init(this->_address, this->_device.c_str());
+	if(this->mcp9808 == NULL) return -1;
+	if(this->_resolution != DEFAULT_RESOLUTION && mcp9808_set_resolution(this->mcp9808, this->_resolution) != 0) return -2;
+	this->_error = false;
+	return 0;
+}
+
 	
 int MCP9808::read() {
 	if(this->mcp9808 == NULL) return -1;
 	
-	this->t = mcp9808_temperature(this->mcp9808);
+	this->_readings[CH_T] = mcp9808_temperature(this->mcp9808);
 	// TODO: Return status on error
 	return 0;
 }
 
+int MCP9808::setPrecision(int level) {
+	if(level < 0 || level > 3) return -1;
+	if(this->mcp9808 != NULL && mcp9808_set_resolution(this->mcp9808, level) != 0) return -2;
+	this->_resolution = level;
+	return 0;
+}
+
+std::string MCP9808::precisionName(int level) const {
+	static const char* names[] = { "0.5 C", "0.25 C", "0.125 C", "0.0625 C" };
+	if(level < 0 || level > 3) return "";
+	return names[level];
+}
+
+long MCP9808::conversionTime(void) const { return mcp9808_conversion_time(this->_resolution); }
+
+int MCP9808::armAlert(void) {
+	if(this->mcp9808 == NULL || this->_alertBand <= 0.0F) return -1;
+	const float t = this->_readings[CH_T];
+	return mcp9808_set_alert(this->mcp9808, t - this->_alertBand, t + this->_alertBand);
+}
+
+int MCP9808::disarmAlert(void) {
+	if(this->mcp9808 == NULL) return -1;
+	return mcp9808_disable_alert(this->mcp9808);
+}
+
 }
 
 
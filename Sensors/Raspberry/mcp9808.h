@@ -13,4 +13,12 @@ void mcp9808_close(void *_s);
 
 float mcp9808_temperature(void *_s);
 
+int mcp9808_set_resolution(void *_s, int resolution);
+
+long mcp9808_conversion_time(int resolution);
+
+int mcp9808_set_alert(void *_s, float lower, float upper);
+
+int mcp9808_disable_alert(void *_s);
+
 
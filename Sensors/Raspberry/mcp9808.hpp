@@ -25,28 +25,51 @@
 namespace sensors {
 
 class MCP9808 : public Sensor {
+public:
+	/** Channel indices */
+	enum { CH_T = 0, CHANNELS };
+	/** Channel descriptors, available at compile time */
+	static constexpr Channel CHANNEL_TABLE[CHANNELS] = {
+		{ "t", "C", CHANNEL_TEMPERATURE, CH_T },
+	};
 private:
 	// Last readings
-	float t;
+	float _readings[CHANNELS];
 	
 	
 	void* mcp9808;
+	/** Resolution, restored on init() */
+	int _resolution;
 public:
 	MCP9808(const char* i2c_device, int address=DEVICE_ADDRESS);
 	MCP9808(const std::string i2c_device, int address=DEVICE_ADDRESS);
 	virtual ~MCP9808();
 	
+	virtual int init(void);
 	int read(void);
 	
-	float temperature() { return this->t; }
+	/** Sets the resolution (0 = 0.5 C, 1 = 0.25 C, 2 = 0.125 C, 3 = 0.0625 C, default: 3).
+	  * The sensor converts continuously, a lower resolution gives fresher readings */
+	virtual int setPrecision(int level);
+	virtual int precision(void) const { return this->_resolution; }
+	virtual int precisionLevels(void) const { return 4; }
+	virtual std::string precisionName(int level) const;
+	virtual long conversionTime(void) const;
+	
+	/** The ALERT pin watches the temperature */
+	virtual const Channel* alertChannel(void) const { return &CHANNEL_TABLE[CH_T]; }
+	virtual int armAlert(void);
+	virtual int disarmAlert(void);
+	
+	float temperature() { return this->_readings[CH_T]; }
 	
-	virtual std::map<std::string,float> values(void) const {
-		std::map<std::string,float> ret;
-		ret["t"] = this->t;
-		return ret;
-	}
+	virtual size_t channelCount(void) const { return CHANNELS; }
+	virtual const Channel* channels(void) const { return CHANNEL_TABLE; }
+	virtual const float* readings(void) const { return this->_readings; }
 	
 	static const int DEVICE_ADDRESS = 0x18;
+	/** Resolution after power-up */
+	static const int DEFAULT_RESOLUTION = 3;
 };
 
 }
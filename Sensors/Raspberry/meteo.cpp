@@ -16,6 +16,8 @@
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <unordered_map>
+#include <cmath>
 
 
 #include <cstdlib>
@@ -39,7 +41,16 @@
 #include "sensors.hpp"
 #include "config.hpp"
 #include "string.hpp"
-#include "mosquitto.hpp"
+#include "scheduler.hpp"
+#include "eventloop.hpp"
+#include "sampler.hpp"
+#include "registry.hpp"
+#include "tca9548a.hpp"
+#include "detect.hpp"
+#include "statecache.hpp"
+#include "deadband.hpp"
+#include "publisher.hpp"
+#include "report.hpp"
 
 using namespace std;
 using namespace sensors;
@@ -50,76 +61,118 @@ using flex::String;
 #define CONFIG_FILE "meteo.cf"
 
 
-static Mosquitto *mosq = NULL;
+/** Publisher of the samples, NULL until the signals are blocked */
+static Publisher *publisher = NULL;
 vector<Sensor*> _sensors;
+/** Readout interval of each sensor in _sensors [ms] */
+static vector<long> _intervals;
+/** I2C bus of each sensor in _sensors */
+static vector<string> _buses;
+/** Description of each sensor in _sensors */
+static vector<SensorSpec> _specs;
+/** Scheduler job of each sensor in _sensors */
+static vector<int> _ids;
+/** Deadbands of each sensor in _sensors */
+static vector<Deadband*> _deadbands;
+/** Index of every sensor and of every scheduler job in _sensors, so that
+  * the sensors of a cycle are found without searching */
+static unordered_map<const Sensor*, size_t> _sensor_index;
+static unordered_map<int, size_t> _job_index;
+
+/** Hardware threshold alert of a sensor */
+struct Alert {
+	GpioLine line;
+	/** Edges of the line and readouts triggered by them */
+	long edges, readouts;
+	/** The line was still asserted after the last readout */
+	bool retried;
+	
+	Alert(const string &chip, int offset) : line(chip, offset), edges(0), readouts(0), retried(false) {}
+};
+/** Alert of each sensor in _sensors, NULL if the sensor is polled */
+static vector<Alert*> _alerts;
+/** Fallback readout interval of sensors with an alert [ms] */
+static const long ALERT_INTERVAL = 3600000L;
+/** Saved device states for a warm start */
+static StateCache _states;
+/** State cache file or empty if disabled */
+static string _state_file = "meteo.state";
 static bool running = true;
+static bool quiet = false;			// Quiet mode
 
 
 
 
 
-static int p_sleep(long millis, long micros = 0) {
-       struct timespec tt, rem;
-       int ret;
-
-       tt.tv_sec = millis/1000L;
-       millis -= tt.tv_sec*1000L;
-       tt.tv_nsec = (micros + millis*1000L)*1000L;
-       ret = nanosleep(&tt, &rem);
-       if(ret < 0) {
-               switch(errno) {
-               case EFAULT:
-                       return -1;
-               case EINTR:
-                       // Interrupted
-                       if(!running) return -2;
-                       
-                       // Is still running, so sleep remaining time
-                       millis = rem.tv_sec * 1000L;
-                       micros = rem.tv_nsec / 1000L;
-                       millis += micros/1000L;
-                       micros -= millis * 1000L;
-                       return p_sleep(millis, micros);
-               case EINVAL:
-                       return -3;
-               default :
-                       return -8;
-               }
-       } else 
-               return 0;
+/** @returns the fields of the given sensor in a sample. With a budget, a
+  * late sensor adds an age field to every channel */
+static size_t sampleFields(const Sensor *sensor, long budget) {
+	return sensor->channelCount() * (budget > 0 ? 2 : 1);
 }
 
+/** @returns true if every channel name of the given sensor with the given
+  * prefix and the age suffix fits into a sample */
+static bool fitsSample(const Sensor *sensor, const string &prefix) {
+	const Channel *channels = sensor->channels();
+	for(size_t i = 0; i < sensor->channelCount(); i++)
+		if(!Sample::fits(prefix.c_str(), channels[i].name, "_age")) return false;
+	return true;
+}
 
-static int readSensor(Sensor *sensor) {
-	int tries = 5;
-	int ret;
-	while(tries-- > 0) {
-		ret = sensor->read();
-		if(ret == 0) return ret;		// Done
-		
-		// Could be that someone else is currently reading, therefore we
-		// wait a little bit and try again
-		p_sleep(100);
+/** Prints why the channel names of the given sensor do not fit into a sample */
+static void printKeyError(const char* context, const string &name, const string &prefix) {
+	cerr << context << "Channel names of sensor " << name << " with prefix \"" << prefix << "\" are too long";
+	cerr << " (at most " << Sample::KEY_SIZE - 5 << " characters including the prefix)" << endl;
+}
+
+/** Prints why the channels of all sensors do not fit into a sample */
+static void printFieldError(const char* context, size_t fields, long budget) {
+	cerr << context << "The sensors have " << fields << " fields per sample";
+	if(budget > 0) cerr << " including the age fields of the budget";
+	cerr << ", at most " << Sample::MAX_FIELDS << " fit into a sample" << endl;
+}
+
+/** Rebuilds the indices of _sensors. Must be called whenever sensors are added or removed */
+static void reindex(void) {
+	_sensor_index.clear();
+	_job_index.clear();
+	for(size_t i = 0; i < _sensors.size(); i++) {
+		_sensor_index[_sensors[i]] = i;
+		_job_index[_ids[i]] = i;
 	}
-	return ret;
+}
+
+/** @returns the alert of the given sensor or NULL */
+static Alert* alertOf(const Sensor *sensor) {
+	unordered_map<const Sensor*, size_t>::const_iterator it = _sensor_index.find(sensor);
+	return (it == _sensor_index.end() ? NULL : _alerts[it->second]);
+}
+
+/** Saves the device states of all sensors to the state cache file */
+static void saveStates(void) {
+	if(_state_file.empty()) return;
+	for(size_t i = 0; i < _sensors.size(); i++)
+		_states.put(StateCache::key(_specs[i]), _sensors[i]);
+	if(_states.save(_state_file) != 0)
+		cerr << "Error writing state cache " << _state_file << endl;
 }
 
 static void cleanup() {
+	saveStates();
 	// Delete sensors
 	vector<Sensor*> sensors(_sensors);
 	_sensors.clear();
+	_sensor_index.clear();
+	_job_index.clear();
 	for(vector<Sensor*>::iterator it = sensors.begin(); it != sensors.end(); ++it)
 		delete *it;
-}
-
-static void sig_handler(int signo) {
-	switch(signo) {
-		case SIGINT:
-		case SIGTERM:
-			if(!running) exit(EXIT_FAILURE);
-			running = false;
-			break;
-	}
+	for(vector<Deadband*>::iterator it = _deadbands.begin(); it != _deadbands.end(); ++it)
+		delete *it;
+	_deadbands.clear();
+	for(vector<Alert*>::iterator it = _alerts.begin(); it != _alerts.end(); ++it)
+		delete *it;
+	_alerts.clear();
+	TCA9548A::closeAll();
 }
 
 static void fork_daemon(void) {
@@ -144,108 +197,566 @@ static void fork_daemon(void) {
 	}
 }
 
-int main(int argc, char** argv) {
-	string i2c = "/dev/i2c-2";
-	string mosquitto = "";
-	string name = "";			// Node name, if available
+/** Settings from the config file and the command line */
+struct Settings {
+	string i2c;
+	string mosquitto;
 	// Sensor enable flags
-	bool bmp180 = false;
-	bool htu21df = false;
-	bool mcp9808 = false;
-	bool tsl2561 = false;
-	bool daemon = false;
-	bool quiet = false;			// Quiet mode
-	int delay = 5;				// Delay between loops [Seconds]
-	int node_id = 0;			// ID of the node
-	
-	// Read config
-	{
-		string tmp;
-		Config config(CONFIG_FILE);
-		if(!config.readSuccessfull()) {
-			cerr << "Reading of the config file failed." << endl;
-			cerr << "Please check your config file " << CONFIG_FILE << endl;
-			return EXIT_FAILURE;
+	bool bmp180;
+	bool htu21df;
+	bool mcp9808;
+	bool tsl2561;
+	bool daemon;
+	bool quiet;
+	int node_id;
+	string name;
+	int delay;				// Delay between loops [Seconds]
+	bool align;				// Align readouts to wall-clock multiples of delay
+	map<string, string> buses;		// Per-sensor I2C bus
+	int bmp180_treuse;			// BMP180 reads per temperature conversion
+	long budget;				// Time budget per cycle [ms], 0 = unlimited
+	float stats;				// Interval of the statistics [Seconds], 0 = only on SIGHUP and exit
+	int breaker_threshold;		// Consecutive failures until a sensor is suspended
+	float breaker_backoff;		// First backoff of a failing sensor [Seconds]
+	float breaker_backoff_max;	// Maximum backoff of a failing sensor [Seconds]
+	map<string, float> intervals;	// Per-sensor readout intervals [Seconds]
+	map<string, int> precisions;	// Per-sensor precision levels
+	vector<SensorSpec> specs;		// Sensors from [sensor.NAME] sections
+	bool detect;			// Print the detected sensors and exit
+	bool autodetect;		// Add the detected sensors to the configured ones
+	long detect_timeout;		// Time limit of the bus scan [ms]
+	bool profile;			// Profile the precision levels of the sensors and exit
+	string state_file;		// State cache file, empty if disabled
+	bool watch;				// Reload the config file when it changes
+	map<string, string> deadbands;	// Default deadband options of all sensors
+	int batch;				// Samples per published message
+	float batch_time;		// Maximum delay of a sample in a batch [Seconds]
+	bool timestamps;		// Add the timestamps of the stages to every sample
+	int queue;				// Samples between sampling and publishing
+	Publisher::Overflow overflow;	// What is dropped, when the queue is full
+	
+	Settings() : i2c("/dev/i2c-2"), bmp180(false), htu21df(false), mcp9808(false), tsl2561(false),
+		daemon(false), quiet(false), node_id(0), delay(5), align(false), bmp180_treuse(1), budget(0), stats(0.0F),
+		breaker_threshold(3), breaker_backoff(5.0F), breaker_backoff_max(300.0F),
+		detect(false), autodetect(false), detect_timeout(500), profile(false), state_file("meteo.state"), watch(true),
+		batch(1), batch_time(0.0F), timestamps(false), queue(64), overflow(Publisher::DROP_OLDEST) {}
+};
+
+/** Reads the config file into the given settings
+  * @returns false on error */
+static bool readConfig(const char* filename, Settings &settings) {
+	string tmp;
+	Config config(filename);
+	if(!config.readSuccessfull()) {
+		cerr << "Reading of the config file failed." << endl;
+		cerr << "Please check your config file " << filename << endl;
+		return false;
+	}
+	if((tmp = config.get("mosquitto", "")) != "")
+		settings.mosquitto = tmp;
+	if((tmp = config.get("i2c", "")) != "")
+		settings.i2c = tmp;
+	settings.bmp180 = config.getBoolean("bmp180", settings.bmp180);
+	settings.htu21df = config.getBoolean("htu21df", settings.htu21df);
+	settings.mcp9808 = config.getBoolean("mcp9808", settings.mcp9808);
+	settings.tsl2561 = config.getBoolean("tsl2561", settings.tsl2561);
+	settings.bmp180_treuse = config.getInt("bmp180_treuse", settings.bmp180_treuse);
+	settings.budget = config.getLong("budget", settings.budget);
+	settings.stats = config.getFloat("stats", settings.stats);
+	settings.autodetect = config.getBoolean("autodetect", settings.autodetect);
+	settings.detect_timeout = config.getLong("detect_timeout", settings.detect_timeout);
+	settings.state_file = config.get("state", settings.state_file);
+	settings.watch = config.getBoolean("watch", settings.watch);
+	settings.batch = config.getInt("batch", settings.batch);
+	if(settings.batch < 1) settings.batch = 1;
+	settings.batch_time = config.getFloat("batch_time", settings.batch_time);
+	settings.timestamps = config.getBoolean("timestamps", settings.timestamps);
+	settings.queue = config.getInt("queue", settings.queue);
+	if(settings.queue < 1) settings.queue = 1;
+	if((tmp = config.get("queue_overflow", "")) != "" && !Publisher::parseOverflow(tmp, settings.overflow)) {
+		cerr << "Illegal queue_overflow: " << tmp << " (drop_oldest, drop_newest or coalesce)" << endl;
+		return false;
+	}
+	const char* deadbands[] = { "deadband", "deadband_rel", "heartbeat" };
+	for(size_t i = 0; i < sizeof(deadbands)/sizeof(deadbands[0]); i++)
+		if((tmp = config.get(deadbands[i], "")) != "")
+			settings.deadbands[deadbands[i]] = tmp;
+	settings.breaker_threshold = config.getInt("breaker_threshold", settings.breaker_threshold);
+	settings.breaker_backoff = config.getFloat("breaker_backoff", settings.breaker_backoff);
+	settings.breaker_backoff_max = config.getFloat("breaker_backoff_max", settings.breaker_backoff_max);
+	const char* names[] = { "bmp180", "htu21df", "mcp9808", "tsl2561" };
+	for(size_t i = 0; i < sizeof(names)/sizeof(names[0]); i++) {
+		settings.intervals[names[i]] = config.getFloat(string(names[i]) + "_interval", 0.0F);
+		const int precision = config.getInt(string(names[i]) + "_precision", -1);
+		if(precision >= 0) settings.precisions[names[i]] = precision;
+		ConfigSection *section = config.section(names[i]);
+		if(section != NULL && (tmp = section->get("i2c", "")) != "")
+			settings.buses[names[i]] = tmp;
+	}
+	settings.node_id = config.getInt("id", settings.node_id);
+	//settings.quiet = config.getBoolean("quiet", settings.quiet);
+	//settings.daemon = config.getBoolean("daemon", settings.daemon);
+	settings.delay = config.getInt("delay", settings.delay);
+	settings.align = config.getBoolean("align", settings.align);
+	settings.name = config.get("name", "");
+	try {
+		SensorRegistry::parse(config, settings.specs);
+	} catch (const char* msg) {
+		cerr << "Error in sensor configuration: " << msg << endl;
+		return false;
+	}
+	try {
+		Deadband::check(settings.deadbands);
+		for(vector<SensorSpec>::const_iterator it = settings.specs.begin(); it != settings.specs.end(); ++it)
+			Deadband::check(it->options);
+	} catch (const char* msg) {
+		cerr << "Error in deadband configuration: " << msg << endl;
+		return false;
+	}
+	for(vector<SensorSpec>::const_iterator it = settings.specs.begin(); it != settings.specs.end(); ++it) {
+		map<string, string>::const_iterator alert = it->options.find("alert");
+		string chip;
+		int line;
+		if(alert != it->options.end() && !GpioLine::parse(alert->second, chip, line)) {
+			cerr << "Error in sensor configuration: Illegal alert line " << alert->second << endl;
+			return false;
 		}
-		if((tmp = config.get("mosquitto", "")) != "")
-			mosquitto = tmp;
-		if((tmp = config.get("i2c", "")) != "")
-			i2c = tmp;
-		bmp180 = config.getBoolean("bmp180", bmp180);
-		htu21df = config.getBoolean("htu21df", htu21df);
-		mcp9808 = config.getBoolean("mcp9808", mcp9808);
-		tsl2561 = config.getBoolean("tsl2561", tsl2561);
-		node_id = config.getInt("id", node_id);
-		//quiet = config.getBoolean("quiet", quiet);
-		//daemon = config.getBoolean("daemon", daemon);
-		delay = config.getInt("delay", delay);
-		name = config.get("name", "");
 	}
+	return true;
+}
+
+static void printHelp(const char* program) {
+	cout << "Meteo Sensor - v2.0" << endl;
+	cout << "  2017 Felix Niederwanger" << endl;
 	
+	cout << "Usage: " << program << " [OPTIONS]" << endl;
+	cout << "OPTIONS:" << endl;
+	cout << "    -h     --help               Print this help message" << endl;
+	cout << "    -q     --quiet              Quiet mode" << endl;
+	cout << "    -d     --daemon             Daemon mode" << endl;
+	cout << "           --id ID              Set node ID" << endl;
+	cout << "           --delay SECONDS      Set delay between readouts" << endl;
+	cout << "           --align              Align readouts to wall-clock multiples of the delay" << endl;
+	cout << "           --budget MS          Time budget per readout cycle in milliseconds" << endl;
+	cout << "           --detect             Scan all I2C buses, print the detected sensors and exit" << endl;
+	cout << "           --auto               Use the detected sensors in addition to the configured ones" << endl;
+	cout << "           --profile            Measure the latency of every precision level of the sensors and exit" << endl;
+	cout << "  Sensor options  " << endl;
+	cout << "           --all                Enable all available sensors" << endl;
+	cout << endl;
+	cout << "The program will reads the config file '" << CONFIG_FILE << "' for the following values:" << endl;
+	cout << "  bmp180 = [true|false]         Enable bmp180 sensor" << endl;
+	cout << "  htu21df = [true|false]        Enable htu21df sensor" << endl;
+	cout << "  mcp9808 = [true|false]        Enable mcp9808 sensor" << endl;
+	cout << "  tsl2561 = [true|false]        Enable tsl2561 sensor" << endl;
+	cout << "  bmp180_treuse = N             Reuse BMP180 temperature conversion for N reads" << endl;
+	cout << "  SENSOR_interval = T           Readout interval of SENSOR in seconds (default: delay)" << endl;
+	cout << "  SENSOR_precision = N          Precision level of SENSOR, 0 is the fastest (see --profile)" << endl;
+	cout << "  breaker_threshold = N         Suspend a sensor after N consecutive failures (default: 3)" << endl;
+	cout << "  breaker_backoff = T           First backoff of a suspended sensor in seconds (default: 5)" << endl;
+	cout << "  breaker_backoff_max = T       Maximum backoff of a suspended sensor in seconds (default: 300)" << endl;
+	cout << "  id = ID                       Set node ID" << endl;
+	//cout << "  quiet = [true|false]          Quiet mode" << endl;
+	cout << "  delay = T                     Set readout delay in seconds" << endl;
+	cout << "  align = [true|false]          Align readouts to wall-clock multiples of the delay" << endl;
+	cout << "  budget = MS                   Time budget per readout cycle in milliseconds (default: 0, unlimited)" << endl;
+	cout << "                                Slower sensors are published with their last values and an age" << endl;
+	cout << "  stats = T                     Print the scheduler and sensor statistics every T seconds (default: 0, on SIGHUP and exit)" << endl;
+	cout << "  autodetect = [true|false]     Use the detected sensors in addition to the configured ones" << endl;
+	cout << "  detect_timeout = MS           Time limit of the I2C bus scan in milliseconds (default: 500)" << endl;
+	cout << "  deadband = X                  Only publish, if a reading changed by more than X (default: publish every reading)" << endl;
+	cout << "  deadband_rel = P              Only publish, if a reading changed by more than P percent" << endl;
+	cout << "  heartbeat = T                 Publish at least every T seconds, despite the deadbands" << endl;
+	cout << "  batch = N                     Publish N samples per message (default: 1)" << endl;
+	cout << "  batch_time = T                Publish a batch at the latest T seconds after its first sample" << endl;
+	cout << "  timestamps = [true|false]     Add the conversion, queue and encode timestamps to every sample (default: false)" << endl;
+	cout << "  queue = N                     Samples queued for the publisher thread, e.g. while disconnected (default: 64)" << endl;
+	cout << "  queue_overflow = POLICY       drop_oldest, drop_newest or coalesce, if the queue is full (default: drop_oldest)" << endl;
+	cout << "  watch = [true|false]          Reload the config file when it changes (default: true)" << endl;
+	cout << "  state = FILE                  Cache of the device states for a warm start (default: meteo.state, empty to disable)" << endl;
+	cout << "  name = NAME                   Set node name, if available" << endl;
+	cout << "  mosquitto = HOST              Enable mosquitto and set remote host to HOST" << endl;
+	cout << "  i2c = DEVICE                  Set i2c device to DEVICE" << endl;
+	cout << "Every sensor can have its own section with the following values:" << endl;
+	cout << "  [SENSOR]" << endl;
+	cout << "  i2c = DEVICE                  I2C bus of SENSOR (default: i2c)" << endl;
+	cout << "Further sensors, also multiple of the same type, are defined by sections:" << endl;
+	cout << "  [sensor.NAME]" << endl;
+	cout << "  type = TYPE                   Sensor type (";
+	{
+		vector<string> types = SensorRegistry::types();
+		for(size_t j = 0; j < types.size(); j++) cout << (j > 0 ? ", " : "") << types[j];
+	}
+	cout << ")" << endl;
+	cout << "  i2c = DEVICE                  I2C bus (default: i2c)" << endl;
+	cout << "  address = ADDRESS             I2C address, e.g. 0x19 (default: address of the type)" << endl;
+	cout << "  prefix = PREFIX               Prefix of the published channel names (default: none)" << endl;
+	cout << "  interval = T                  Readout interval in seconds (default: delay)" << endl;
+	cout << "  treuse = N                    bmp180 only: Reuse temperature conversion for N reads" << endl;
+	cout << "  autogain = [0|1]              tsl2561 only: Adjust the gain automatically" << endl;
+	cout << "  mux = ADDRESS                 Address of the TCA9548A multiplexer in front of the sensor (default: 0x70)" << endl;
+	cout << "  channel = N                   Multiplexer channel (0-7) of the sensor" << endl;
+	cout << "  precision = N                 Precision level, 0 is the fastest (default: sensor default, see --profile)" << endl;
+	cout << "  burst = N                     Readings per readout, published as their mean (default: 1)" << endl;
+	cout << "  filter = STAGES               Filter of all channels, e.g. clip:3, median:5, ema:0.75" << endl;
+	cout << "  filter.CHANNEL = STAGES       Filter of a single channel, e.g. filter.p" << endl;
+	cout << "  deadband[.CHANNEL] = X        Absolute deadband of all channels or of a single one" << endl;
+	cout << "  deadband_rel[.CHANNEL] = P    Relative deadband in percent" << endl;
+	cout << "  heartbeat = T                 Maximum time between publications in seconds" << endl;
+	cout << "  alert = CHIP:LINE             mcp9808, tsl2561: Read only when the alert output on this GPIO line fires, e.g. gpiochip0:17" << endl;
+	cout << "  alert_band = X                Threshold window +/- X around the last reading (t in C, l_vis in counts)" << endl;
+	cout << "Sensors on different buses are read in parallel" << endl;
+	cout << "The config file is reloaded on SIGHUP and, unless watch = false, when it changes" << endl;
+}
+
+/** Applies the command line arguments to the given settings
+  * @returns 0 on success, 1 if the help has been printed or -1 on error */
+static int parseArguments(int argc, char** argv, Settings &settings) {
 	for(int i=1;i<argc;i++) {
 		string arg(argv[i]);
 		if(arg == "-h" || arg == "--help") {
-			cout << "Meteo Sensor - v2.0" << endl;
-			cout << "  2017 Felix Niederwanger" << endl;
-			
-			cout << "Usage: " << argv[0] << " [OPTIONS]" << endl;
-			cout << "OPTIONS:" << endl;
-			cout << "    -h     --help               Print this help message" << endl;
-			cout << "    -q     --quiet              Quiet mode" << endl;
-			cout << "    -d     --daemon             Daemon mode" << endl;
-			cout << "           --id ID              Set node ID" << endl;
-			cout << "           --delay SECONDS      Set delay between readouts" << endl;
-			cout << "  Sensor options  " << endl;
-			cout << "           --all                Enable all available sensors" << endl;
-			cout << endl;
-			cout << "The program will reads the config file '" << CONFIG_FILE << "' for the following values:" << endl;
-			cout << "  bmp180 = [true|false]         Enable bmp180 sensor" << endl;
-			cout << "  htu21df = [true|false]        Enable htu21df sensor" << endl;
-			cout << "  mcp9808 = [true|false]        Enable mcp9808 sensor" << endl;
-			cout << "  tsl2561 = [true|false]        Enable tsl2561 sensor" << endl;
-			cout << "  id = ID                       Set node ID" << endl;
-			//cout << "  quiet = [true|false]          Quiet mode" << endl;
-			cout << "  delay = T                     Set readout delay in seconds" << endl;
-			cout << "  name = NAME                   Set node name, if available" << endl;
-			cout << "  mosquitto = HOST              Enable mosquitto and set remote host to HOST" << endl;
-			cout << "  i2c = DEVICE                  Set i2c device to DEVICE" << endl;
-			return EXIT_SUCCESS;
+			printHelp(argv[0]);
+			return 1;
 		} else if(arg == "--all") {
-			bmp180 = true;
-			htu21df = true;
-			mcp9808 = true;
-			tsl2561 = true;
+			settings.bmp180 = true;
+			settings.htu21df = true;
+			settings.mcp9808 = true;
+			settings.tsl2561 = true;
 		} else if(arg == "--id") {
-			node_id = ::atoi(argv[++i]);		// XXX: Potentially index-out-of-bands!
+			if(i + 1 >= argc) {
+				cerr << "Missing value of " << arg << endl;
+				return -1;
+			}
+			settings.node_id = ::atoi(argv[++i]);
 		} else if(arg == "--quiet" || arg == "-q") {
-			quiet = true;
+			settings.quiet = true;
 		} else if(arg == "--daemon" || arg == "-d") {
-			daemon = true;
+			settings.daemon = true;
 		} else if(arg == "--delay") {
-			delay = ::atoi(argv[++i]);		// XXX: Potentially index-out-of-bands!
-			if(delay <= 0) delay = 1;
+			if(i + 1 >= argc) {
+				cerr << "Missing value of " << arg << endl;
+				return -1;
+			}
+			settings.delay = ::atoi(argv[++i]);
+			if(settings.delay <= 0) settings.delay = 1;
+		} else if(arg == "--align") {
+			settings.align = true;
+		} else if(arg == "--budget") {
+			if(i + 1 >= argc) {
+				cerr << "Missing value of " << arg << endl;
+				return -1;
+			}
+			settings.budget = ::atol(argv[++i]);
+			if(settings.budget < 0) settings.budget = 0;
+		} else if(arg == "--detect") {
+			settings.detect = true;
+		} else if(arg == "--auto") {
+			settings.autodetect = true;
+		} else if(arg == "--profile") {
+			settings.profile = true;
 		} else {
 			cerr << "Illegal argument: " << arg << endl;
-			return EXIT_FAILURE;
+			return -1;
 		}
 	}
+	return 0;
+}
+
+/**
+  * Builds the descriptions of all sensors of the given settings: The enable
+  * flags, the [sensor.NAME] sections and the detected sensors. Every sensor
+  * is on the default bus unless its section says otherwise.
+  * Conflicting addresses are checked before any sensor is initialized
+  * @param running Running sensors, that the detection must not probe
+  * @returns false on conflicting sensors
+  */
+static bool setupSensors(const Settings &settings, vector<SensorSpec> &setup, const vector<SensorSpec> &running = vector<SensorSpec>()) {
+	vector<SensorSpec> specs;
 	
-	if(mosquitto == "") {
-		cerr << "WARNING: No mosquitto server defined. No data will be published!" << endl;
-	} else {
-		mosq = new Mosquitto();
-		mosq->connect(mosquitto.c_str());
+	// The enable flags are shortcuts for one sensor of the type on its default address
+	const char* types[] = { "bmp180", "htu21df", "mcp9808", "tsl2561" };
+	const bool enabled[] = { settings.bmp180, settings.htu21df, settings.mcp9808, settings.tsl2561 };
+	for(size_t i = 0; i < sizeof(types)/sizeof(types[0]); i++) {
+		if(!enabled[i]) continue;
+		SensorSpec spec;
+		spec.name = types[i];
+		spec.type = types[i];
+		map<string, string>::const_iterator bus = settings.buses.find(types[i]);
+		if(bus != settings.buses.end()) spec.bus = bus->second;
+		map<string, float>::const_iterator interval = settings.intervals.find(types[i]);
+		if(interval != settings.intervals.end()) spec.interval = interval->second;
+		map<string, int>::const_iterator precision = settings.precisions.find(types[i]);
+		if(precision != settings.precisions.end()) {
+			stringstream ss;
+			ss << precision->second;
+			spec.options["precision"] = ss.str();
+		}
+		specs.push_back(spec);
+	}
+	specs.insert(specs.end(), settings.specs.begin(), settings.specs.end());
+	
+	// Detected sensors are appended and skipped, if their address is configured already.
+	// Configured and running sensors are not probed at all
+	const size_t configured = specs.size();
+	if(settings.autodetect) {
+		vector<SensorSpec> known(running);
+		for(size_t i = 0; i < configured; i++) {
+			known.push_back(specs[i]);
+			if(known.back().bus.empty()) known.back().bus = settings.i2c;
+		}
+		detectSensors(i2cBuses(), known, specs, settings.detect_timeout);
+	}
+	
+	for(vector<SensorSpec>::iterator it = specs.begin(); it != specs.end(); ++it) {
+		if(it->type == "bmp180" && it->options.find("treuse") == it->options.end()) {
+			stringstream ss;
+			ss << settings.bmp180_treuse;
+			it->options["treuse"] = ss.str();
+		}
+		// The default deadbands apply, unless the sensor defines its own
+		for(map<string, string>::const_iterator option = settings.deadbands.begin(); option != settings.deadbands.end(); ++option)
+			if(it->options.find(option->first) == it->options.end()) it->options[option->first] = option->second;
+		if(it->bus.empty()) it->bus = settings.i2c;
+		const int address = SensorRegistry::address(*it);
+		
+		bool conflict = false;
+		for(vector<SensorSpec>::const_iterator other = setup.begin(); other != setup.end() && !conflict; ++other) {
+			if(other->bus != it->bus || SensorRegistry::address(*other) != address) continue;
+			// Sensors behind different multiplexer channels do not see each other
+			conflict = !(other->mux >= 0 && it->mux >= 0 && (other->mux != it->mux || other->channel != it->channel));
+		}
+		if(conflict) {
+			if((size_t)(it - specs.begin()) >= configured) continue;		// Detected, but configured already
+			cerr << "Error: Sensor " << it->name << " uses the same address 0x" << hex << address << dec << " on " << it->bus << " as another sensor" << endl;
+			return false;
+		}
+		setup.push_back(*it);
+	}
+	return true;
+}
+
+/** @returns the readout interval of the given sensor [ms]. Sensors with an
+  * alert are only polled as fallback and for their heartbeat */
+static long intervalOf(const SensorSpec &spec, int delay) {
+	if(spec.interval > 0.0F) return (long)(spec.interval * 1000.0F);
+	if(spec.options.find("alert") == spec.options.end()) return delay * 1000L;
+	const long heartbeat = (long)(spec.getFloat("heartbeat", 0.0F) * 1000.0F);
+	return (heartbeat > 0 && heartbeat < ALERT_INTERVAL ? heartbeat : ALERT_INTERVAL);
+}
+
+/** Opens the alert line of the given sensor. Throws a const char* on error
+  * @returns the alert or NULL, if the sensor has none */
+static Alert* openAlert(const SensorSpec &spec) {
+	map<string, string>::const_iterator it = spec.options.find("alert");
+	if(it == spec.options.end()) return NULL;
+	string chip;
+	int line;
+	if(!GpioLine::parse(it->second, chip, line)) throw "Illegal alert line";
+	return new Alert(chip, line);
+}
+
+/** @returns the deadband options of the given spec */
+static map<string, string> deadbandOptions(const SensorSpec &spec) {
+	map<string, string> options;
+	for(map<string, string>::const_iterator it = spec.options.begin(); it != spec.options.end(); ++it)
+		if(Deadband::isOption(it->first)) options.insert(*it);
+	return options;
+}
+
+/** @returns true if both specs describe the same device with the same settings. Prefix, interval and deadbands may differ */
+static bool sameSensor(const SensorSpec &a, const SensorSpec &b) {
+	if(a.type != b.type || a.bus != b.bus || a.mux != b.mux || a.channel != b.channel) return false;
+	if(SensorRegistry::address(a) != SensorRegistry::address(b)) return false;
+	map<string, string> options_a, options_b;
+	for(map<string, string>::const_iterator it = a.options.begin(); it != a.options.end(); ++it)
+		if(it->first != "prefix" && it->first != "interval" && !Deadband::isOption(it->first)) options_a.insert(*it);
+	for(map<string, string>::const_iterator it = b.options.begin(); it != b.options.end(); ++it)
+		if(it->first != "prefix" && it->first != "interval" && !Deadband::isOption(it->first)) options_b.insert(*it);
+	return options_a == options_b;
+}
+
+/** Loads the saved states of the given sensors from the state cache
+  * @returns the number of sensors with a saved state */
+static size_t loadStates(vector<SensorSpec> &setup) {
+	size_t warm = 0;
+	if(_state_file.empty() || _states.load(_state_file) <= 0) return 0;
+	for(vector<SensorSpec>::iterator it = setup.begin(); it != setup.end(); ++it) {
+		it->state = _states.get(StateCache::key(*it));
+		if(!it->state.empty()) warm++;
+	}
+	return warm;
+}
+
+/**
+  * Reads every configured sensor at each of its precision levels and prints
+  * the nominal conversion time, the measured latency of a readout and the
+  * standard deviation of the readings. The configured level is restored
+  * @returns the exit code
+  */
+static int profileSensors(const Settings &settings) {
+	static const int READS = 8;
+	vector<SensorSpec> setup;
+	if(!setupSensors(settings, setup)) return EXIT_FAILURE;
+	loadStates(setup);
+	vector<SensorCreation> created;
+	SensorRegistry::createAll(setup, settings.i2c, created);
+	
+	int ret = EXIT_SUCCESS;
+	vector<Sensor*> read, late;
+	for(size_t i = 0; i < setup.size(); i++) {
+		Sensor *sensor = created[i].sensor;
+		if(sensor == NULL) {
+			cerr << "Error creating sensor " << setup[i].name << ": " << created[i].error << endl;
+			ret = EXIT_FAILURE;
+			continue;
+		}
+		const Channel *channels = sensor->channels();
+		const size_t count = sensor->channelCount();
+		const int configured = sensor->precision();
+		cout << "# " << setup[i].name << " (" << setup[i].type << "), precision " << configured << " of " << sensor->precisionLevels() << " levels" << endl;
+		
+		SensorHealth health(sensor);
+		const vector<SensorHealth*> sensors(1, &health);
+		for(int level = 0; level < sensor->precisionLevels(); level++) {
+			cout << "  " << level << " " << sensor->precisionName(level) << ": ";
+			if(sensor->setPrecision(level) != 0) {
+				cout << "failed" << endl;
+				continue;
+			}
+			vector<double> sum(count, 0.0), squares(count, 0.0);
+			long long total = 0;
+			int good = 0;
+			for(int j = 0; j < READS; j++) {
+				const long long start = monotonic_ns();
+				sampleSensors(sensors, read, late);
+				if(read.empty()) continue;
+				total += monotonic_ns() - start;
+				good++;
+				const float *readings = sensor->readings();
+				for(size_t k = 0; k < count; k++) {
+					sum[k] += readings[k];
+					squares[k] += (double)readings[k] * readings[k];
+				}
+			}
+			cout << "nominal " << sensor->conversionTime() / 1000.0 << " ms";
+			if(good == 0) {
+				cout << ", no successful reads" << endl;
+				continue;
+			}
+			cout << ", measured " << total / good / 1e6 << " ms (" << good << "/" << READS << " reads), sd";
+			for(size_t k = 0; k < count; k++) {
+				const size_t index = channels[k].index;
+				const double mean = sum[index] / good;
+				const double var = squares[index] / good - mean * mean;
+				cout << " " << channels[k].name << "=" << sqrt(var > 0.0 ? var : 0.0);
+			}
+			cout << endl;
+		}
+		sensor->setPrecision(configured);
+		delete sensor;
+	}
+	return ret;
+}
+
+int main(int argc, char** argv) {
+	const long long startup = monotonic_ns();
+	Settings settings;
+	if(!readConfig(CONFIG_FILE, settings)) return EXIT_FAILURE;
+	{
+		const int ret = parseArguments(argc, argv, settings);
+		if(ret != 0) return (ret > 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	quiet = settings.quiet;
+	_state_file = settings.state_file;
+	
+	if(settings.detect) {
+		vector<SensorSpec> detected;
+		const vector<string> all = i2cBuses();
+		const long long start = monotonic_ns();
+		detectSensors(all, vector<SensorSpec>(), detected, settings.detect_timeout);
+		const long long elapsed = (monotonic_ns() - start) / 1000000LL;
+		cout << "# " << detected.size() << " sensors detected on " << all.size() << " buses in " << elapsed << " ms" << endl;
+		for(vector<SensorSpec>::const_iterator it = detected.begin(); it != detected.end(); ++it) {
+			cout << endl << "[" << SensorRegistry::SECTION_PREFIX << it->name << "]" << endl;
+			cout << "type = " << it->type << endl;
+			cout << "i2c = " << it->bus << endl;
+			cout << "address = 0x" << hex << it->address << dec << endl;
+			if(!it->prefix.empty()) cout << "prefix = " << it->prefix << endl;
+		}
+		return EXIT_SUCCESS;
 	}
+	if(settings.profile) return profileSensors(settings);
+	
+	if(settings.mosquitto == "")
+		cerr << "WARNING: No mosquitto server defined. No data will be published!" << endl;
 	
-	// Setting up sensors
-	if(bmp180)
-		_sensors.push_back(new BMP180(i2c.c_str()));
-	if(htu21df)
-		_sensors.push_back(new HTU21DF(i2c.c_str()));
-	if(mcp9808)
-		_sensors.push_back(new MCP9808(i2c.c_str()));
-	if(tsl2561)
-		_sensors.push_back(new TSL2561(i2c.c_str()));
+	const long long detect_start = monotonic_ns();
+	vector<SensorSpec> setup;
+	if(!setupSensors(settings, setup)) return EXIT_FAILURE;
+	const long long init_start = monotonic_ns();
+	
+	// Devices with a saved state are initialized with it (warm start)
+	const size_t warm = loadStates(setup);
+	
+	// Initialization is mostly waiting for the devices, so all sensors are initialized concurrently
+	vector<SensorCreation> created;
+	SensorRegistry::createAll(setup, settings.i2c, created);
+	const SensorCreation *slowest = NULL;
+	bool failed = false;
+	// Every sample must hold all channels, configurations that do not fit are rejected
+	size_t fields = 0;
+	for(size_t i = 0; i < setup.size(); i++) {
+		if(created[i].error != NULL) {
+			cerr << "Error creating sensor " << setup[i].name << ": " << created[i].error << endl;
+			failed = true;
+		} else {
+			if(!fitsSample(created[i].sensor, created[i].sensor->prefix())) {
+				printKeyError("Error: ", setup[i].name, created[i].sensor->prefix());
+				failed = true;
+			}
+			fields += sampleFields(created[i].sensor, settings.budget);
+		}
+		if(slowest == NULL || created[i].time > slowest->time) slowest = &created[i];
+	}
+	if(fields > Sample::MAX_FIELDS) {
+		printFieldError("Error: ", fields, settings.budget);
+		failed = true;
+	}
+	if(failed) {
+		for(size_t i = 0; i < created.size(); i++) delete created[i].sensor;
+		return EXIT_FAILURE;
+	}
+	int next_id = 0;
+	for(size_t i = 0; i < setup.size(); i++) {
+		_sensors.push_back(created[i].sensor);
+		_intervals.push_back(intervalOf(setup[i], settings.delay));
+		_buses.push_back(created[i].sensor->device());
+		_specs.push_back(setup[i]);
+		_ids.push_back(next_id++);
+		try {
+			_deadbands.push_back(new Deadband(created[i].sensor, setup[i].options));
+		} catch (const char* msg) {
+			cerr << "Error in deadband configuration of sensor " << setup[i].name << ": " << msg << endl;
+			return EXIT_FAILURE;
+		}
+		try {
+			_alerts.push_back(openAlert(setup[i]));
+		} catch (const char* msg) {
+			cerr << "Error opening alert line of sensor " << setup[i].name << ": " << msg << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	reindex();
+	const long long init_end = monotonic_ns();
+	saveStates();
+	if(!quiet) {
+		cout << "Startup: config " << (detect_start - startup) / 1000000LL << " ms";
+		if(settings.autodetect) cout << ", detection " << (init_start - detect_start) / 1000000LL << " ms";
+		cout << ", initialization " << (init_end - init_start) / 1000000LL << " ms";
+		if(slowest != NULL) cout << " (slowest: " << setup[slowest - &created[0]].name << " " << slowest->time / 1000000LL << " ms)";
+		if(warm > 0) cout << ", " << warm << " of " << setup.size() << " sensors with saved state";
+		cout << endl;
+	}
 	
 	if(_sensors.size() == 0) {
 		cerr << "Error: No sensors set" << endl;
@@ -253,60 +764,420 @@ int main(int argc, char** argv) {
 		return EXIT_FAILURE;
 	}
 	
-	if(daemon) fork_daemon();
-	signal(SIGINT, sig_handler);
-	signal(SIGTERM, sig_handler);
+	if(settings.daemon) fork_daemon();
 	atexit(cleanup);
 	
-	while(running) {
-		// Read sensors
-		bool first = true;
-		for(vector<Sensor*>::const_iterator it = _sensors.begin(); it != _sensors.end(); ++it) {
-			readSensor(*it);
-			if(!quiet) {
-				if(first) first = false;
-				else cout << ", ";
-				cout << (*it)->toString();
+	// Readouts happen on absolute deadlines, so that the time spent for
+	// reading and publishing does not add up to the period.
+	// Every sensor has its own interval and is only read when it is due
+	Scheduler scheduler(settings.align);
+	for(size_t i = 0; i < _sensors.size(); i++)
+		scheduler.add(_ids[i], _intervals[i]);
+	
+	// Sampling deadlines, the config file and the signals are all handled
+	// by one event loop
+	EventLoop evloop;
+	vector<int> signals;
+	signals.push_back(SIGINT);
+	signals.push_back(SIGTERM);
+	signals.push_back(SIGHUP);
+	SignalFd sigfd(signals);
+	
+	// Every bus is read by its own worker thread. The workers are created
+	// after the signals are blocked, so that they inherit the signal mask
+	Sampler sampler;
+	sampler.setBreaker(settings.breaker_threshold, (long)(settings.breaker_backoff * 1000.0F), (long)(settings.breaker_backoff_max * 1000.0F));
+	sampler.setBudget(settings.budget);
+	for(size_t i = 0; i < _sensors.size(); i++)
+		sampler.add(_sensors[i], _buses[i]);
+	
+	// The samples are encoded and sent by the publisher thread, which also
+	// owns the mosquitto connection. A slow or lost connection only fills
+	// the queue and never delays the sampling
+	const auto publisherConfig = [](const Settings &from) {
+		PublisherConfig config;
+		config.mosquitto = from.mosquitto;
+		config.node_id = from.node_id;
+		config.name = from.name;
+		config.batch = from.batch;
+		config.batch_time = from.batch_time;
+		config.timestamps = from.timestamps;
+		config.quiet = from.quiet;
+		return config;
+	};
+	publisher = new Publisher((size_t)settings.queue, settings.overflow, publisherConfig(settings));
+	// Decides per cycle, whether the readings are news, and queues them
+	Reporter reporter(publisher, quiet);
+	for(size_t i = 0; i < _sensors.size(); i++)
+		reporter.setDeadband(_sensors[i], _deadbands[i]);
+	
+	// Sensors that became due while the sampler was still busy.
+	// All per-cycle buffers are reserved here, so that the steady state
+	// does not allocate memory
+	vector<Sensor*> backlog;
+	vector<Sensor*> sampled, late;
+	vector<pair<Sensor*, double> > stale;
+	vector<int> due;
+	vector<Sensor*> cycle;
+	Timer timer;
+	// Without sensors (e.g. all removed by a reload) there is no deadline and the timer is disarmed
+	const auto armTimer = [&]() {
+		const long long deadline = scheduler.deadline();
+		if(deadline < 0) timer.disarm();
+		else timer.setAbsolute(deadline);
+	};
+	const auto reserve = [&]() {
+		backlog.reserve(_sensors.size());
+		sampled.reserve(_sensors.size());
+		late.reserve(_sensors.size());
+		stale.reserve(_sensors.size());
+		due.reserve(_sensors.size());
+		cycle.reserve(_sensors.size());
+	};
+	reserve();
+	
+	// Reads the sensors in cycle, or right after the running cycle
+	const auto dispatch = [&]() {
+		if(cycle.size() > 0 && !sampler.sample(cycle)) {
+			// Previous cycle still running. Read the sensors right afterwards
+			for(vector<Sensor*>::const_iterator it = cycle.begin(); it != cycle.end(); ++it)
+				if(find(backlog.begin(), backlog.end(), *it) == backlog.end())
+					backlog.push_back(*it);
+		}
+	};
+	
+	// Sensors with an alert are read, when their alert line fires
+	const auto watchAlert = [&](Sensor *sensor, Alert *alert) {
+		evloop.add(alert->line.fd(), EPOLLIN, [&, sensor, alert](uint32_t) {
+			alert->edges += alert->line.acknowledge();
+			alert->readouts++;
+			cycle.clear();
+			cycle.push_back(sensor);
+			dispatch();
+		});
+	};
+	for(size_t i = 0; i < _sensors.size(); i++)
+		if(_alerts[i] != NULL) watchAlert(_sensors[i], _alerts[i]);
+	
+	// Reloading compares the new configuration with the running one and
+	// only changes what differs. Sensors are only replaced between cycles
+	bool reload_pending = false;
+	// Scheduler and sensor statistics, printed on exit, on SIGHUP and every stats seconds
+	long long next_stats = monotonic_ns() + (long long)(settings.stats * 1e9F);
+	const auto printStats = [&]() {
+		next_stats = monotonic_ns() + (long long)(settings.stats * 1e9F);
+		if(quiet) return;
+		std::lock_guard<std::mutex> lock(Publisher::console());
+		cout << "Scheduler: " << scheduler.cycles() << " cycles, " << scheduler.overruns() << " overruns (" << scheduler.skipped() << " skipped)";
+		cout << ", jitter mean " << scheduler.jitterMean() << " ms, max " << scheduler.jitterMax() << " ms" << endl;
+		for(size_t i = 0; i < _sensors.size(); i++) {
+			cout << "Sensor " << sampler.health(_sensors[i])->toString() << endl;
+			if(_deadbands[i]->active()) cout << "Deadband " << _specs[i].name << ": " << _deadbands[i]->toString() << endl;
+			if(_alerts[i] != NULL) {
+				cout << "Alert " << _specs[i].name << " (" << _alerts[i]->line.chip() << ":" << _alerts[i]->line.line() << "): ";
+				cout << _alerts[i]->edges << " edges, " << _alerts[i]->readouts << " readouts" << endl;
 			}
 		}
-		if(!quiet) cout << endl;
+	};
+	
+	const auto reload = [&]() {
+		reload_pending = false;
+		const long long start = monotonic_ns();
+		Settings next;
+		vector<SensorSpec> setup;
+		if(!readConfig(CONFIG_FILE, next) || parseArguments(argc, argv, next) != 0 || !setupSensors(next, setup, _specs)) {
+			cerr << "Reload failed after " << (monotonic_ns() - start) / 1000000LL << " ms. Keeping the running configuration" << endl;
+			return;
+		}
+		int added = 0, removed = 0, changed = 0, errors = 0;
 		
-		if(mosq != NULL) {
-			// Build json packet
-			stringstream ss;
-			
-			ss << "{\"node\":" << node_id;
-			if(name.size() > 0)
-				ss << ",\"name\":\"" << name << "\"";
-			
-			for(vector<Sensor*>::const_iterator it = _sensors.begin(); it != _sensors.end(); ++it) {
-				map<string,float> values = (*it)->values();
-				
-				for(map<string,float>::const_iterator j = values.begin(); j != values.end(); j++) {
-					ss << ",\"" << j->first << "\":" << j->second;
+		// Keep the sensors, that are still configured, and remove the others
+		for(size_t i = 0; i < _sensors.size(); ) {
+			vector<SensorSpec>::iterator match = setup.begin();
+			while(match != setup.end() && !sameSensor(_specs[i], *match)) ++match;
+			if(match == setup.end()) {
+				Sensor *sensor = _sensors[i];
+				_states.put(StateCache::key(_specs[i]), sensor);
+				scheduler.remove(_ids[i]);
+				sampler.remove(sensor);
+				backlog.erase(remove(backlog.begin(), backlog.end(), sensor), backlog.end());
+				_sensors.erase(_sensors.begin() + i);
+				_intervals.erase(_intervals.begin() + i);
+				_buses.erase(_buses.begin() + i);
+				_specs.erase(_specs.begin() + i);
+				_ids.erase(_ids.begin() + i);
+				reporter.setDeadband(sensor, NULL);
+				delete _deadbands[i];
+				_deadbands.erase(_deadbands.begin() + i);
+				if(_alerts[i] != NULL) {
+					evloop.remove(_alerts[i]->line.fd());
+					sensor->disarmAlert();
+					delete _alerts[i];
 				}
+				_alerts.erase(_alerts.begin() + i);
+				delete sensor;
+				removed++;
+				continue;
 			}
-			
-			ss << "}";
-			
-			string json = ss.str();
-			ss.str("");
-			ss << "meteo/" << node_id;
-			string topic = ss.str();
-			
+			bool modified = false;
+			if(match->prefix != _specs[i].prefix && !fitsSample(_sensors[i], match->prefix)) {
+				printKeyError("Reload: ", match->name, match->prefix);
+				match->prefix = _specs[i].prefix;
+				errors++;
+			}
+			if(match->prefix != _specs[i].prefix) {
+				_sensors[i]->setPrefix(match->prefix);
+				modified = true;
+			}
+			const long interval = intervalOf(*match, next.delay);
+			if(interval != _intervals[i]) {
+				scheduler.setPeriod(_ids[i], interval);
+				_intervals[i] = interval;
+				modified = true;
+			}
+			if(deadbandOptions(*match) != deadbandOptions(_specs[i])) {
+				try {
+					Deadband *deadband = new Deadband(_sensors[i], match->options);
+					reporter.setDeadband(_sensors[i], deadband);
+					delete _deadbands[i];
+					_deadbands[i] = deadband;
+					modified = true;
+				} catch (const char* msg) {
+					cerr << "Reload: Error in deadband configuration of sensor " << match->name << ": " << msg << ". Keeping the running deadbands" << endl;
+					errors++;
+				}
+			}
+			if(modified) changed++;
+			_specs[i] = *match;
+			setup.erase(match);
+			i++;
+		}
+		
+		// The running sensors fit with the running budget, a new budget may add the age fields
+		size_t fields = 0;
+		for(size_t i = 0; i < _sensors.size(); i++) fields += sampleFields(_sensors[i], next.budget);
+		if(fields > Sample::MAX_FIELDS) {
+			printFieldError("Reload: ", fields, next.budget);
+			cerr << "Reload: Keeping the budget of " << settings.budget << " ms" << endl;
+			next.budget = settings.budget;
+			fields = 0;
+			for(size_t i = 0; i < _sensors.size(); i++) fields += sampleFields(_sensors[i], next.budget);
+			errors++;
+		}
+		
+		// New sensors
+		sampler.setBreaker(next.breaker_threshold, (long)(next.breaker_backoff * 1000.0F), (long)(next.breaker_backoff_max * 1000.0F));
+		sampler.setBudget(next.budget);
+		_state_file = next.state_file;
+		loadStates(setup);
+		vector<SensorCreation> created;
+		SensorRegistry::createAll(setup, next.i2c, created);
+		for(size_t i = 0; i < setup.size(); i++) {
+			if(created[i].error != NULL) {
+				cerr << "Reload: Error creating sensor " << setup[i].name << ": " << created[i].error << endl;
+				errors++;
+				continue;
+			}
+			Sensor *sensor = created[i].sensor;
+			const bool keys = fitsSample(sensor, sensor->prefix());
+			if(!keys || fields + sampleFields(sensor, next.budget) > Sample::MAX_FIELDS) {
+				if(!keys) printKeyError("Reload: ", setup[i].name, sensor->prefix());
+				else printFieldError("Reload: ", fields + sampleFields(sensor, next.budget), next.budget);
+				cerr << "Reload: Sensor " << setup[i].name << " not added" << endl;
+				delete sensor;
+				errors++;
+				continue;
+			}
+			Deadband *deadband = NULL;
 			try {
-				mosq->publish(topic, json);
-				if(!quiet) cout << topic << " :: " << json << endl;
+				deadband = new Deadband(sensor, setup[i].options);
 			} catch (const char* msg) {
-				cerr << "Publish failed: " << msg << endl;
-			} catch (...) {
-				cerr << "Publish failed: Unknown exception caught" << endl;
+				cerr << "Reload: Error in deadband configuration of sensor " << setup[i].name << ": " << msg << endl;
+				delete sensor;
+				errors++;
+				continue;
 			}
+			Alert *alert = NULL;
+			try {
+				alert = openAlert(setup[i]);
+			} catch (const char* msg) {
+				cerr << "Reload: Error opening alert line of sensor " << setup[i].name << ": " << msg << endl;
+				delete deadband;
+				delete created[i].sensor;
+				errors++;
+				continue;
+			}
+			_sensors.push_back(created[i].sensor);
+			_intervals.push_back(intervalOf(setup[i], next.delay));
+			_buses.push_back(created[i].sensor->device());
+			_specs.push_back(setup[i]);
+			_ids.push_back(next_id++);
+			_deadbands.push_back(deadband);
+			reporter.setDeadband(sensor, deadband);
+			_alerts.push_back(alert);
+			fields += sampleFields(sensor, next.budget);
+			if(alert != NULL) watchAlert(_sensors.back(), alert);
+			scheduler.add(_ids.back(), _intervals.back());
+			sampler.add(_sensors.back(), _buses.back());
+			// Arms the alert
+			if(alert != NULL) backlog.push_back(_sensors.back());
+			added++;
+		}
+		reindex();
+		reserve();
+		
+		// Sinks. Pending samples are published with the running settings
+		bool sinks = false;
+		if(publisherConfig(next) != publisherConfig(settings)) {
+			publisher->configure(publisherConfig(next));
+			sinks = true;
+		}
+		if(next.overflow != settings.overflow) {
+			publisher->setOverflow(next.overflow);
+			sinks = true;
 		}
+		if(next.align != settings.align)
+			cerr << "Reload: Changing align requires a restart" << endl;
+		next.align = settings.align;
+		if(next.queue != settings.queue)
+			cerr << "Reload: Changing queue requires a restart" << endl;
+		next.queue = settings.queue;
+		settings = next;
+		if(added > 0 || removed > 0) saveStates();
+		armTimer();
 		
-		sleep(delay);
+		cerr << "Reload: " << added << " added, " << removed << " removed, " << changed << " changed";
+		if(errors > 0) cerr << ", " << errors << " failed";
+		if(sinks) cerr << ", sinks updated";
+		cerr << " in " << (monotonic_ns() - start) / 1000000LL << " ms" << endl;
+	};
+	const auto requestReload = [&]() {
+		reload_pending = true;
+		if(!sampler.busy()) reload();
+	};
+	
+	evloop.add(sigfd.fd(), EPOLLIN, [&](uint32_t) {
+		int signo;
+		while((signo = sigfd.next()) > 0) {
+			if(signo == SIGHUP) {
+				printStats();
+				requestReload();
+				continue;
+			}
+			running = false;
+			evloop.stop();
+		}
+	});
+	
+	FileWatch *watch = NULL;
+	if(settings.watch) {
+		try {
+			watch = new FileWatch(CONFIG_FILE);
+			evloop.add(watch->fd(), EPOLLIN, [&](uint32_t) {
+				if(watch->changed()) requestReload();
+			});
+		} catch (const char* msg) {
+			cerr << "Cannot watch " << CONFIG_FILE << ": " << msg << endl;
+		}
 	}
 	
+	bool first = true;
+	evloop.add(sampler.fd(), EPOLLIN, [&](uint32_t) {
+		if(!sampler.collect(sampled, late)) return;
+		if(first && sampled.size() > 0) {
+			first = false;
+			if(!quiet) cout << "Startup: first readout after " << (monotonic_ns() - startup) / 1000000LL << " ms" << endl;
+		}
+		// Late sensors are only published if they have been read before
+		stale.clear();
+		const long long now = monotonic_ns();
+		for(vector<Sensor*>::const_iterator it = late.begin(); it != late.end(); ++it) {
+			const double age = sampler.health(*it)->age(now);
+			if(age >= 0.0) stale.push_back(pair<Sensor*, double>(*it, age));
+		}
+		if(sampled.size() > 0 || stale.size() > 0) reporter.process(sampled, stale);
+		// An alert line, that is still asserted after its window has been
+		// re-armed, would not see another edge. Such a sensor is read once more
+		for(vector<Sensor*>::const_iterator it = sampled.begin(); it != sampled.end(); ++it) {
+			Alert *alert = alertOf(*it);
+			if(alert == NULL) continue;
+			if(alert->line.value() == 0 && !alert->retried) {
+				alert->retried = true;
+				if(find(backlog.begin(), backlog.end(), *it) == backlog.end()) backlog.push_back(*it);
+			} else
+				alert->retried = false;
+		}
+		if(reload_pending) reload();
+		if(backlog.size() > 0) {
+			sampler.sample(backlog);
+			backlog.clear();
+		}
+	});
+	
+	evloop.add(timer.fd(), EPOLLIN, [&](uint32_t) {
+		timer.acknowledge();
+		scheduler.due(due);
+		cycle.clear();
+		for(vector<int>::const_iterator it = due.begin(); it != due.end(); ++it) {
+			unordered_map<int, size_t>::const_iterator index = _job_index.find(*it);
+			if(index != _job_index.end()) cycle.push_back(_sensors[index->second]);
+		}
+		dispatch();
+		armTimer();
+	});
+	
+	// A coalesced sample is queued as soon as there is room, even if no further sample arrives
+	Timer misc;
+	evloop.add(misc.fd(), EPOLLIN, [&](uint32_t) {
+		misc.acknowledge();
+		publisher->retry();
+		if(settings.stats > 0.0F && monotonic_ns() >= next_stats) printStats();
+	});
+	misc.setPeriodic(1000);
+	
+	// Initially all sensors are read
+	sampler.sample(_sensors);
+	armTimer();
+	if(evloop.run() < 0)
+		cerr << "Event loop failed: " << strerror(errno) << endl;
+	
+	publisher->stop();
+	delete watch;
+	sampler.stop();
+	// The bus workers are gone, the alerts are disabled from this thread
+	for(size_t i = 0; i < _sensors.size(); i++) {
+		if(_alerts[i] == NULL) continue;
+		evloop.remove(_alerts[i]->line.fd());
+		if(_sensors[i]->select() == 0) _sensors[i]->disarmAlert();
+	}
+	
+	printStats();
+	if(!quiet) {
+		const Batch &batch = publisher->batch();
+		if(batch.messages > 0 && batch.size > 1) {
+			cout << "Batching: " << batch.messages << " messages, " << ((double)batch.samples / batch.messages) << " samples per message";
+			cout << ", " << ((double)batch.bytes / batch.samples) << " bytes per sample";
+			cout << ", flush latency mean " << (batch.latency / batch.messages) / 1e6 << " ms, max " << batch.latency_max / 1e6 << " ms" << endl;
+		}
+		const long packets = reporter.packets(), suppressed = reporter.suppressed();
+		if(suppressed > 0) {
+			cout << "Publishing: " << suppressed << " of " << (packets + suppressed) << " packets suppressed";
+			cout << " (" << (100.0 * suppressed / (packets + suppressed)) << " %)" << endl;
+		}
+		if(settings.mosquitto != "") {
+			cout << "Queue: " << publisher->toString() << endl;
+			for(int i = 0; i < Publisher::STAGES; i++) {
+				const Publisher::Stage stage = (Publisher::Stage)i;
+				if(publisher->latency(stage).count() > 0)
+					cout << "Latency " << Publisher::stageName(stage) << ": " << publisher->latency(stage).toString() << endl;
+			}
+		}
+		const vector<TCA9548A*> &muxes = TCA9548A::instances();
+		for(vector<TCA9548A*>::const_iterator it = muxes.begin(); it != muxes.end(); ++it)
+			cout << "Multiplexer " << (*it)->toString() << endl;
+	}
+	delete publisher;
+	publisher = NULL;
 	
 	return 0;
 }
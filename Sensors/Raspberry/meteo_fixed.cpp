@@ -0,0 +1,150 @@
+/* =============================================================================
+ *
+ * Title:         Meteo program for a fixed sensor set
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Meteo sensor node, whose sensors are fixed at compile time.
+ *                The sensor set is chosen with METEO_SENSOR_SET, e.g.
+ *                make meteo-fixed SENSOR_SET=BMP180,HTU21DF
+ *
+ * =============================================================================
+ */
+
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include <cstdlib>
+#include <signal.h>
+
+#include "sensors.hpp"
+#include "sensorset.hpp"
+#include "config.hpp"
+#include "mosquitto.hpp"
+#include "scheduler.hpp"
+#include "encoder.hpp"
+
+using namespace std;
+using namespace sensors;
+using namespace meteo;
+
+
+#define CONFIG_FILE "meteo.cf"
+
+#ifndef METEO_SENSOR_SET
+#define METEO_SENSOR_SET BMP180, HTU21DF, MCP9808, TSL2561
+#endif
+
+typedef SensorSet<METEO_SENSOR_SET> FixedSensors;
+
+
+static volatile bool running = true;
+
+static void sig_handler(int signo) {
+	(void)signo;
+	running = false;
+}
+
+int main(int argc, char** argv) {
+	string i2c = "/dev/i2c-2";
+	string mosquitto = "";
+	int node_id = 0;
+	string name = "";
+	int delay = 5;				// Delay between readouts [Seconds]
+	bool quiet = false;
+
+	{
+		string tmp;
+		Config config(CONFIG_FILE);
+		if(!config.readSuccessfull()) {
+			cerr << "Reading of the config file failed." << endl;
+			cerr << "Please check your config file " << CONFIG_FILE << endl;
+			return EXIT_FAILURE;
+		}
+		if((tmp = config.get("mosquitto", "")) != "")
+			mosquitto = tmp;
+		if((tmp = config.get("i2c", "")) != "")
+			i2c = tmp;
+		node_id = config.getInt("id", node_id);
+		delay = config.getInt("delay", delay);
+		name = config.get("name", "");
+	}
+	for(int i=1;i<argc;i++) {
+		string arg(argv[i]);
+		if(arg == "-h" || arg == "--help") {
+			cout << "Meteo Sensor (fixed sensor set, " << FixedSensors::SIZE << " sensors, " << FixedSensors::CHANNELS << " channels)" << endl;
+			cout << "Usage: " << argv[0] << " [OPTIONS]" << endl;
+			cout << "OPTIONS:" << endl;
+			cout << "    -h     --help               Print this help message" << endl;
+			cout << "    -q     --quiet              Quiet mode" << endl;
+			cout << "The config file '" << CONFIG_FILE << "' is read for i2c, mosquitto, id, name and delay" << endl;
+			return EXIT_SUCCESS;
+		} else if(arg == "--quiet" || arg == "-q") {
+			quiet = true;
+		} else {
+			cerr << "Illegal argument: " << arg << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	if(delay <= 0) delay = 1;
+
+	Mosquitto *mosq = NULL;
+	if(mosquitto != "") {
+		try {
+			mosq = new Mosquitto();
+			mosq->connect(mosquitto.c_str());
+			mosq->loopStart();
+		} catch (const char* msg) {
+			cerr << "Mosquitto: " << msg << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	string topic;
+	{
+		stringstream ss;
+		ss << "meteo/" << node_id;
+		topic = ss.str();
+	}
+
+	signal(SIGINT, sig_handler);
+	signal(SIGTERM, sig_handler);
+
+	FixedSensors sensors(i2c);
+	JsonEncoder encoder(256 + FixedSensors::CHANNELS * 96 + name.size());
+	Scheduler scheduler;
+	scheduler.add(0, delay * 1000L);
+	vector<int> due;
+	due.reserve(1);
+
+	do {
+		const int failed = sensors.sample();
+		if(!quiet) {
+			sensors.print(cout);
+			if(failed > 0) cout << " (" << failed << " failed)";
+			cout << endl;
+		}
+
+		// Like meteo, only the sensors that have been read are published
+		if(mosq != NULL && sensors.validCount() > 0) {
+			encoder.begin();
+			encoder.field("node", (long)node_id);
+			if(name.size() > 0) encoder.field("name", name.c_str());
+			sensors.encode(encoder);
+			encoder.end();
+			try {
+				mosq->publish(topic.c_str(), encoder.data(), encoder.size());
+			} catch (const char* msg) {
+				cerr << "Publish failed: " << msg << endl;
+			}
+		}
+	} while(running && scheduler.wait(due) == 0);
+
+	if(mosq != NULL) {
+		mosq->close();
+		delete mosq;
+	}
+	return EXIT_SUCCESS;
+}
@@ -42,6 +42,8 @@ public:
 	void subscribe(const std::string &topic);
 	
 	void publish(const std::string &topic, const std::string &message);
+	/** Publishes the given payload without copying it. Throws a const char* on error */
+	void publish(const char* topic, const void* payload, size_t len);
 	
 	/**
 	  * Connects to the given remote host
@@ -65,6 +67,23 @@ public:
 	/** Starts the loop as background thread */
 	void loopStart();
 	
+	/** @returns the socket of the connection for use in an external event loop, or -1 if not connected */
+	int socket();
+	/** @returns true if there is outgoing data, i.e. the socket should be watched for writability */
+	bool wantWrite();
+	/** Reads incoming data. To be called when the socket is readable
+	  * @returns MOSQ_ERR_SUCCESS on success or a mosquitto error code */
+	int loopRead();
+	/** Writes outgoing data. To be called when the socket is writable
+	  * @returns MOSQ_ERR_SUCCESS on success or a mosquitto error code */
+	int loopWrite();
+	/** Handles keepalive pings and retries. Should be called about once per second
+	  * @returns MOSQ_ERR_SUCCESS on success or a mosquitto error code */
+	int loopMisc();
+	/** Reconnects after the connection has been lost
+	  * @returns MOSQ_ERR_SUCCESS on success or a mosquitto error code */
+	int reconnect();
+	
 	/** Cleanup mosquitto library. This call should be called before program termination */
 	static void cleanup_library();
 };
@@ -173,11 +192,12 @@ void Mosquitto::subscribe(const std::string &topic) {
 }
 
 void Mosquitto::publish(const std::string &topic, const std::string &message) {
-	const char *payload = message.c_str();
-	const int len = (int)message.size();
-	
+	this->publish(topic.c_str(), message.c_str(), message.size());
+}
+
+void Mosquitto::publish(const char* topic, const void* payload, size_t len) {
 	const int qos = 0;
-	int ret = mosquitto_publish(this->mosq, NULL, topic.c_str(), len, (const void*)payload, qos, false);
+	int ret = mosquitto_publish(this->mosq, NULL, topic, (int)len, payload, qos, false);
 	if(ret != MOSQ_ERR_SUCCESS)
 		throw mosquitto_strerror(ret);
 }
@@ -229,4 +249,28 @@ void Mosquitto::loopStart() {
 		throw mosquitto_strerror(rc);
 }
 
+int Mosquitto::socket() {
+	return mosquitto_socket(this->mosq);
+}
+
+bool Mosquitto::wantWrite() {
+	return mosquitto_want_write(this->mosq);
+}
+
+int Mosquitto::loopRead() {
+	return mosquitto_loop_read(this->mosq, 1);
+}
+
+int Mosquitto::loopWrite() {
+	return mosquitto_loop_write(this->mosq, 1);
+}
+
+int Mosquitto::loopMisc() {
+	return mosquitto_loop_misc(this->mosq);
+}
+
+int Mosquitto::reconnect() {
+	return mosquitto_reconnect(this->mosq);
+}
+
 #endif
@@ -0,0 +1,525 @@
+/* =============================================================================
+ *
+ * Title:         Sample publisher
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Publisher thread, that encodes and sends the samples of
+ *                the sampling thread, decoupled by a lock-free ring
+ *
+ * =============================================================================
+ */
+
+#include <iostream>
+#include <sstream>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "publisher.hpp"
+#include "scheduler.hpp"
+#include "mosquitto.hpp"
+
+
+namespace meteo {
+
+void Sample::clear(long long monotonic, long long realtime) {
+	this->monotonic = monotonic;
+	this->realtime = realtime;
+	this->started = 0;
+	this->converted = 0;
+	this->count = 0;
+	this->truncated = 0;
+	this->merged = 0;
+}
+
+void Sample::stamp(long long started, long long converted) {
+	if(started <= 0) return;
+	if(this->started == 0 || started < this->started) this->started = started;
+	if(converted > this->converted) this->converted = converted;
+}
+
+bool Sample::add(const char* prefix, const char* key, float value, const char* suffix) {
+	if(this->count >= MAX_FIELDS) {
+		this->truncated++;
+		return false;
+	}
+	Field &field = this->fields[this->count];
+	const int len = snprintf(field.key, KEY_SIZE, "%s%s%s", prefix, key, (suffix == NULL ? "" : suffix));
+	if(len < 0 || (size_t)len >= KEY_SIZE) {
+		this->truncated++;
+		return false;
+	}
+	field.value = value;
+	this->count++;
+	return true;
+}
+
+uint32_t Sample::merge(const Sample &newer) {
+	uint32_t lost = 0;
+	for(uint32_t i = 0; i < newer.count; i++) {
+		uint32_t j = 0;
+		while(j < this->count && strcmp(this->fields[j].key, newer.fields[i].key) != 0) j++;
+		if(j < this->count) this->fields[j].value = newer.fields[i].value;
+		else if(this->count < MAX_FIELDS) this->fields[this->count++] = newer.fields[i];
+		else lost++;
+	}
+	this->monotonic = newer.monotonic;
+	this->realtime = newer.realtime;
+	this->started = newer.started;
+	this->converted = newer.converted;
+	this->merged += newer.merged + 1;
+	this->truncated += lost;
+	return lost;
+}
+
+bool Sample::fits(const char* prefix, const char* key, const char* suffix) {
+	return strlen(prefix) + strlen(key) + (suffix == NULL ? 0 : strlen(suffix)) < KEY_SIZE;
+}
+
+bool PublisherConfig::operator==(const PublisherConfig &other) const {
+	return this->mosquitto == other.mosquitto && this->node_id == other.node_id && this->name == other.name &&
+		this->batch == other.batch && this->batch_time == other.batch_time && this->timestamps == other.timestamps &&
+		this->quiet == other.quiet;
+}
+
+/** @returns the maximum size of an encoded sample with the given fields in bytes.
+  * One more field is reserved for the timestamps or the coalesced readouts */
+static size_t sampleSize(size_t fields) {
+	return 64 + (fields + 1) * 96;
+}
+
+Publisher::Publisher(size_t capacity, Overflow overflow, const PublisherConfig &config) : _ring(capacity) {
+	this->_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(this->_efd < 0) throw "Error creating eventfd";
+	this->_changed = false;
+	this->_stopping = false;
+	this->_overflow = overflow;
+	this->_has_pending = false;
+	this->_pushed = 0;
+	this->_dropped = 0;
+	this->_coalesced = 0;
+	this->_truncated = 0;
+	this->_high_water = 0;
+	this->_config = config;
+	this->_mosq = NULL;
+	this->_mosq_fd = -1;
+	this->_lost = false;
+	this->_reconnect = 0;
+	this->_backoff = 1;
+	this->_encoder = NULL;
+	this->_fields = 0;
+	this->_sent = 0;
+	this->_unsent = 0;
+	this->_batch.size = (config.batch < 1 ? 1 : config.batch);
+	this->_batch.time = (long long)(config.batch_time * 1e9F);
+	std::stringstream ss;
+	ss << "meteo/" << config.node_id;
+	this->_topic = ss.str();
+	this->_thread = std::thread(&Publisher::run, this);
+}
+
+Publisher::~Publisher() {
+	this->stop();
+	::close(this->_efd);
+	delete this->_encoder;
+}
+
+void Publisher::wake(void) {
+	const uint64_t value = 1;
+	if(::write(this->_efd, &value, sizeof(value)) < 0) {}		// Counter is already non-zero
+}
+
+void Publisher::push(const Sample &sample) {
+	this->_pushed++;
+	if(sample.truncated > 0) this->truncated(sample.truncated);
+	bool queued = false;
+	if(this->_has_pending) {
+		// The coalesced sample is older and goes first
+		if(this->_ring.push(this->_pending)) this->_has_pending = false;
+		else {
+			const uint32_t lost = this->_pending.merge(sample);
+			if(lost > 0) this->truncated(lost);
+			this->_coalesced++;
+			queued = true;
+		}
+	}
+	if(!queued) {
+		switch(this->_overflow) {
+		case DROP_OLDEST:
+			if(!this->_ring.pushOverwrite(sample)) this->_dropped++;
+			break;
+		case DROP_NEWEST:
+			if(!this->_ring.push(sample)) this->_dropped++;
+			break;
+		case COALESCE:
+			if(!this->_ring.push(sample)) {
+				this->_pending = sample;
+				this->_has_pending = true;
+			}
+			break;
+		}
+	}
+	const size_t occupancy = this->_ring.size();
+	if(occupancy > this->_high_water) this->_high_water = occupancy;
+	this->wake();
+}
+
+void Publisher::truncated(uint32_t fields) {
+	if(this->_truncated == 0) {
+		std::lock_guard<std::mutex> lock(console());
+		std::cerr << "WARNING: " << fields << " fields did not fit into a sample (at most " << Sample::MAX_FIELDS << " fields of " << Sample::KEY_SIZE - 1 << " characters) and are not published" << std::endl;
+	}
+	this->_truncated += fields;
+}
+
+void Publisher::retry(void) {
+	if(!this->_has_pending || !this->_ring.push(this->_pending)) return;
+	this->_has_pending = false;
+	this->wake();
+}
+
+void Publisher::configure(const PublisherConfig &config) {
+	{
+		std::lock_guard<std::mutex> lock(this->_mutex);
+		this->_next = config;
+		this->_changed = true;
+	}
+	this->wake();
+}
+
+void Publisher::stop(void) {
+	if(!this->_thread.joinable()) return;
+	if(this->_has_pending) {
+		if(!this->_ring.pushOverwrite(this->_pending)) this->_dropped++;
+		this->_has_pending = false;
+	}
+	{
+		std::lock_guard<std::mutex> lock(this->_mutex);
+		this->_stopping = true;
+	}
+	this->wake();
+	this->_thread.join();
+}
+
+void Publisher::run(void) {
+	this->connect();
+	this->reserve(0);
+	this->_loop.add(this->_efd, EPOLLIN, [this](uint32_t) {
+		uint64_t value;
+		if(::read(this->_efd, &value, sizeof(value)) < 0) {}		// Only resets the eventfd
+		PublisherConfig config;
+		bool changed, stopping;
+		{
+			std::lock_guard<std::mutex> lock(this->_mutex);
+			changed = this->_changed;
+			this->_changed = false;
+			if(changed) config = this->_next;
+			stopping = this->_stopping;
+		}
+		if(changed) this->apply(config);
+		this->drain();
+		if(stopping) this->_loop.stop();
+	});
+	this->_loop.add(this->_misc.fd(), EPOLLIN, [this](uint32_t) {
+		this->_misc.acknowledge();
+		this->misc();
+	});
+	this->_misc.setPeriodic(1000);
+	this->watch();
+	if(this->_loop.run() < 0) {
+		std::lock_guard<std::mutex> lock(console());
+		std::cerr << "Publisher event loop failed: " << strerror(errno) << std::endl;
+	}
+
+	// Samples, that cannot be sent anymore, are discarded
+	this->drain();
+	Sample sample;
+	while(this->_ring.pop(sample)) this->_unsent++;
+	this->flushBatch();
+	this->disconnect();
+	this->_loop.remove(this->_misc.fd());
+	this->_loop.remove(this->_efd);
+}
+
+void Publisher::apply(const PublisherConfig &config) {
+	// Pending samples are published with the running settings
+	this->flushBatch();
+	const bool reconnect = (config.mosquitto != this->_config.mosquitto);
+	if(reconnect) this->disconnect();
+	this->_config = config;
+	this->_batch.size = (config.batch < 1 ? 1 : config.batch);
+	this->_batch.time = (long long)(config.batch_time * 1e9F);
+	std::stringstream ss;
+	ss << "meteo/" << config.node_id;
+	this->_topic = ss.str();
+	this->reserve(0);
+	if(reconnect) this->connect();
+	this->watch();
+}
+
+void Publisher::connect(void) {
+	if(this->_config.mosquitto.empty()) return;
+	this->_lost = true;
+	this->_backoff = 1;
+	this->_reconnect = 0;
+	if(!this->open()) this->_reconnect = this->_backoff;
+}
+
+bool Publisher::open(void) {
+	try {
+		if(this->_mosq == NULL) {
+			this->_mosq = new Mosquitto();
+			this->_mosq->connect(this->_config.mosquitto.c_str());
+		} else if(this->_mosq->reconnect() != MOSQ_ERR_SUCCESS)
+			return false;
+	} catch (const char* msg) {
+		// Retried with backoff like a lost connection, also if the
+		// instance could not be created
+		std::lock_guard<std::mutex> lock(console());
+		std::cerr << "Mosquitto: " << msg << std::endl;
+		return false;
+	}
+	this->_lost = false;
+	this->_backoff = 1;
+	return true;
+}
+
+void Publisher::disconnect(void) {
+	if(this->_mosq == NULL) return;
+	if(this->_mosq_fd >= 0) this->_loop.remove(this->_mosq_fd);
+	this->_mosq_fd = -1;
+	this->_mosq->close();
+	delete this->_mosq;
+	this->_mosq = NULL;
+}
+
+void Publisher::watch(void) {
+	if(this->_mosq == NULL) return;
+
+	const int fd = (this->_lost ? -1 : this->_mosq->socket());
+	if(this->_mosq_fd >= 0 && fd != this->_mosq_fd) {
+		this->_loop.remove(this->_mosq_fd);
+		this->_mosq_fd = -1;
+	}
+	if(fd < 0) return;
+
+	// Only watch for writability if there is pending outgoing data
+	uint32_t events = EPOLLIN;
+	if(this->_mosq->wantWrite()) events |= EPOLLOUT;
+	if(this->_mosq_fd < 0) {
+		this->_loop.add(fd, events, [this](uint32_t ready) { this->event(ready); });
+		this->_mosq_fd = fd;
+	} else
+		this->_loop.modify(fd, events);
+}
+
+void Publisher::event(uint32_t events) {
+	int rc = MOSQ_ERR_SUCCESS;
+	if(events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+		rc = this->_mosq->loopRead();
+	if(rc == MOSQ_ERR_SUCCESS && (events & EPOLLOUT))
+		rc = this->_mosq->loopWrite();
+	if(rc != MOSQ_ERR_SUCCESS) {
+		std::lock_guard<std::mutex> lock(console());
+		std::cerr << "Mosquitto connection lost: " << mosquitto_strerror(rc) << std::endl;
+		this->_lost = true;
+	}
+	this->watch();
+}
+
+void Publisher::misc(void) {
+	if(this->_mosq != NULL && !this->_lost) {
+		const int rc = this->_mosq->loopMisc();
+		if(rc != MOSQ_ERR_SUCCESS) this->_lost = true;
+	}
+	if(!this->_config.mosquitto.empty() && this->_lost && --this->_reconnect <= 0) {
+		if(!this->open()) {
+			// Exponential backoff up to one minute
+			this->_backoff *= 2;
+			if(this->_backoff > 60) this->_backoff = 60;
+			this->_reconnect = this->_backoff;
+		}
+	}
+	// Samples wait at most batch_time, even if no further sample arrives
+	if(this->_batch.count > 0 && this->_batch.time > 0 && monotonic_ns() - this->_batch.first >= this->_batch.time)
+		this->flushBatch();
+	// Samples queued while the connection was lost
+	this->drain();
+}
+
+void Publisher::drain(void) {
+	// While the connection is lost or could not be created, the samples stay
+	// in the ring and the overflow policy counts the dropped ones.
+	// Without a broker they are discarded
+	Sample sample;
+	if(this->_config.mosquitto.empty()) {
+		while(this->_ring.pop(sample)) {}
+		return;
+	}
+	if(this->_mosq == NULL || this->_lost) return;
+	while(this->_ring.pop(sample)) this->send(sample);
+	this->watch();
+}
+
+void Publisher::send(const Sample &sample) {
+	const long long now = monotonic_ns();
+	this->_sent++;
+	if(sample.started > 0) {
+		this->_latency[STAGE_CONVERSION].add(sample.converted - sample.started);
+		this->_latency[STAGE_CYCLE].add(sample.monotonic - sample.converted);
+	}
+	this->_latency[STAGE_QUEUE].add(now - sample.monotonic);
+	this->reserve(sample.count);
+	const Stamps stamps = { sample.started, now };
+
+	JsonEncoder *encoder = this->_encoder;
+	if(this->_batch.size <= 1) {
+		encoder->begin();
+		encoder->field("node", (long)this->_config.node_id);
+		if(this->_config.name.size() > 0)
+			encoder->field("name", this->_config.name.c_str());
+		this->encodeFields(sample, now);
+		encoder->end();
+		this->_stamps.push_back(stamps);
+		this->publishPacket();
+		return;
+	}
+	// A batch is flushed before it would overflow
+	if(this->_batch.count > 0 && encoder->remaining() < sampleSize(sample.count) + 2)
+		this->flushBatch();
+	if(this->_batch.count == 0) {
+		encoder->begin();
+		encoder->field("node", (long)this->_config.node_id);
+		if(this->_config.name.size() > 0)
+			encoder->field("name", this->_config.name.c_str());
+		encoder->beginArray("samples");
+		this->_batch.first = sample.monotonic;
+	}
+	encoder->beginObject();
+	encoder->field("ts", sample.realtime / 1000000LL);
+	this->encodeFields(sample, now);
+	encoder->endObject();
+	this->_stamps.push_back(stamps);
+	this->_batch.count++;
+	if(this->_batch.count >= this->_batch.size || (this->_batch.time > 0 && now - this->_batch.first >= this->_batch.time))
+		this->flushBatch();
+}
+
+void Publisher::reserve(size_t fields) {
+	if(fields > this->_fields) this->_fields = fields;
+	this->_stamps.reserve((size_t)this->_batch.size);
+	// Header and one sample per message of a batch
+	const size_t capacity = 256 + this->_config.name.size() + (size_t)this->_batch.size * sampleSize(this->_fields);
+	if(this->_encoder != NULL && this->_encoder->capacity() + 1 >= capacity) return;
+	this->flushBatch();
+	delete this->_encoder;
+	this->_encoder = new JsonEncoder(capacity);
+}
+
+void Publisher::encodeFields(const Sample &sample, long long encoded) {
+	for(uint32_t i = 0; i < sample.count; i++)
+		this->_encoder->field(sample.fields[i].key, sample.fields[i].value);
+	if(this->_config.timestamps && sample.started > 0) {
+		// Realtime of the first conversion start and the offsets of the
+		// conversion end, queueing and encoding [us]
+		const long long stamps[] = {
+			(sample.realtime + sample.started - sample.monotonic) / 1000LL,
+			(sample.converted - sample.started) / 1000LL,
+			(sample.monotonic - sample.started) / 1000LL,
+			(encoded - sample.started) / 1000LL
+		};
+		this->_encoder->field("stamps", stamps, sizeof(stamps) / sizeof(stamps[0]));
+	}
+	// Number of readouts, that have been coalesced into this sample
+	if(sample.merged > 0)
+		this->_encoder->field("coalesced", (long)sample.merged + 1);
+}
+
+void Publisher::publishPacket(void) {
+	if(this->_encoder->overflow()) {
+		this->_stamps.clear();
+		std::lock_guard<std::mutex> lock(console());
+		std::cerr << "Publish failed: Packet too large" << std::endl;
+		return;
+	}
+	try {
+		const long long start = monotonic_ns();
+		this->_mosq->publish(this->_topic.c_str(), this->_encoder->data(), this->_encoder->size());
+		const long long end = monotonic_ns();
+		this->_latency[STAGE_PUBLISH].add(end - start);
+		for(std::vector<Stamps>::const_iterator it = this->_stamps.begin(); it != this->_stamps.end(); ++it) {
+			this->_latency[STAGE_BATCH].add(start - it->encoded);
+			if(it->started > 0) this->_latency[STAGE_TOTAL].add(end - it->started);
+		}
+		if(!this->_config.quiet) {
+			std::lock_guard<std::mutex> lock(console());
+			std::cout << this->_topic << " :: " << this->_encoder->data() << std::endl;
+		}
+	} catch (const char* msg) {
+		std::lock_guard<std::mutex> lock(console());
+		std::cerr << "Publish failed: " << msg << std::endl;
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(console());
+		std::cerr << "Publish failed: Unknown exception caught" << std::endl;
+	}
+	this->_stamps.clear();
+}
+
+void Publisher::flushBatch(void) {
+	if(this->_batch.count == 0 || this->_encoder == NULL) return;
+	this->_encoder->endArray();
+	this->_encoder->end();
+	const long long latency = monotonic_ns() - this->_batch.first;
+	this->_batch.messages++;
+	this->_batch.samples += this->_batch.count;
+	this->_batch.bytes += this->_encoder->size();
+	this->_batch.latency += latency;
+	if(latency > this->_batch.latency_max) this->_batch.latency_max = latency;
+	this->_batch.count = 0;
+	if(this->_mosq != NULL) this->publishPacket();
+	this->_stamps.clear();
+	this->watch();
+}
+
+std::string Publisher::toString(void) const {
+	std::stringstream ss;
+	ss << this->capacity() << " slots (" << overflowName(this->_overflow) << "), high water " << this->_high_water;
+	ss << ", " << this->_pushed << " samples, " << this->_sent << " sent, " << this->_dropped << " dropped";
+	if(this->_coalesced > 0) ss << ", " << this->_coalesced << " coalesced";
+	if(this->_truncated > 0) ss << ", " << this->_truncated << " fields truncated";
+	if(this->_unsent > 0) ss << ", " << this->_unsent << " unsent";
+	return ss.str();
+}
+
+bool Publisher::parseOverflow(const std::string &name, Overflow &overflow) {
+	if(name == "drop_oldest") overflow = DROP_OLDEST;
+	else if(name == "drop_newest") overflow = DROP_NEWEST;
+	else if(name == "coalesce") overflow = COALESCE;
+	else return false;
+	return true;
+}
+
+const char* Publisher::overflowName(Overflow overflow) {
+	switch(overflow) {
+	case DROP_OLDEST: return "drop_oldest";
+	case DROP_NEWEST: return "drop_newest";
+	case COALESCE: return "coalesce";
+	}
+	return "";
+}
+
+const char* Publisher::stageName(Stage stage) {
+	static const char* names[STAGES] = { "conversion", "cycle", "queue", "batch", "publish", "total" };
+	return (stage >= 0 && stage < STAGES ? names[stage] : "");
+}
+
+std::mutex& Publisher::console(void) {
+	static std::mutex mutex;
+	return mutex;
+}
+
+}
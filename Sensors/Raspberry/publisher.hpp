@@ -0,0 +1,275 @@
+/* =============================================================================
+ *
+ * Title:         Sample publisher
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Publisher thread, that encodes and sends the samples of
+ *                the sampling thread, decoupled by a lock-free ring
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_PUBLISHER_HPP
+#define _METEO_PUBLISHER_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+
+#include <stdint.h>
+
+#include "spsc.hpp"
+#include "eventloop.hpp"
+#include "encoder.hpp"
+#include "histogram.hpp"
+
+
+class Mosquitto;
+
+namespace meteo {
+
+/**
+  * Fixed-size record of the readings of one cycle. The channel names are
+  * copied, so that a record stays valid when its sensors are removed.
+  * Configurations, whose channels do not fit, are rejected (see fits())
+  */
+struct Sample {
+	static const size_t MAX_FIELDS = 128;
+	static const size_t KEY_SIZE = 48;
+	struct Field {
+		char key[KEY_SIZE];
+		float value;
+	};
+	/** Monotonic and realtime time, when the sample was queued [ns] */
+	long long monotonic, realtime;
+	/** Monotonic time, when the first conversion of the sample was started
+	  * and when the last one was done [ns], 0 if unknown */
+	long long started, converted;
+	/** Number of fields */
+	uint32_t count;
+	/** Fields, that did not fit into the record */
+	uint32_t truncated;
+	/** Number of newer samples, that have been coalesced into this one */
+	uint32_t merged;
+	Field fields[MAX_FIELDS];
+
+	/** Removes all fields and sets the time, when the sample is queued */
+	void clear(long long monotonic, long long realtime);
+	/** Widens the conversion time of the sample to include the given conversion */
+	void stamp(long long started, long long converted);
+	/** Adds the field PREFIX KEY SUFFIX
+	  * @returns false if the record is full or the name too long */
+	bool add(const char* prefix, const char* key, float value, const char* suffix = NULL);
+	/** Merges a newer sample into this one. Fields of both take the newer value
+	  * @returns the number of fields, that did not fit */
+	uint32_t merge(const Sample &newer);
+
+	/** @returns true if the key PREFIX KEY SUFFIX fits into a field */
+	static bool fits(const char* prefix, const char* key, const char* suffix = NULL);
+};
+
+/** Batching of multiple samples into one message */
+struct Batch {
+	/** Maximum samples per message, 1 if disabled */
+	int size;
+	/** Maximum age of the first sample of a message [ns], 0 if unlimited */
+	long long time;
+	/** Samples in the current message */
+	int count;
+	/** Monotonic time of the first sample of the current message [ns] */
+	long long first;
+	/** Published messages, samples and bytes */
+	long messages, samples;
+	long long bytes;
+	/** Sum and maximum of the age of the first sample, when a message was flushed [ns] */
+	long long latency, latency_max;
+
+	Batch() : size(1), time(0), count(0), first(0), messages(0), samples(0), bytes(0), latency(0), latency_max(0) {}
+};
+
+/** Settings of the publisher, that can change on a reload */
+struct PublisherConfig {
+	/** Mosquitto host, empty if disabled */
+	std::string mosquitto;
+	int node_id;
+	std::string name;
+	/** Samples per message */
+	int batch;
+	/** Maximum delay of a sample in a batch [s] */
+	float batch_time;
+	/** Adds the timestamps of the stages to every sample */
+	bool timestamps;
+	/** Do not print the published packets */
+	bool quiet;
+
+	PublisherConfig() : node_id(0), batch(1), batch_time(0.0F), timestamps(false), quiet(false) {}
+	bool operator==(const PublisherConfig &other) const;
+	bool operator!=(const PublisherConfig &other) const { return !(*this == other); }
+};
+
+/**
+  * Publishes samples from its own thread. The sampling thread pushes every
+  * sample into a lock-free ring and returns immediately, the publisher
+  * thread drains the ring, encodes and sends the samples. The publisher
+  * thread owns the mosquitto connection with its keepalive and reconnects,
+  * so neither a slow broker nor a lost connection delays the next readout.
+  *
+  * While the connection is lost, the samples stay in the ring. When the ring
+  * is full, the overflow policy decides which samples are lost:
+  *
+  *     DROP_OLDEST   The oldest sample in the ring is dropped
+  *     DROP_NEWEST   The new sample is dropped
+  *     COALESCE      New samples are merged into one pending sample, that is
+  *                   pushed as soon as there is room (latest value per channel)
+  *
+  * push(), retry(), setOverflow() and the statistics of the ring must only
+  * be called by the sampling thread.
+  *
+  * The latency of every sample is traced through the stages:
+  *
+  *     CONVERSION    First conversion started until the last one is done
+  *     CYCLE         Until the cycle is complete and the sample is queued
+  *     QUEUE         Time in the ring until the sample is encoded
+  *     BATCH         Time in the batch until the message is published
+  *     PUBLISH       Duration of the publish call (per message)
+  *     TOTAL         First conversion started until the message is published
+  */
+class Publisher {
+public:
+	enum Overflow { DROP_OLDEST = 0, DROP_NEWEST = 1, COALESCE = 2 };
+	enum Stage { STAGE_CONVERSION = 0, STAGE_CYCLE, STAGE_QUEUE, STAGE_BATCH, STAGE_PUBLISH, STAGE_TOTAL, STAGES };
+private:
+	SpscRing<Sample> _ring;
+	/** eventfd that wakes the publisher thread */
+	int _efd;
+	std::thread _thread;
+	std::mutex _mutex;
+	/** Settings to be applied by the publisher thread */
+	PublisherConfig _next;
+	bool _changed;
+	bool _stopping;
+
+	/** Members of the sampling thread */
+	Overflow _overflow;
+	/** Coalesced sample, that is waiting for room in the ring */
+	Sample _pending;
+	bool _has_pending;
+	long _pushed, _dropped, _coalesced, _truncated;
+	size_t _high_water;
+	/** Counts fields, that did not fit into a sample. Warns on the first one */
+	void truncated(uint32_t fields);
+
+	/** Members of the publisher thread */
+	PublisherConfig _config;
+	EventLoop _loop;
+	Timer _misc;
+	Mosquitto *_mosq;
+	/** Mosquitto socket that is currently watched by the event loop */
+	int _mosq_fd;
+	/** Connection lost and needs to be reconnected */
+	bool _lost;
+	/** Seconds until the next reconnect attempt and current backoff */
+	int _reconnect, _backoff;
+	std::string _topic;
+	/** Encoder for the published packets, only reallocated if a sample needs more room */
+	JsonEncoder *_encoder;
+	/** Most fields of a sample so far */
+	size_t _fields;
+	Batch _batch;
+	/** Samples taken from the ring, samples discarded at shutdown */
+	long _sent, _unsent;
+	/** Conversion start and encoding time of the samples of the next message [ns] */
+	struct Stamps {
+		long long started, encoded;
+	};
+	std::vector<Stamps> _stamps;
+	Histogram _latency[STAGES];
+
+	void run(void);
+	void wake(void);
+	/** Applies the settings of a reload */
+	void apply(const PublisherConfig &config);
+	/** Connects to the configured host. A failed attempt is retried by misc() */
+	void connect(void);
+	/** Creates the mosquitto instance if there is none, connects or reconnects
+	  * @returns true if connected */
+	bool open(void);
+	void disconnect(void);
+	/** Synchronizes the watched mosquitto socket and events with the connection */
+	void watch(void);
+	/** Called by the event loop when the mosquitto socket is ready */
+	void event(uint32_t events);
+	/** Called once per second. Handles keepalive, reconnects and the batch time */
+	void misc(void);
+	/** Encodes and sends the samples in the ring, as long as the connection is up */
+	void drain(void);
+	/** Encodes and sends one sample */
+	void send(const Sample &sample);
+	/** Reallocates the encoder, if a sample with the given fields would not fit */
+	void reserve(size_t fields);
+	/** Adds the fields of the sample, that is encoded at the given monotonic time */
+	void encodeFields(const Sample &sample, long long encoded);
+	void publishPacket(void);
+	/** Publishes the pending samples of the batch as one message */
+	void flushBatch(void);
+
+	Publisher(const Publisher&);
+	Publisher& operator=(const Publisher&);
+public:
+	/**
+	  * Creates the ring and starts the publisher thread, that connects to the
+	  * mosquitto host. Must be created after the signals are blocked, so that
+	  * the thread inherits the signal mask. Throws a const char* on error
+	  * @param capacity Minimum number of samples in the ring
+	  * @param overflow Overflow policy of the ring
+	  * @param config Initial settings
+	  */
+	Publisher(size_t capacity, Overflow overflow, const PublisherConfig &config);
+	/** Stops the publisher thread, if not yet stopped */
+	virtual ~Publisher();
+
+	/** Queues a sample for publishing. Never blocks and does not allocate memory */
+	void push(const Sample &sample);
+	/** Pushes the coalesced sample, if there is room in the ring again */
+	void retry(void);
+	/** Changes the overflow policy */
+	void setOverflow(Overflow overflow) { this->_overflow = overflow; }
+	Overflow overflow(void) const { return this->_overflow; }
+	/** Hands new settings to the publisher thread. Pending samples are
+	  * published with the running settings */
+	void configure(const PublisherConfig &config);
+	/** Publishes the samples in the ring, if connected, closes the connection
+	  * and joins the publisher thread. Nothing is published hereafter */
+	void stop(void);
+
+	/** @returns the number of samples in the ring */
+	size_t occupancy(void) const { return this->_ring.size(); }
+	/** @returns the maximum occupancy of the ring so far */
+	size_t highWater(void) const { return this->_high_water; }
+	size_t capacity(void) const { return this->_ring.capacity(); }
+	/** @returns the number of dropped samples */
+	long dropped(void) const { return this->_dropped; }
+	/** @returns the number of samples, that have been merged into others */
+	long coalesced(void) const { return this->_coalesced; }
+	/** @returns the batching statistics. Only valid after stop() */
+	const Batch& batch(void) const { return this->_batch; }
+	/** @returns the statistics of the ring. Only complete after stop() */
+	std::string toString(void) const;
+	/** @returns the latency histogram of the given stage. Only valid after stop() */
+	const Histogram& latency(Stage stage) const { return this->_latency[stage]; }
+	static const char* stageName(Stage stage);
+
+	/** Parses the name of an overflow policy (drop_oldest, drop_newest, coalesce)
+	  * @returns false if the name is unknown */
+	static bool parseOverflow(const std::string &name, Overflow &overflow);
+	static const char* overflowName(Overflow overflow);
+	/** @returns the lock of stdout, so that the lines of both threads do not interleave */
+	static std::mutex& console(void);
+};
+
+}
+
+
+#endif
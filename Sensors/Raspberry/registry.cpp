@@ -0,0 +1,256 @@
+/* =============================================================================
+ *
+ * Title:         Sensor registry
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Creates sensors by their type name from config sections
+ *
+ * =============================================================================
+ */
+
+#include <cstdlib>
+#include <thread>
+
+#include "registry.hpp"
+#include "sensors.hpp"
+#include "tca9548a.hpp"
+#include "filter.hpp"
+#include "scheduler.hpp"
+
+using namespace sensors;
+
+
+namespace meteo {
+
+constexpr const char* SensorRegistry::SECTION_PREFIX;
+
+/** Parses an integer in decimal or hexadecimal (0x..) notation */
+static bool parseInt(const std::string &value, int &result) {
+	if(value.empty()) return false;
+	char *endptr = NULL;
+	const long parsed = strtol(value.c_str(), &endptr, 0);
+	if(endptr == NULL || *endptr != '\0') return false;
+	result = (int)parsed;
+	return true;
+}
+
+int SensorSpec::getInt(const std::string &key, int defaultValue) const {
+	std::map<std::string, std::string>::const_iterator it = this->options.find(key);
+	if(it == this->options.end()) return defaultValue;
+	int result;
+	if(!parseInt(it->second, result)) return defaultValue;
+	return result;
+}
+
+/** Parses a float */
+static bool parseFloat(const std::string &value, float &result) {
+	if(value.empty()) return false;
+	char *endptr = NULL;
+	result = strtof(value.c_str(), &endptr);
+	return (endptr != NULL && *endptr == '\0');
+}
+
+float SensorSpec::getFloat(const std::string &key, float defaultValue) const {
+	std::map<std::string, std::string>::const_iterator it = this->options.find(key);
+	if(it == this->options.end()) return defaultValue;
+	float result;
+	if(!parseFloat(it->second, result)) return defaultValue;
+	return result;
+}
+
+
+template <class T>
+static Sensor* createSensor(const SensorSpec &spec, const std::string &bus) {
+	const int address = (spec.address < 0 ? T::DEVICE_ADDRESS : spec.address);
+	return new T(bus, address);
+}
+
+static Sensor* createBMP180(const SensorSpec &spec, const std::string &bus) {
+	const int address = (spec.address < 0 ? BMP180::DEVICE_ADDRESS : spec.address);
+	BMP180 *sensor = new BMP180(bus, address, spec.state.data(), spec.state.size());
+	sensor->setTemperatureReuse(spec.getInt("treuse", 1));
+	return sensor;
+}
+
+static Sensor* createTSL2561(const SensorSpec &spec, const std::string &bus) {
+	TSL2561 *sensor = (TSL2561*)createSensor<TSL2561>(spec, bus);
+	sensor->setAutogain(spec.getInt("autogain", 0) != 0);
+	if(!spec.state.empty()) sensor->restoreState(spec.state.data(), spec.state.size());
+	return sensor;
+}
+
+
+std::map<std::string, SensorRegistry::Factory>& SensorRegistry::factories(void) {
+	static std::map<std::string, Factory> factories;
+	if(factories.empty()) {
+		// Built-in sensors
+		factories["bmp180"] = createBMP180;
+		factories["htu21df"] = createSensor<HTU21DF>;
+		factories["mcp9808"] = createSensor<MCP9808>;
+		factories["tsl2561"] = createTSL2561;
+	}
+	return factories;
+}
+
+std::map<std::string, int>& SensorRegistry::addresses(void) {
+	static std::map<std::string, int> addresses;
+	if(addresses.empty()) {
+		addresses["bmp180"] = BMP180::DEVICE_ADDRESS;
+		addresses["htu21df"] = HTU21DF::DEVICE_ADDRESS;
+		addresses["mcp9808"] = MCP9808::DEVICE_ADDRESS;
+		addresses["tsl2561"] = TSL2561::DEVICE_ADDRESS;
+	}
+	return addresses;
+}
+
+void SensorRegistry::add(const std::string &type, Factory factory, int address) {
+	factories()[type] = factory;
+	if(address >= 0)
+		addresses()[type] = address;
+	else
+		addresses().erase(type);
+}
+
+int SensorRegistry::address(const SensorSpec &spec) {
+	if(spec.address >= 0) return spec.address;
+	std::map<std::string, int>::const_iterator it = addresses().find(spec.type);
+	if(it == addresses().end()) return -1;
+	return it->second;
+}
+
+bool SensorRegistry::contains(const std::string &type) {
+	return factories().find(type) != factories().end();
+}
+
+std::vector<std::string> SensorRegistry::types(void) {
+	std::vector<std::string> result;
+	std::map<std::string, Factory> &factories = SensorRegistry::factories();
+	for(std::map<std::string, Factory>::const_iterator it = factories.begin(); it != factories.end(); ++it)
+		result.push_back(it->first);
+	return result;
+}
+
+Sensor* SensorRegistry::create(const SensorSpec &spec, const std::string &bus) {
+	std::map<std::string, Factory>::const_iterator it = factories().find(spec.type);
+	if(it == factories().end()) throw "Unknown sensor type";
+
+	const std::string &device = (spec.bus.empty() ? bus : spec.bus);
+	TCA9548A *mux = NULL;
+	if(spec.mux >= 0) {
+		mux = TCA9548A::get(device, spec.mux);
+		if(mux == NULL) throw "Cannot open multiplexer";
+		if(mux->select(spec.channel) != 0) throw "Cannot select multiplexer channel";
+	}
+	Sensor *sensor = it->second(spec, device);
+	if(sensor == NULL) throw "Error creating sensor";
+	sensor->setPrefix(spec.prefix);
+	if(mux != NULL) sensor->setMux(mux, spec.channel);
+	try {
+		sensor->setFilter(Filter::create(sensor, spec.options));
+		// After the factory, so that it overrides a saved state
+		if(spec.options.find("precision") != spec.options.end() && sensor->setPrecision(spec.getInt("precision", 0)) != 0)
+			throw "Unsupported precision";
+		if(spec.options.find("alert") != spec.options.end()) {
+			if(sensor->alertChannel() == NULL) throw "Sensor has no alert output";
+			sensor->setAlertBand(spec.getFloat("alert_band", 0.0F));
+		}
+	} catch (const char*) {
+		delete sensor;
+		throw;
+	}
+	return sensor;
+}
+
+/** Creates the given sensors one after another */
+static void createSequence(const std::vector<SensorSpec> *specs, const std::vector<size_t> *indices, const std::string *bus, std::vector<SensorCreation> *result) {
+	for(std::vector<size_t>::const_iterator it = indices->begin(); it != indices->end(); ++it) {
+		SensorCreation &creation = (*result)[*it];
+		const long long start = monotonic_ns();
+		try {
+			creation.sensor = SensorRegistry::create((*specs)[*it], *bus);
+		} catch (const char* msg) {
+			creation.error = msg;
+		}
+		creation.time = monotonic_ns() - start;
+	}
+}
+
+void SensorRegistry::createAll(const std::vector<SensorSpec> &specs, const std::string &bus, std::vector<SensorCreation> &result) {
+	result.assign(specs.size(), SensorCreation());
+	factories();		// Fill the registry before the threads use it
+
+	// Every sensor gets its own sequence, except the multiplexed ones, that
+	// share one sequence per bus. The multiplexers are opened here, so that
+	// the threads only select channels
+	std::vector<std::vector<size_t> > sequences;
+	std::map<std::string, size_t> muxed;
+	for(size_t i = 0; i < specs.size(); i++) {
+		const SensorSpec &spec = specs[i];
+		if(spec.mux < 0) {
+			sequences.push_back(std::vector<size_t>(1, i));
+			continue;
+		}
+		const std::string device = (spec.bus.empty() ? bus : spec.bus);
+		if(TCA9548A::get(device, spec.mux) == NULL) {
+			result[i].error = "Cannot open multiplexer";
+			continue;
+		}
+		std::map<std::string, size_t>::const_iterator it = muxed.find(device);
+		if(it == muxed.end()) {
+			muxed[device] = sequences.size();
+			sequences.push_back(std::vector<size_t>(1, i));
+		} else
+			sequences[it->second].push_back(i);
+	}
+
+	std::vector<std::thread> threads;
+	for(size_t i = 0; i < sequences.size(); i++)
+		threads.push_back(std::thread(createSequence, &specs, &sequences[i], &bus, &result));
+	for(std::vector<std::thread>::iterator it = threads.begin(); it != threads.end(); ++it)
+		it->join();
+}
+
+void SensorRegistry::parse(Config &config, std::vector<SensorSpec> &specs) {
+	const std::string prefix(SECTION_PREFIX);
+	std::vector<ConfigSection*> sections = config.sections();
+	for(std::vector<ConfigSection*>::iterator it = sections.begin(); it != sections.end(); ++it) {
+		ConfigSection *section = *it;
+		const std::string name = section->name();
+		if(name.compare(0, prefix.size(), prefix) != 0) continue;
+
+		SensorSpec spec;
+		spec.name = name.substr(prefix.size());
+		spec.type = section->get("type", "");
+		if(spec.type.empty()) throw "Sensor section without type";
+		if(!contains(spec.type)) throw "Unknown sensor type";
+		spec.bus = section->get("i2c", "");
+		const std::string address = section->get("address", "");
+		if(!address.empty() && !parseInt(address, spec.address)) throw "Illegal sensor address";
+		spec.prefix = section->get("prefix", "");
+		spec.interval = section->getFloat("interval", 0.0F);
+		const std::string mux = section->get("mux", "");
+		const std::string channel = section->get("channel", "");
+		if(!mux.empty() && !parseInt(mux, spec.mux)) throw "Illegal multiplexer address";
+		if(!channel.empty()) {
+			if(!parseInt(channel, spec.channel) || spec.channel < 0 || spec.channel >= TCA9548A::CHANNELS)
+				throw "Illegal multiplexer channel";
+			if(spec.mux < 0) spec.mux = TCA9548A::DEVICE_ADDRESS;
+		} else if(spec.mux >= 0)
+			throw "Multiplexer without channel";
+
+		std::vector<std::string> keys = section->keys();
+		for(std::vector<std::string>::const_iterator key = keys.begin(); key != keys.end(); ++key)
+			spec.options[*key] = section->get(*key, "");
+		Filter::check(spec.options);
+		const std::string precision = section->get("precision", "");
+		int level;
+		if(!precision.empty() && (!parseInt(precision, level) || level < 0)) throw "Illegal precision";
+		float band;
+		if(!section->get("alert", "").empty() && (!parseFloat(section->get("alert_band", ""), band) || band <= 0.0F))
+			throw "Alert requires a positive alert_band";
+		specs.push_back(spec);
+	}
+}
+
+}
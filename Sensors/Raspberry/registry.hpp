@@ -0,0 +1,149 @@
+/* =============================================================================
+ *
+ * Title:         Sensor registry
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Creates sensors by their type name from config sections
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_REGISTRY_HPP
+#define _METEO_REGISTRY_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "sensor.hpp"
+#include "config.hpp"
+
+
+namespace meteo {
+
+/**
+  * Description of one sensor instance, usually read from a [sensor.NAME]
+  * section of the config file:
+  *
+  *     [sensor.rack1]
+  *     type = mcp9808
+  *     i2c = /dev/i2c-1
+  *     address = 0x19
+  *     prefix = rack1_
+  *     interval = 10
+  *     mux = 0x70
+  *     channel = 2
+  */
+struct SensorSpec {
+	/** Instance name (NAME of the section) */
+	std::string name;
+	/** Sensor type, e.g. "bmp180" */
+	std::string type;
+	/** I2C bus device or empty for the default bus */
+	std::string bus;
+	/** I2C address or a negative value for the default address of the type */
+	int address;
+	/** Prefix of the published channel names */
+	std::string prefix;
+	/** Readout interval in seconds or 0 for the default delay */
+	float interval;
+	/** I2C address of the TCA9548A multiplexer in front of the sensor or a negative value for none */
+	int mux;
+	/** Channel of the multiplexer */
+	int channel;
+	/** All further keys of the section for type-specific settings */
+	std::map<std::string, std::string> options;
+	/** Saved device state for a warm start (see Sensor::saveState()), empty for a cold start */
+	std::string state;
+
+	SensorSpec() : address(-1), interval(0.0F), mux(-1), channel(-1) {}
+
+	/** @returns the given option as integer or the default value */
+	int getInt(const std::string &key, int defaultValue) const;
+	/** @returns the given option as float or the default value */
+	float getFloat(const std::string &key, float defaultValue) const;
+};
+
+/** Result of the creation of one sensor, see SensorRegistry::createAll() */
+struct SensorCreation {
+	/** Created sensor or NULL on error */
+	sensors::Sensor *sensor;
+	/** Error message or NULL */
+	const char* error;
+	/** Time the creation and initialization took [ns] */
+	long long time;
+
+	SensorCreation() : sensor(NULL), error(NULL), time(0) {}
+};
+
+/**
+  * Registry of all sensor types. Every type is created by a factory
+  * function from a SensorSpec
+  */
+class SensorRegistry {
+public:
+	/** Creates a sensor on the given bus. Returns NULL on error */
+	typedef sensors::Sensor* (*Factory)(const SensorSpec &spec, const std::string &bus);
+private:
+	static std::map<std::string, Factory>& factories(void);
+	/** Default addresses of the types */
+	static std::map<std::string, int>& addresses(void);
+public:
+	/** Registers a sensor type. An existing type of the same name is replaced
+	  * @param type Type name
+	  * @param factory Factory of the type
+	  * @param address Default I2C address of the type or a negative value if unknown
+	  */
+	static void add(const std::string &type, Factory factory, int address = -1);
+
+	/** @returns the I2C address of the given spec, i.e. the default address of its type, if
+	  * the spec does not define one. A negative value if unknown */
+	static int address(const SensorSpec &spec);
+
+	/** @returns true if the given type is known */
+	static bool contains(const std::string &type);
+
+	/** @returns the names of all known types */
+	static std::vector<std::string> types(void);
+
+	/**
+	  * Creates the sensor described by the given spec. Throws a const char* on error.
+	  * If the sensor is behind a multiplexer, its channel is selected before the sensor
+	  * is initialized. The option "precision" sets the precision level, see Sensor::setPrecision().
+	  * With the option "alert" the threshold window of "alert_band" is set, see Sensor::armAlert().
+	  * The alert line itself is watched by the caller
+	  * @param spec Sensor description
+	  * @param bus Bus to use, if the spec does not define one
+	  */
+	static sensors::Sensor* create(const SensorSpec &spec, const std::string &bus);
+
+	/**
+	  * Creates the sensors of all given specs concurrently. Sensor initialization
+	  * is mostly waiting for resets and conversions, and the kernel serializes
+	  * the single transactions on a bus, so every sensor is initialized by its
+	  * own thread. Only sensors behind multiplexers are initialized one after
+	  * another per bus, because a multiplexer channel must stay selected
+	  * during the initialization.
+	  * Does not throw, the errors are reported per sensor
+	  * @param specs Sensor descriptions
+	  * @param bus Bus to use, if a spec does not define one
+	  * @param result Filled with the result of every spec, in the same order
+	  */
+	static void createAll(const std::vector<SensorSpec> &specs, const std::string &bus, std::vector<SensorCreation> &result);
+
+	/**
+	  * Reads all [sensor.NAME] sections of the given config. Throws a const char* on error
+	  * @param config Config to be read
+	  * @param specs The sensor descriptions are appended here
+	  */
+	static void parse(Config &config, std::vector<SensorSpec> &specs);
+
+	/** Prefix of the config sections, that describe sensors */
+	static constexpr const char* SECTION_PREFIX = (const char*)"sensor.";
+};
+
+}
+
+
+#endif
@@ -0,0 +1,120 @@
+/* =============================================================================
+ *
+ * Title:         Sample reporting
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Prints the readouts of a cycle and queues them as one
+ *                sample for the publisher, if they are news
+ *
+ * =============================================================================
+ */
+
+#include <iostream>
+#include <mutex>
+
+#include "report.hpp"
+#include "scheduler.hpp"
+
+using namespace sensors;
+
+
+namespace meteo {
+
+/** Prints the channels of the given sensor */
+static void printSensor(const Sensor *sensor, bool &first) {
+	const Channel *channels = sensor->channels();
+	for(size_t i = 0; i < sensor->channelCount(); i++) {
+		if(first) first = false;
+		else std::cout << ", ";
+		std::cout << sensor->prefix() << channels[i].name << " = " << sensor->reading(channels[i]);
+	}
+}
+
+/** Copies the channels of the given sensors and the conversion times of
+  * their readouts into the sample
+  * @param sensors Sensors read in this cycle
+  * @param stale Sensors that exceeded the budget together with the age of their values [s]
+  */
+static void recordSensors(const std::vector<Sensor*> &sensors, const std::vector<std::pair<Sensor*, double> > &stale, Sample &sample) {
+	// Only the channels of the sensors read in this cycle are published
+	for(std::vector<Sensor*>::const_iterator it = sensors.begin(); it != sensors.end(); ++it) {
+		const Channel *channels = (*it)->channels();
+		for(size_t i = 0; i < (*it)->channelCount(); i++)
+			sample.add((*it)->prefix(), channels[i].name, (*it)->reading(channels[i]));
+		const Snapshot snapshot = (*it)->snapshot();
+		sample.stamp(snapshot.started, snapshot.monotonic);
+	}
+	// Stale channels are marked by an additional CHANNEL_age field
+	for(std::vector<std::pair<Sensor*, double> >::const_iterator it = stale.begin(); it != stale.end(); ++it) {
+		const Channel *channels = it->first->channels();
+		for(size_t i = 0; i < it->first->channelCount(); i++) {
+			sample.add(it->first->prefix(), channels[i].name, it->first->reading(channels[i]));
+			sample.add(it->first->prefix(), channels[i].name, (float)it->second, "_age");
+		}
+	}
+}
+
+Reporter::Reporter(Publisher *publisher, bool quiet) {
+	this->_publisher = publisher;
+	this->_quiet = quiet;
+	this->_packets = 0;
+	this->_suppressed = 0;
+}
+
+void Reporter::setDeadband(const Sensor *sensor, Deadband *deadband) {
+	if(deadband == NULL) this->_deadbands.erase(sensor);
+	else this->_deadbands[sensor] = deadband;
+}
+
+Deadband* Reporter::deadband(const Sensor *sensor) const {
+	std::unordered_map<const Sensor*, Deadband*>::const_iterator it = this->_deadbands.find(sensor);
+	return (it == this->_deadbands.end() ? NULL : it->second);
+}
+
+bool Reporter::process(const std::vector<Sensor*> &sensors, const std::vector<std::pair<Sensor*, double> > &stale) {
+	if(!this->_quiet) {
+		std::lock_guard<std::mutex> lock(Publisher::console());
+		bool first = true;
+		for(std::vector<Sensor*>::const_iterator it = sensors.begin(); it != sensors.end(); ++it)
+			printSensor(*it, first);
+		for(std::vector<std::pair<Sensor*, double> >::const_iterator it = stale.begin(); it != stale.end(); ++it) {
+			printSensor(it->first, first);
+			std::cout << " (stale " << it->second << " s)";
+		}
+		std::cout << std::endl;
+	}
+
+	const long long now = monotonic_ns();
+	bool news = false;
+	for(std::vector<Sensor*>::const_iterator it = sensors.begin(); it != sensors.end() && !news; ++it) {
+		const Deadband *deadband = this->deadband(*it);
+		news = (deadband == NULL || deadband->changed(now));
+	}
+	// Stale readings are no news, unless the sensor reports every reading
+	for(std::vector<std::pair<Sensor*, double> >::const_iterator it = stale.begin(); it != stale.end() && !news; ++it) {
+		const Deadband *deadband = this->deadband(it->first);
+		news = (deadband == NULL || !deadband->active());
+	}
+	for(std::vector<Sensor*>::const_iterator it = sensors.begin(); it != sensors.end(); ++it) {
+		Deadband *deadband = this->deadband(*it);
+		if(deadband == NULL) continue;
+		if(news) deadband->published(now);
+		else deadband->suppressed();
+	}
+	if(!news) {
+		this->_suppressed++;
+		return false;
+	}
+	this->_packets++;
+
+	if(this->_publisher != NULL) {
+		Sample sample;
+		sample.clear(now, realtime_ns());
+		recordSensors(sensors, stale, sample);
+		this->_publisher->push(sample);
+	}
+	return true;
+}
+
+}
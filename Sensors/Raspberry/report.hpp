@@ -0,0 +1,77 @@
+/* =============================================================================
+ *
+ * Title:         Sample reporting
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Prints the readouts of a cycle and queues them as one
+ *                sample for the publisher, if they are news
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_REPORT_HPP
+#define _METEO_REPORT_HPP
+
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+#include "sensor.hpp"
+#include "deadband.hpp"
+#include "publisher.hpp"
+
+
+namespace meteo {
+
+/**
+  * Turns the readouts of a cycle into a sample. A sample is only published,
+  * if a reading moved out of its deadband or the heartbeat of a sensor
+  * expired (report by exception). Sensors that exceeded the cycle budget are
+  * published with their last good values and the age of those values.
+  * The sample is only queued for the publisher thread, so process() never
+  * waits for the network and does not allocate memory
+  */
+class Reporter {
+private:
+	/** Publisher of the samples or NULL */
+	Publisher *_publisher;
+	/** Deadbands of the sensors, not owned */
+	std::unordered_map<const sensors::Sensor*, Deadband*> _deadbands;
+	/** Do not print the readouts */
+	bool _quiet;
+	/** Published and suppressed packets */
+	long _packets, _suppressed;
+
+	Reporter(const Reporter&);
+	Reporter& operator=(const Reporter&);
+public:
+	/**
+	  * @param publisher Publisher of the samples, NULL if nothing is published
+	  * @param quiet Do not print the readouts
+	  */
+	Reporter(Publisher *publisher, bool quiet);
+
+	/** Sets the deadbands of the given sensor, NULL removes them. The deadbands are not owned */
+	void setDeadband(const sensors::Sensor *sensor, Deadband *deadband);
+	/** @returns the deadbands of the given sensor or NULL */
+	Deadband* deadband(const sensors::Sensor *sensor) const;
+
+	/**
+	  * Prints and publishes the values of the given sensors, that have been read
+	  * @param sensors Sensors read in this cycle
+	  * @param stale Sensors that exceeded the budget together with the age of their values [s]
+	  * @returns true if the sample is news and has been queued
+	  */
+	bool process(const std::vector<sensors::Sensor*> &sensors, const std::vector<std::pair<sensors::Sensor*, double> > &stale);
+
+	/** @returns the number of published packets */
+	long packets(void) const { return this->_packets; }
+	/** @returns the number of packets suppressed by the deadbands */
+	long suppressed(void) const { return this->_suppressed; }
+};
+
+}
+
+
+#endif
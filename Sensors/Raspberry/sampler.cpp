@@ -0,0 +1,385 @@
+/* =============================================================================
+ *
+ * Title:         Sensor sampler
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Parallel sampling of sensors with one worker thread per
+ *                I2C bus
+ *
+ * =============================================================================
+ */
+
+#include <algorithm>
+
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/eventfd.h>
+
+#include "sampler.hpp"
+#include "filter.hpp"
+#include "scheduler.hpp"
+#include "tca9548a.hpp"
+
+using sensors::Sensor;
+
+
+namespace meteo {
+
+static void sleep_us(long long micros) {
+	struct timespec ts;
+	ts.tv_sec = (time_t)(micros / 1000000LL);
+	ts.tv_nsec = (long)(micros % 1000000LL) * 1000L;
+	while(nanosleep(&ts, &ts) < 0);
+}
+
+/** Monotonic clock in microseconds */
+static inline long long monotonic_us(void) {
+	return monotonic_ns() / 1000LL;
+}
+
+/** Sensors behind a multiplexer are ordered by multiplexer and channel */
+static inline bool muxBefore(const Sensor *a, const Sensor *b) {
+	if(a->mux() != b->mux()) return a->mux() < b->mux();
+	return a->muxChannel() < b->muxChannel();
+}
+
+/** @returns true if the given sensor can be accessed without switching a multiplexer channel */
+static inline bool selected(const Sensor *sensor) {
+	return sensor->mux() == NULL || sensor->mux()->channel() == sensor->muxChannel();
+}
+
+void sampleSensors(const std::vector<SensorHealth*> &sensors, std::vector<Sensor*> &read, std::vector<Sensor*> &late, long long deadline) {
+	struct Pending {
+		SensorHealth *health;
+		long long ready;		// Monotonic time when collect() is due [us]
+		long long started;		// Monotonic time when the first conversion was started [ns]
+	};
+	// Reused by every cycle of this thread
+	static thread_local std::vector<Pending> pending;
+	static thread_local std::vector<SensorHealth*> order;
+	pending.clear();
+	
+	// Start the sensors grouped by multiplexer channel, so that every channel
+	// is selected once. Insertion sort keeps the configured order otherwise
+	order.assign(sensors.begin(), sensors.end());
+	for(size_t i = 1; i < order.size(); i++) {
+		SensorHealth *health = order[i];
+		size_t j = i;
+		for(; j > 0 && muxBefore(health->sensor(), order[j-1]->sensor()); j--)
+			order[j] = order[j-1];
+		order[j] = health;
+	}
+	
+	const long long now = monotonic_ns();
+	const long long limit = (deadline > 0 ? deadline / 1000LL : 0);		// [us]
+	for(std::vector<SensorHealth*>::const_iterator it = order.begin(); it != order.end(); ++it) {
+		SensorHealth *health = *it;
+		if(!health->allow(now)) continue;		// Breaker open
+		
+		Sensor *sensor = health->sensor();
+		if(limit > 0 && monotonic_us() >= limit) {
+			health->late(monotonic_ns());
+			late.push_back(sensor);
+			continue;
+		}
+		if(sensor->select() != 0) {
+			health->failure(monotonic_ns());
+			continue;
+		}
+		if(health->probing() && sensor->init() != 0) {
+			health->failure(monotonic_ns());
+			continue;
+		}
+		if(sensor->filter() != NULL) sensor->filter()->discard();
+		const long long started = monotonic_ns();
+		const long wait = sensor->start();
+		if(wait < 0)
+			health->failure(monotonic_ns());
+		else {
+			Pending entry = { health, monotonic_us() + wait, started };
+			pending.push_back(entry);
+		}
+	}
+	
+	while(pending.size() > 0) {
+		std::vector<Pending>::iterator next = pending.begin();
+		for(std::vector<Pending>::iterator it = pending.begin(); it != pending.end(); ++it)
+			if(it->ready < next->ready) next = it;
+		
+		if(limit > 0 && next->ready > limit) {
+			// Would not be ready in time. Abandon for this cycle
+			next->health->sensor()->abort();
+			next->health->late(monotonic_ns());
+			late.push_back(next->health->sensor());
+			pending.erase(next);
+			continue;
+		}
+		
+		const long long remaining = next->ready - monotonic_us();
+		if(remaining > 0) {
+			sleep_us(remaining);
+			continue;
+		}
+		
+		// Of the sensors, that are ready, prefer one on the selected multiplexer channel
+		if(!selected(next->health->sensor())) {
+			const long long current = monotonic_us();
+			for(std::vector<Pending>::iterator it = pending.begin(); it != pending.end(); ++it) {
+				if(it->ready <= current && selected(it->health->sensor())) {
+					next = it;
+					break;
+				}
+			}
+		}
+		
+		Sensor *sensor = next->health->sensor();
+		if(sensor->select() != 0) {
+			sensor->abort();
+			next->health->failure(monotonic_ns());
+			pending.erase(next);
+			continue;
+		}
+		long ret = sensor->collect();
+		if(ret == 0 && sensor->filter() != NULL && !sensor->filter()->add(sensor->readings())) {
+			// Burst oversampling: Start the next conversion of the burst right away
+			ret = sensor->start();
+			if(ret == 0) ret = 1;
+		}
+		if(ret > 0)
+			next->ready = monotonic_us() + ret;
+		else {
+			// The threshold window of an alert follows every readout
+			if(ret == 0 && sensor->alertBand() > 0.0F && sensor->armAlert() != 0) ret = -1;
+			if(ret < 0)
+				next->health->failure(monotonic_ns());
+			else {
+				sensor->publish(next->started, monotonic_ns(), realtime_ns());
+				next->health->success(monotonic_ns());
+				read.push_back(sensor);
+			}
+			pending.erase(next);
+		}
+	}
+}
+
+
+
+BusWorker::BusWorker(Sampler *sampler, const std::string &bus) {
+	this->_sampler = sampler;
+	this->_bus = bus;
+	this->_running = true;
+	this->_deadline = 0;
+	this->_thread = std::thread(&BusWorker::run, this);
+}
+
+BusWorker::~BusWorker() {
+	{
+		std::lock_guard<std::mutex> lock(this->_mutex);
+		this->_running = false;
+	}
+	this->_cond.notify_all();
+	this->_thread.join();
+}
+
+void BusWorker::reserve(size_t sensors) {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	this->_work.reserve(sensors);
+	this->_batch.reserve(sensors);
+	this->_current.reserve(sensors);
+	this->_read.reserve(sensors);
+	this->_late.reserve(sensors);
+}
+
+void BusWorker::dispatch(long long deadline) {
+	{
+		std::lock_guard<std::mutex> lock(this->_mutex);
+		this->_deadline = deadline;
+		this->_work.insert(this->_work.end(), this->_batch.begin(), this->_batch.end());
+	}
+	this->_batch.clear();
+	this->_cond.notify_all();
+}
+
+void BusWorker::run(void) {
+	std::unique_lock<std::mutex> lock(this->_mutex);
+	while(this->_running) {
+		if(this->_work.empty()) {
+			this->_cond.wait(lock);
+			continue;
+		}
+		
+		// Swapping keeps the capacity of both buffers
+		const long long deadline = this->_deadline;
+		this->_current.clear();
+		this->_current.swap(this->_work);
+		lock.unlock();
+		this->_read.clear();
+		this->_late.clear();
+		sampleSensors(this->_current, this->_read, this->_late, deadline);
+		this->_sampler->done(this->_read, this->_late);
+		lock.lock();
+	}
+}
+
+
+
+Sampler::Sampler() {
+	this->_threshold = 3;
+	this->_backoff = 5000L;
+	this->_backoff_max = 300000L;
+	this->_budget = 0;
+	this->_active = false;
+	this->_pending = 0;
+	this->_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(this->_efd < 0) throw "Error creating eventfd";
+}
+
+Sampler::~Sampler() {
+	this->stop();
+	for(std::map<Sensor*, SensorHealth*>::iterator it = this->_health.begin(); it != this->_health.end(); ++it)
+		delete it->second;
+	this->_health.clear();
+	::close(this->_efd);
+}
+
+void Sampler::stop(void) {
+	for(std::map<std::string, BusWorker*>::iterator it = this->_workers.begin(); it != this->_workers.end(); ++it)
+		delete it->second;
+	this->_workers.clear();
+	this->_assignment.clear();
+}
+
+void Sampler::setBreaker(int threshold, long backoff_ms, long backoff_max_ms) {
+	this->_threshold = threshold;
+	this->_backoff = backoff_ms;
+	this->_backoff_max = backoff_max_ms;
+}
+
+void Sampler::setBudget(long budget_ms) {
+	this->_budget = (budget_ms > 0 ? budget_ms * 1000000LL : 0);
+}
+
+SensorHealth* Sampler::health(Sensor *sensor) const {
+	std::map<Sensor*, SensorHealth*>::const_iterator it = this->_health.find(sensor);
+	if(it == this->_health.end()) return NULL;
+	return it->second;
+}
+
+void Sampler::add(Sensor *sensor, const std::string &bus) {
+	BusWorker *worker;
+	std::map<std::string, BusWorker*>::iterator it = this->_workers.find(bus);
+	if(it == this->_workers.end()) {
+		worker = new BusWorker(this, bus);
+		this->_workers[bus] = worker;
+	} else
+		worker = it->second;
+	this->_assignment[sensor] = worker;
+	if(this->_health.find(sensor) == this->_health.end())
+		this->_health[sensor] = new SensorHealth(sensor, this->_threshold, this->_backoff, this->_backoff_max);
+	
+	// Reserve all buffers, so that sampling does not allocate memory
+	size_t count = 0;
+	for(std::map<Sensor*, BusWorker*>::const_iterator it = this->_assignment.begin(); it != this->_assignment.end(); ++it)
+		if(it->second == worker) count++;
+	worker->reserve(count);
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	this->_cycle.reserve(this->_assignment.size());
+	this->_read.reserve(this->_assignment.size());
+	this->_late.reserve(this->_assignment.size());
+}
+
+bool Sampler::remove(Sensor *sensor) {
+	BusWorker *worker;
+	{
+		std::lock_guard<std::mutex> lock(this->_mutex);
+		if(this->_active) return false;
+		std::map<Sensor*, BusWorker*>::iterator it = this->_assignment.find(sensor);
+		if(it == this->_assignment.end()) return false;
+		worker = it->second;
+		this->_assignment.erase(it);
+		std::map<Sensor*, SensorHealth*>::iterator health = this->_health.find(sensor);
+		if(health != this->_health.end()) {
+			delete health->second;
+			this->_health.erase(health);
+		}
+	}
+	
+	// The worker of a bus without sensors is stopped and joined
+	for(std::map<Sensor*, BusWorker*>::const_iterator it = this->_assignment.begin(); it != this->_assignment.end(); ++it)
+		if(it->second == worker) return true;
+	this->_workers.erase(worker->bus());
+	delete worker;
+	return true;
+}
+
+bool Sampler::sample(const std::vector<Sensor*> &sensors) {
+	{
+		std::lock_guard<std::mutex> lock(this->_mutex);
+		if(this->_active) return false;
+	}
+	
+	// Stage the sensors of every bus
+	int workers = 0;
+	for(std::vector<Sensor*>::const_iterator it = sensors.begin(); it != sensors.end(); ++it) {
+		std::map<Sensor*, BusWorker*>::iterator worker = this->_assignment.find(*it);
+		if(worker == this->_assignment.end()) continue;
+		if(worker->second->_batch.empty()) workers++;
+		worker->second->_batch.push_back(this->_health.find(*it)->second);
+	}
+	
+	{
+		std::lock_guard<std::mutex> lock(this->_mutex);
+		this->_active = true;
+		this->_cycle = sensors;
+		this->_read.clear();
+		this->_late.clear();
+		this->_pending = workers;
+	}
+	
+	if(workers == 0) {
+		const uint64_t value = 1;
+		if(::write(this->_efd, &value, sizeof(value)) < 0) return false;
+	}
+	const long long deadline = (this->_budget > 0 ? monotonic_ns() + this->_budget : 0);
+	for(std::map<std::string, BusWorker*>::iterator it = this->_workers.begin(); it != this->_workers.end(); ++it)
+		if(!it->second->_batch.empty()) it->second->dispatch(deadline);
+	return true;
+}
+
+void Sampler::done(const std::vector<Sensor*> &read, const std::vector<Sensor*> &late) {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	this->_read.insert(this->_read.end(), read.begin(), read.end());
+	this->_late.insert(this->_late.end(), late.begin(), late.end());
+	if(--this->_pending == 0) {
+		const uint64_t value = 1;
+		if(::write(this->_efd, &value, sizeof(value)) < 0) return;
+	}
+}
+
+bool Sampler::busy(void) {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	return this->_active;
+}
+
+bool Sampler::collect(std::vector<Sensor*> &sensors, std::vector<Sensor*> &late) {
+	uint64_t value;
+	if(::read(this->_efd, &value, sizeof(value)) < 0) {}		// Only resets the eventfd
+	
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	if(!this->_active || this->_pending > 0) return false;
+	// Keep the order of the cycle
+	sensors.clear();
+	late.clear();
+	for(std::vector<Sensor*>::const_iterator it = this->_cycle.begin(); it != this->_cycle.end(); ++it) {
+		if(std::find(this->_read.begin(), this->_read.end(), *it) != this->_read.end())
+			sensors.push_back(*it);
+		else if(std::find(this->_late.begin(), this->_late.end(), *it) != this->_late.end())
+			late.push_back(*it);
+	}
+	this->_active = false;
+	return true;
+}
+
+}
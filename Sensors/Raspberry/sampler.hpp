@@ -0,0 +1,184 @@
+/* =============================================================================
+ *
+ * Title:         Sensor sampler
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Parallel sampling of sensors with one worker thread per
+ *                I2C bus
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_SAMPLER_HPP
+#define _METEO_SAMPLER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "sensor.hpp"
+#include "health.hpp"
+
+
+namespace meteo {
+
+/**
+  * Reads the given sensors with overlapping conversions: All conversions
+  * are started at once and every result is collected as soon as it is ready.
+  * This takes about as long as the slowest conversion instead of the sum of
+  * all of them. Blocks until all sensors are read.
+  * Failing sensors are not retried, instead their health is updated. Sensors
+  * with an open circuit breaker are skipped without touching the bus.
+  * Conversions that would complete after the deadline are abandoned.
+  * The threshold window of sensors with an alert is re-armed around every readout
+  * and every readout is published as snapshot of the sensor
+  * @param sensors Sensors to be read
+  * @param read Filled with the sensors that have been read successfully
+  * @param late Filled with the sensors that have been abandoned due to the deadline
+  * @param deadline Monotonic time in nanoseconds, when sampling must be done, or 0 for no deadline
+  */
+void sampleSensors(const std::vector<SensorHealth*> &sensors, std::vector<sensors::Sensor*> &read, std::vector<sensors::Sensor*> &late, long long deadline = 0);
+
+class Sampler;
+
+/**
+  * Worker thread that samples all sensors of one I2C bus
+  */
+class BusWorker {
+private:
+	Sampler *_sampler;
+	/** Bus device name */
+	std::string _bus;
+
+	std::thread _thread;
+	std::mutex _mutex;
+	std::condition_variable _cond;
+	/** Sensors to be read in the current cycle */
+	std::vector<SensorHealth*> _work;
+	/** Deadline of the current cycle */
+	long long _deadline;
+	volatile bool _running;
+
+	/** Sensors staged for the next cycle. Only used by the thread of the sampler */
+	std::vector<SensorHealth*> _batch;
+	/** Buffers of the worker thread, that are reused every cycle */
+	std::vector<SensorHealth*> _current;
+	std::vector<sensors::Sensor*> _read, _late;
+
+	void run(void);
+
+	friend class Sampler;
+public:
+	BusWorker(Sampler *sampler, const std::string &bus);
+	virtual ~BusWorker();
+
+	/** Reserves the buffers for the given number of sensors, so that
+	  * sampling does not allocate memory */
+	void reserve(size_t sensors);
+
+	/** Hands the staged sensors to the worker thread */
+	void dispatch(long long deadline = 0);
+
+	std::string bus(void) const { return this->_bus; }
+};
+
+/**
+  * Samples sensors in parallel with one BusWorker per I2C bus.
+  * sample() returns immediately. When all buses are done, fd() becomes
+  * readable and the result is fetched with collect()
+  */
+class Sampler {
+private:
+	/** Worker of each bus */
+	std::map<std::string, BusWorker*> _workers;
+	/** Worker of each sensor */
+	std::map<sensors::Sensor*, BusWorker*> _assignment;
+	/** Health of each sensor */
+	std::map<sensors::Sensor*, SensorHealth*> _health;
+	/** Circuit breaker settings for new sensors */
+	int _threshold;
+	long _backoff, _backoff_max;
+	/** Time budget of a cycle [ns], 0 if unlimited */
+	long long _budget;
+
+	/** eventfd that signals the completion of a cycle */
+	int _efd;
+	std::mutex _mutex;
+	/** A cycle has been started and not yet collected */
+	bool _active;
+	/** Number of workers that are not yet done with the current cycle */
+	int _pending;
+	/** Sensors of the current cycle */
+	std::vector<sensors::Sensor*> _cycle;
+	/** Sensors of the current cycle that have been read successfully */
+	std::vector<sensors::Sensor*> _read;
+	/** Sensors of the current cycle that exceeded the budget */
+	std::vector<sensors::Sensor*> _late;
+
+	/** Called by the workers when they are done */
+	void done(const std::vector<sensors::Sensor*> &read, const std::vector<sensors::Sensor*> &late);
+
+	friend class BusWorker;
+public:
+	/** Creates the sampler. Throws a const char* on error */
+	Sampler();
+	/** Stops and joins all worker threads */
+	virtual ~Sampler();
+
+	/** Sets the circuit breaker settings for sensors added hereafter
+	  * @param threshold Consecutive failures that open the breaker
+	  * @param backoff_ms Backoff after the breaker opened in milliseconds
+	  * @param backoff_max_ms Maximum backoff in milliseconds
+	  */
+	void setBreaker(int threshold, long backoff_ms, long backoff_max_ms);
+
+	/** Sets the time budget of a cycle. Conversions that would not complete
+	  * within the budget are abandoned for this cycle
+	  * @param budget_ms Budget in milliseconds or 0 for no limit
+	  */
+	void setBudget(long budget_ms);
+
+	/** Adds a sensor on the given bus. A worker thread is started for every new bus */
+	void add(sensors::Sensor *sensor, const std::string &bus);
+	
+	/** Removes a sensor and its health. The worker of its bus is stopped,
+	  * if no sensor is left on the bus. Must not be called while busy()
+	  * @returns false if the sensor has not been added or a cycle is running */
+	bool remove(sensors::Sensor *sensor);
+
+	/** @returns the health of the given sensor or NULL, if not added */
+	SensorHealth* health(sensors::Sensor *sensor) const;
+
+	/** Stops and joins all worker threads. No cycle can be started hereafter */
+	void stop(void);
+
+	/** Starts sampling the given sensors without waiting for them
+	  * @returns false if the previous cycle is not yet collected
+	  */
+	bool sample(const std::vector<sensors::Sensor*> &sensors);
+
+	/** @returns true if a cycle is running or not yet collected */
+	bool busy(void);
+
+	/** @returns the file descriptor, that becomes readable when a cycle is complete */
+	int fd(void) const { return this->_efd; }
+
+	/** Fetches the completed cycle
+	  * @param sensors Filled with the sensors that have been read successfully
+	  * @param late Filled with the sensors that exceeded the budget
+	  * @returns false if the cycle is not yet complete
+	  */
+	bool collect(std::vector<sensors::Sensor*> &sensors, std::vector<sensors::Sensor*> &late);
+
+	/** @returns the number of buses */
+	size_t buses(void) const { return this->_workers.size(); }
+};
+
+}
+
+
+#endif
@@ -0,0 +1,154 @@
+/* =============================================================================
+ *
+ * Title:         Periodic scheduler
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Drift-free periodic scheduling on absolute deadlines
+ *
+ * =============================================================================
+ */
+
+#include <algorithm>
+#include <functional>
+
+#include <time.h>
+#include <errno.h>
+
+#include "scheduler.hpp"
+
+#define NS_PER_SEC 1000000000LL
+
+
+namespace meteo {
+
+static long long to_ns(const struct timespec &ts) {
+	return (long long)ts.tv_sec * NS_PER_SEC + (long long)ts.tv_nsec;
+}
+
+long long monotonic_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return to_ns(ts);
+}
+
+long long realtime_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return to_ns(ts);
+}
+
+
+Scheduler::Scheduler(bool align) {
+	this->_align = align;
+	this->_cycles = 0;
+	this->_overruns = 0;
+	this->_skipped = 0;
+	this->_jitter = 0;
+	this->_jitter_max = 0;
+	this->_jitter_sum = 0;
+}
+
+Scheduler::~Scheduler() {}
+
+long long Scheduler::firstDeadline(long long now, long long period) const {
+	if(!this->_align) return now + period;
+	
+	// Next multiple of the period in wall-clock time, translated to the monotonic clock
+	const long long real = realtime_ns();
+	const long long next = (real / period + 1) * period;
+	return now + (next - real);
+}
+
+void Scheduler::add(int id, long period_ms) {
+	if(period_ms <= 0) period_ms = 1;
+	Job job;
+	job.id = id;
+	job.period = (long long)period_ms * 1000000LL;
+	job.deadline = this->firstDeadline(monotonic_ns(), job.period);
+	this->_jobs.push_back(job);
+	std::push_heap(this->_jobs.begin(), this->_jobs.end(), std::greater<Job>());
+}
+
+bool Scheduler::remove(int id) {
+	for(std::vector<Job>::iterator it = this->_jobs.begin(); it != this->_jobs.end(); ++it) {
+		if(it->id != id) continue;
+		this->_jobs.erase(it);
+		std::make_heap(this->_jobs.begin(), this->_jobs.end(), std::greater<Job>());
+		return true;
+	}
+	return false;
+}
+
+bool Scheduler::setPeriod(int id, long period_ms) {
+	if(period_ms <= 0) period_ms = 1;
+	for(std::vector<Job>::iterator it = this->_jobs.begin(); it != this->_jobs.end(); ++it) {
+		if(it->id != id) continue;
+		it->period = (long long)period_ms * 1000000LL;
+		it->deadline = this->firstDeadline(monotonic_ns(), it->period);
+		std::make_heap(this->_jobs.begin(), this->_jobs.end(), std::greater<Job>());
+		return true;
+	}
+	return false;
+}
+
+long long Scheduler::deadline(void) const {
+	if(this->_jobs.empty()) return -1;
+	return this->_jobs.front().deadline;
+}
+
+int Scheduler::wait(std::vector<int> &due) {
+	due.clear();
+	if(this->_jobs.empty()) return -1;
+	
+	const long long deadline = this->_jobs.front().deadline;
+	struct timespec ts;
+	ts.tv_sec = (time_t)(deadline / NS_PER_SEC);
+	ts.tv_nsec = (long)(deadline % NS_PER_SEC);
+	const int ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	if(ret == EINTR) return -1;
+	
+	this->due(due);
+	return 0;
+}
+
+int Scheduler::due(std::vector<int> &due) {
+	due.clear();
+	if(this->_jobs.empty()) return 0;
+	
+	const long long now = monotonic_ns();
+	const long long deadline = this->_jobs.front().deadline;
+	if(deadline > now) return 0;
+	
+	this->_jitter = now - deadline;
+	if(this->_jitter > this->_jitter_max) this->_jitter_max = this->_jitter;
+	this->_jitter_sum += this->_jitter;
+	this->_cycles++;
+	
+	// Pop all jobs that are due and put them back with their next deadline
+	while(!this->_jobs.empty() && this->_jobs.front().deadline <= now) {
+		std::pop_heap(this->_jobs.begin(), this->_jobs.end(), std::greater<Job>());
+		Job &job = this->_jobs.back();
+		due.push_back(job.id);
+		
+		job.deadline += job.period;
+		if(job.deadline <= now) {
+			// The job is late by more than one period. Skip the missed
+			// deadlines instead of catching up, so that the grid stays aligned
+			this->_overruns++;
+			const long long missed = (now - job.deadline) / job.period + 1;
+			this->_skipped += (long)missed;
+			job.deadline += missed * job.period;
+		}
+		std::push_heap(this->_jobs.begin(), this->_jobs.end(), std::greater<Job>());
+	}
+	
+	return (int)due.size();
+}
+
+double Scheduler::jitterMean(void) const {
+	if(this->_cycles == 0) return 0.0;
+	return (this->_jitter_sum / this->_cycles) / 1e6;
+}
+
+}
@@ -0,0 +1,118 @@
+/* =============================================================================
+ *
+ * Title:         Periodic scheduler
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Drift-free periodic scheduling on absolute deadlines
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_SCHEDULER_HPP
+#define _METEO_SCHEDULER_HPP
+
+#include <vector>
+
+namespace meteo {
+
+/** Current CLOCK_MONOTONIC time in nanoseconds */
+long long monotonic_ns(void);
+
+/** Current CLOCK_REALTIME time in nanoseconds */
+long long realtime_ns(void);
+
+/**
+  * Scheduler for periodic jobs based on absolute monotonic deadlines.
+  * Every job (e.g. a sensor) has its own period and its deadlines are
+  * multiples of it, so the time spent for reading and publishing does not
+  * accumulate as drift. The jobs are kept in a min-heap ordered by their
+  * next deadline. Optionally the deadlines are aligned to multiples of the
+  * period in wall-clock time, so that samples of different nodes line up.
+  */
+class Scheduler {
+private:
+	struct Job {
+		/** Next deadline (CLOCK_MONOTONIC) in nanoseconds */
+		long long deadline;
+		/** Period in nanoseconds */
+		long long period;
+		/** Caller-defined identifier */
+		int id;
+		
+		bool operator>(const Job &job) const { return this->deadline > job.deadline; }
+	};
+	
+	/** Min-heap of all jobs */
+	std::vector<Job> _jobs;
+	/** Align deadlines to the wall-clock */
+	bool _align;
+	
+	/** Number of wakeups */
+	long _cycles;
+	/** Number of times a job was late by more than its period */
+	long _overruns;
+	/** Number of deadlines skipped due to overruns */
+	long _skipped;
+	/** Wakeup jitter of the last cycle, maximum jitter and sum of all jitters [ns] */
+	long long _jitter, _jitter_max, _jitter_sum;
+	
+	/** Computes the first deadline after the given monotonic time */
+	long long firstDeadline(long long now, long long period) const;
+public:
+	/**
+	  * @param align If true, deadlines are aligned to multiples of their period in wall-clock time
+	  */
+	Scheduler(bool align = false);
+	virtual ~Scheduler();
+	
+	/**
+	  * Adds a periodic job. Its first deadline is one period from now
+	  * @param id Identifier that is returned by wait() when the job is due
+	  * @param period_ms Period in milliseconds
+	  */
+	void add(int id, long period_ms);
+	
+	/** Removes the given job
+	  * @returns false if there is no such job */
+	bool remove(int id);
+	
+	/** Changes the period of the given job. Its next deadline is one period from now
+	  * @returns false if there is no such job */
+	bool setPeriod(int id, long period_ms);
+	
+	/**
+	  * Sleeps until the next deadline and returns the jobs that are due.
+	  * A job that is late by more than its period is counted as overrun and
+	  * continues with its next deadline in the future
+	  * @param due Filled with the identifiers of all due jobs
+	  * @returns 0 on success, -1 if the sleep has been interrupted or there are no jobs
+	  */
+	int wait(std::vector<int> &due);
+	
+	/**
+	  * Returns the jobs that are due now without sleeping. This is meant for
+	  * event loops that wait for deadline() themselves (e.g. with a timerfd)
+	  * @param due Filled with the identifiers of all due jobs
+	  * @returns number of due jobs
+	  */
+	int due(std::vector<int> &due);
+	
+	/** @returns the next deadline (CLOCK_MONOTONIC) in nanoseconds or -1 if there are no jobs */
+	long long deadline(void) const;
+	
+	long cycles(void) const { return this->_cycles; }
+	long overruns(void) const { return this->_overruns; }
+	long skipped(void) const { return this->_skipped; }
+	/** @returns wakeup jitter of the last cycle in milliseconds */
+	double jitter(void) const { return this->_jitter / 1e6; }
+	/** @returns maximum wakeup jitter in milliseconds */
+	double jitterMax(void) const { return this->_jitter_max / 1e6; }
+	/** @returns mean wakeup jitter in milliseconds */
+	double jitterMean(void) const;
+};
+
+}
+
+
+#endif
@@ -12,7 +12,11 @@
 
 #include <string>
 
+#include <string.h>
+
 #include "sensor.hpp"
+#include "tca9548a.hpp"
+#include "filter.hpp"
 
 namespace sensors {
 
@@ -20,6 +24,11 @@ Sensor::Sensor(const char* i2c_device, int address) {
 	this->_device = std::string(i2c_device);
 	this->_address = address;
 	this->_error = false;
+	this->_mux = NULL;
+	this->_muxChannel = -1;
+	this->_filter = NULL;
+	this->_filtered = NULL;
+	this->_alertBand = 0.0F;
 }
 
 
@@ -27,11 +36,16 @@ Sensor::Sensor(const std::string i2c_device, int address) {
 	this->_device = std::string(i2c_device);
 	this->_address = address;
 	this->_error = false;
+	this->_mux = NULL;
+	this->_muxChannel = -1;
+	this->_filter = NULL;
+	this->_filtered = NULL;
+	this->_alertBand = 0.0F;
 }
 
 
 Sensor::~Sensor() {
-	
+	delete this->_filter;
 }
 
 bool Sensor::isError(void) {
@@ -40,6 +54,82 @@ bool Sensor::isError(void) {
 	return result;
 }
 
+long Sensor::start(void) { return 0; }
+
+long Sensor::collect(void) {
+	const int ret = this->read();
+	if(ret > 0) return -ret;
+	return ret;
+}
+
+void Sensor::abort(void) {}
+
+size_t Sensor::saveState(void*, size_t) const { return 0; }
+
+int Sensor::restoreState(const void*, size_t) { return 0; }
+
+int Sensor::setPrecision(int level) { return (level == 0 ? 0 : -1); }
+
+int Sensor::precision(void) const { return 0; }
+
+int Sensor::precisionLevels(void) const { return 1; }
+
+std::string Sensor::precisionName(int level) const { return (level == 0 ? "default" : ""); }
+
+long Sensor::conversionTime(void) const { return 0; }
+
+const Channel* Sensor::alertChannel(void) const { return NULL; }
+
+int Sensor::armAlert(void) { return -1; }
+
+int Sensor::disarmAlert(void) { return 0; }
+
+void Sensor::publish(long long started, long long monotonic, long long realtime) {
+	Snapshot snapshot;
+	const Channel *channels = this->channels();
+	const size_t count = this->channelCount();
+	memset(snapshot.values, 0, sizeof(snapshot.values));
+	for(size_t i = 0; i < count; i++)
+		if(channels[i].index < Snapshot::MAX_CHANNELS) snapshot.values[channels[i].index] = this->reading(channels[i]);
+	snapshot.channels = (uint32_t)(count < Snapshot::MAX_CHANNELS ? count : Snapshot::MAX_CHANNELS);
+	snapshot.version = this->_snapshot.version() + 1;
+	snapshot.monotonic = monotonic;
+	snapshot.realtime = realtime;
+	snapshot.started = started;
+	this->_snapshot.store(snapshot);
+}
+
+void Sensor::setFilter(Filter *filter) {
+	if(filter != this->_filter) delete this->_filter;
+	this->_filter = filter;
+	this->_filtered = (filter == NULL ? NULL : filter->values());
+}
+
+int Sensor::select(void) {
+	if(this->_mux == NULL) return 0;
+	return this->_mux->select(this->_muxChannel);
+}
+
+std::map<std::string,float> Sensor::values(void) const {
+	std::map<std::string,float> ret;
+	const Channel *channels = this->channels();
+	for(size_t i = 0; i < this->channelCount(); i++)
+		ret[this->_prefix + channels[i].name] = this->reading(channels[i]);
+	return ret;
+}
+
+std::string Sensor::toString(void) const {
+	std::stringstream ss;
+	
+	const Channel *channels = this->channels();
+	for(size_t i = 0; i < this->channelCount(); i++) {
+		if(i > 0) ss << ", ";
+		ss << this->_prefix << channels[i].name << " = " << this->reading(channels[i]);
+	}
+	
+	return ss.str();
+}
+
 std::string Sensor::device() { return this->_device; }
 int Sensor::address() { return this->_address; }
 
@@ -21,9 +21,58 @@
 #include <cstdlib>
 #include <unistd.h>
 
+#include "seqlock.hpp"
+
 
 namespace sensors {
 
+class TCA9548A;
+class Filter;
+
+
+/** Physical quantity of a channel */
+enum ChannelType {
+	CHANNEL_TEMPERATURE = 0,
+	CHANNEL_PRESSURE,
+	CHANNEL_ALTITUDE,
+	CHANNEL_HUMIDITY,
+	CHANNEL_LIGHT,
+};
+
+/**
+  * Static descriptor of a sensor channel. Every sensor publishes a table of
+  * those once, the readings themselves are kept in a contiguous float array
+  */
+struct Channel {
+	/** Channel name, as it is published (e.g. "t") */
+	const char* name;
+	/** Unit of the readings (e.g. "C") */
+	const char* unit;
+	/** Physical quantity */
+	ChannelType type;
+	/** Index of the channel in Sensor::readings() */
+	size_t index;
+};
+
+
+/**
+  * Versioned copy of the last readout of a sensor, see Sensor::snapshot()
+  */
+struct Snapshot {
+	/** Maximum number of channels of a sensor */
+	static const size_t MAX_CHANNELS = 8;
+	/** Readings at Channel::index, filtered if the sensor has a filter */
+	float values[MAX_CHANNELS];
+	/** Number of valid values */
+	uint32_t channels;
+	/** Number of published readouts, 0 if the sensor has not been read yet */
+	uint32_t version;
+	/** CLOCK_MONOTONIC and CLOCK_REALTIME time of the readout [ns] */
+	long long monotonic, realtime;
+	/** CLOCK_MONOTONIC time, when the conversion of the readout was started [ns] */
+	long long started;
+};
+
 
 /**
   * Abstract superclass for all Sensors
@@ -38,6 +87,25 @@ protected:
 	
 	/** Error flag */
 	bool _error;
+	
+	/** Prefix of the published channel names */
+	std::string _prefix;
+	
+	/** Multiplexer in front of the sensor or NULL */
+	TCA9548A *_mux;
+	/** Channel of the multiplexer */
+	int _muxChannel;
+	
+	/** Filter of the readings or NULL */
+	Filter *_filter;
+	/** Filtered readings or NULL, if there is no filter */
+	const float *_filtered;
+	
+	/** Half width of the threshold window of the alert, 0 if disabled */
+	float _alertBand;
+	
+	/** Last published readout */
+	SeqLock<Snapshot> _snapshot;
 public:
 	/** Initialize sensor */
 	Sensor(const char* i2c_device, int address);
@@ -50,34 +118,134 @@ public:
 	/** @returns the I2C-address for this sensor */
 	int address(void);
 	
+	/** @returns the prefix of the published channel names (default: none) */
+	const char* prefix(void) const { return this->_prefix.c_str(); }
+	/** Sets the prefix of the published channel names, e.g. to distinguish
+	  * multiple instances of the same type */
+	void setPrefix(const std::string &prefix) { this->_prefix = prefix; }
+	
+	/** Puts the sensor behind the given channel of a multiplexer. NULL removes the multiplexer */
+	void setMux(TCA9548A *mux, int channel) { this->_mux = mux; this->_muxChannel = channel; }
+	/** @returns the multiplexer in front of the sensor or NULL */
+	TCA9548A* mux(void) const { return this->_mux; }
+	/** @returns the multiplexer channel of the sensor, -1 if there is no multiplexer */
+	int muxChannel(void) const { return (this->_mux == NULL ? -1 : this->_muxChannel); }
+	/** Sets the filter of the readings. The sensor takes ownership. NULL removes the filter */
+	void setFilter(Filter *filter);
+	/** @returns the filter of the readings or NULL */
+	Filter* filter(void) const { return this->_filter; }
+	
+	/** Selects the multiplexer channel of the sensor. Must be called before
+	  * every bus access, unless the sensor is the only one on its bus
+	  * @returns 0 on success (also without multiplexer), a non-zero value on error */
+	int select(void);
+	
 	/** Reads the sensor
 	  * @returns 0 on success, a non-zero value on error
 	  */
 	virtual int read(void) = 0;
+	
+	/** Starts a conversion without waiting for it to complete.
+	  * The default implementation does nothing and leaves the work to collect()
+	  * @returns the time in microseconds until collect() can be called, or a negative value on error
+	  */
+	virtual long start(void);
+	
+	/** Collects the result of the conversion started with start().
+	  * If the sensor requires a further conversion, it is started and the
+	  * time until the next call to collect() is returned.
+	  * The default implementation performs a blocking read()
+	  * @returns 0 on success, the time in microseconds until the next collect() call or a negative value on error
+	  */
+	virtual long collect(void);
+	
+	/** Abandons the conversion started with start(), e.g. when it takes too long.
+	  * The default implementation does nothing
+	  */
+	virtual void abort(void);
 
-	/** Get a values map from the sensor */
-	virtual std::map<std::string,float> values(void) const = 0;
-	
-	std::string toString(void) const {
-		std::stringstream ss;
-		
-		std::map<std::string,float> values = this->values();
-		bool first = true;
-		for(std::map<std::string,float>::const_iterator it = values.begin(); it != values.end(); ++it) {
-			if(first) first = false;
-			else ss << ", ";
-			ss << it->first << " = " << it->second;
-		}
-		
-		return ss.str();
-	}
-#if 0
+	/** @returns the number of channels of this sensor */
+	virtual size_t channelCount(void) const = 0;
+	/** @returns the static descriptor table of the channels, channelCount() entries */
+	virtual const Channel* channels(void) const = 0;
+	/** @returns the last readings. The reading of a channel is at Channel::index.
+	  * Reading them does not allocate memory */
+	virtual const float* readings(void) const = 0;
+	
+	/** @returns the last reading of the given channel, filtered if the sensor has a filter */
+	float reading(const Channel &channel) const { return (this->_filtered != NULL ? this->_filtered : this->readings())[channel.index]; }
+	
 	/**
-	  * (Re)Initialize the device
+	  * Publishes the current readings as snapshot. Only the thread, that
+	  * reads the sensor, may call this. It never waits for the readers
+	  * @param started CLOCK_MONOTONIC time, when the conversion was started [ns]
+	  * @param monotonic CLOCK_MONOTONIC time of the readout [ns]
+	  * @param realtime CLOCK_REALTIME time of the readout [ns]
+	  */
+	void publish(long long started, long long monotonic, long long realtime);
+	/** @returns a consistent copy of the last published readout. Safe to call
+	  * from any number of threads while the sensor is read, without locks */
+	Snapshot snapshot(void) const { return this->_snapshot.load(); }
+	
+	/** Get a values map from the sensor.
+	  * Compatibility function built on channels() and readings(). It allocates
+	  * a new map on every call, so prefer channels() and readings() */
+	virtual std::map<std::string,float> values(void) const;
+	
+	std::string toString(void) const;
+	/**
+	  * (Re)Initialize the device. A previously opened device is closed first
 	  * @returns 0 on success, a non-zero value on error
 	*/
 	virtual int init(void) = 0;
-#endif
+	
+	/**
+	  * Saves the device state, that is expensive to acquire (e.g. calibration data),
+	  * for a warm start with restoreState(). The default implementation saves nothing
+	  * @returns the size of the state, 0 if there is none or if it does not fit into the buffer
+	  */
+	virtual size_t saveState(void *buffer, size_t size) const;
+	/**
+	  * Applies a state saved with saveState(), e.g. by a previous run. The state is
+	  * validated against the device and ignored, if it does not match.
+	  * The default implementation does nothing
+	  * @returns 0 on success, a non-zero value on error
+	  */
+	virtual int restoreState(const void *state, size_t size);
+	
+	/**
+	  * Sets the precision of the conversions. Level 0 is the fastest setting,
+	  * precisionLevels()-1 the most precise one. The level is kept across init().
+	  * The default implementation only supports level 0
+	  * @returns 0 on success, a non-zero value if the level is not supported or on error
+	  */
+	virtual int setPrecision(int level);
+	/** @returns the current precision level (default: 0) */
+	virtual int precision(void) const;
+	/** @returns the number of precision levels (default: 1, i.e. not adjustable) */
+	virtual int precisionLevels(void) const;
+	/** @returns a short description of the given precision level, e.g. "oss=3" */
+	virtual std::string precisionName(int level) const;
+	/** @returns the worst-case conversion time of one reading at the current precision in microseconds, 0 if unknown */
+	virtual long conversionTime(void) const;
+	
+	/** @returns the channel, that is watched by the threshold alert of the device, or NULL if the device has none (default) */
+	virtual const Channel* alertChannel(void) const;
+	/** Sets the half width of the threshold window in units of alertChannel(). 0 disables the alert */
+	void setAlertBand(float band) { this->_alertBand = band; }
+	/** @returns the half width of the threshold window, 0 if the alert is disabled */
+	float alertBand(void) const { return this->_alertBand; }
+	/**
+	  * Programs the threshold window of the device to the last raw reading of
+	  * alertChannel() +/- alertBand() and enables the alert output. The device
+	  * then asserts its alert line, when the reading leaves the window.
+	  * The default implementation returns an error
+	  * @returns 0 on success, a non-zero value on error
+	  */
+	virtual int armAlert(void);
+	/** Disables the alert output. The default implementation does nothing
+	  * @returns 0 on success, a non-zero value on error */
+	virtual int disarmAlert(void);
 	
 	/**
 	  * Get the error flag and sets it to false
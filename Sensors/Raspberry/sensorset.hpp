@@ -0,0 +1,208 @@
+/* =============================================================================
+ *
+ * Title:         Static sensor set
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Compile-time set of sensors without virtual dispatch
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_SENSORSET_HPP
+#define _METEO_SENSORSET_HPP
+
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+#include <time.h>
+
+#include "sensor.hpp"
+#include "encoder.hpp"
+#include "scheduler.hpp"
+
+
+namespace meteo {
+
+/** Sum of the channels of all given sensor types */
+template <class... Sensors> struct ChannelCount;
+template <> struct ChannelCount<> {
+	static constexpr size_t value = 0;
+};
+template <class T, class... Sensors> struct ChannelCount<T, Sensors...> {
+	static constexpr size_t value = (size_t)T::CHANNELS + ChannelCount<Sensors...>::value;
+};
+
+
+/** true if T overrides Sensor::collect(), an inherited one has the type long (Sensor::*)() */
+template <class T> struct OverridesCollect {
+	static constexpr bool value = std::is_same<decltype(&T::collect), long (T::*)(void)>::value;
+};
+
+
+/**
+  * Fixed set of sensors, that is known at compile time, e.g.
+  *
+  *     SensorSet<BMP180, HTU21DF> sensors("/dev/i2c-1");
+  *
+  * The sensors are held by value and all calls are qualified with the
+  * concrete type, so reading, encoding and printing does not need virtual
+  * calls and can be inlined completely. The channel tables of the sensors
+  * are constexpr. This is meant for dedicated builds with a fixed sensor
+  * configuration, the generic program uses vector<Sensor*>
+  */
+template <class... Sensors>
+class SensorSet {
+public:
+	/** Number of sensors */
+	static constexpr size_t SIZE = sizeof...(Sensors);
+	/** Total number of channels */
+	static constexpr size_t CHANNELS = ChannelCount<Sensors...>::value;
+
+	/** Type of the I-th sensor */
+	template <size_t I> using Type = typename std::tuple_element<I, std::tuple<Sensors...> >::type;
+
+	static_assert(SIZE > 0, "A sensor set needs at least one sensor");
+private:
+	std::tuple<Sensors...> _sensors;
+	/** Sensors, whose last readout succeeded */
+	bool _valid[SIZE];
+
+	/** Repeats the bus argument once for every sensor type */
+	template <class T> static const std::string& bus(const std::string &bus) { return bus; }
+
+	static inline long long monotonic_us(void) { return monotonic_ns() / 1000LL; }
+
+	// Every operation recurses over the sensor index I at compile time
+
+	template <size_t I> typename std::enable_if<(I == SIZE), int>::type readFrom(void) { return 0; }
+	template <size_t I> typename std::enable_if<(I < SIZE), int>::type readFrom(void) {
+		typedef Type<I> T;
+		T &sensor = std::get<I>(this->_sensors);
+		const int failed = (sensor.T::read() != 0 ? 1 : 0);
+		this->_valid[I] = (failed == 0);
+		return failed + this->readFrom<I+1>();
+	}
+
+	template <size_t I> typename std::enable_if<(I == SIZE), int>::type startFrom(long long*) { return 0; }
+	template <size_t I> typename std::enable_if<(I < SIZE), int>::type startFrom(long long *ready) {
+		typedef Type<I> T;
+		T &sensor = std::get<I>(this->_sensors);
+		const long wait = sensor.T::start();
+		int failed = 0;
+		this->_valid[I] = false;
+		if(wait < 0) {
+			ready[I] = -1;
+			failed = 1;
+		} else
+			ready[I] = monotonic_us() + wait;
+		return failed + this->startFrom<I+1>(ready);
+	}
+
+	template <size_t I> typename std::enable_if<(I == SIZE), int>::type collectAt(size_t, long long*) { return 0; }
+	template <size_t I> typename std::enable_if<(I < SIZE), int>::type collectAt(size_t index, long long *ready) {
+		if(index != I) return this->collectAt<I+1>(index, ready);
+		typedef Type<I> T;
+		T &sensor = std::get<I>(this->_sensors);
+		const long ret = collectOne(sensor);
+		if(ret > 0) {
+			ready[I] = monotonic_us() + ret;
+			return 0;
+		}
+		ready[I] = -1;
+		this->_valid[I] = (ret == 0);
+		return (ret < 0 ? 1 : 0);
+	}
+
+	// Sensors without their own collect() are read directly, the inherited
+	// Sensor::collect() would reach read() through the vtable
+	template <class T> static typename std::enable_if<OverridesCollect<T>::value, long>::type collectOne(T &sensor) {
+		return sensor.T::collect();
+	}
+	template <class T> static typename std::enable_if<!OverridesCollect<T>::value, long>::type collectOne(T &sensor) {
+		const int ret = sensor.T::read();
+		return (ret > 0 ? -ret : ret);
+	}
+
+	template <size_t I> typename std::enable_if<(I == SIZE)>::type encodeFrom(JsonEncoder&) const {}
+	template <size_t I> typename std::enable_if<(I < SIZE)>::type encodeFrom(JsonEncoder &encoder) const {
+		typedef Type<I> T;
+		const T &sensor = std::get<I>(this->_sensors);
+		const float *readings = sensor.T::readings();
+		for(size_t i = 0; i < (size_t)T::CHANNELS && this->_valid[I]; i++)
+			encoder.field(sensor.prefix(), T::CHANNEL_TABLE[i].name, readings[T::CHANNEL_TABLE[i].index]);
+		this->encodeFrom<I+1>(encoder);
+	}
+
+	template <size_t I> typename std::enable_if<(I == SIZE)>::type printFrom(std::ostream&, bool) const {}
+	template <size_t I> typename std::enable_if<(I < SIZE)>::type printFrom(std::ostream &out, bool first) const {
+		typedef Type<I> T;
+		const T &sensor = std::get<I>(this->_sensors);
+		const float *readings = sensor.T::readings();
+		for(size_t i = 0; i < (size_t)T::CHANNELS && this->_valid[I]; i++) {
+			if(first) first = false;
+			else out << ", ";
+			out << sensor.prefix() << T::CHANNEL_TABLE[i].name << " = " << readings[T::CHANNEL_TABLE[i].index];
+		}
+		this->printFrom<I+1>(out, first);
+	}
+public:
+	/** Creates all sensors on the given bus with their default addresses */
+	explicit SensorSet(const std::string &i2c) : _sensors(bus<Sensors>(i2c)...) {
+		for(size_t i = 0; i < SIZE; i++) this->_valid[i] = false;
+	}
+
+	/** @returns the I-th sensor */
+	template <size_t I> Type<I>& get(void) { return std::get<I>(this->_sensors); }
+	template <size_t I> const Type<I>& get(void) const { return std::get<I>(this->_sensors); }
+
+	/** Reads all sensors one after another
+	  * @returns the number of sensors, that failed */
+	int read(void) { return this->readFrom<0>(); }
+
+	/** Reads all sensors with overlapping conversions, like sampleSensors()
+	  * @returns the number of sensors, that failed */
+	int sample(void) {
+		long long ready[SIZE];		// Time when collect() is due [us], -1 if done
+		int failed = this->startFrom<0>(ready);
+		for(;;) {
+			size_t next = SIZE;
+			for(size_t i = 0; i < SIZE; i++)
+				if(ready[i] >= 0 && (next == SIZE || ready[i] < ready[next])) next = i;
+			if(next == SIZE) break;
+
+			const long long remaining = ready[next] - monotonic_us();
+			if(remaining > 0) {
+				struct timespec ts;
+				ts.tv_sec = (time_t)(remaining / 1000000LL);
+				ts.tv_nsec = (long)(remaining % 1000000LL) * 1000L;
+				nanosleep(&ts, NULL);
+				continue;
+			}
+			failed += this->collectAt<0>(next, ready);
+		}
+		return failed;
+	}
+
+	/** @returns true if the last readout of the I-th sensor succeeded */
+	bool valid(size_t i) const { return (i < SIZE ? this->_valid[i] : false); }
+	/** @returns the number of sensors, whose last readout succeeded */
+	size_t validCount(void) const {
+		size_t count = 0;
+		for(size_t i = 0; i < SIZE; i++) if(this->_valid[i]) count++;
+		return count;
+	}
+
+	/** Adds the channels of the sensors, that have been read successfully, to the given encoder */
+	void encode(JsonEncoder &encoder) const { this->encodeFrom<0>(encoder); }
+
+	/** Prints the channels of the sensors, that have been read successfully */
+	void print(std::ostream &out) const { this->printFrom<0>(out, true); }
+};
+
+}
+
+
+#endif
@@ -0,0 +1,91 @@
+/* =============================================================================
+ *
+ * Title:         Sequence lock
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Single-writer, multi-reader sequence lock for small
+ *                trivially copyable values
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_SEQLOCK_HPP
+#define _METEO_SEQLOCK_HPP
+
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+#include <stdint.h>
+#include <string.h>
+
+
+namespace sensors {
+
+/**
+  * Sequence lock around a value of type T. One writer stores new values
+  * without ever waiting for the readers, any number of readers take
+  * consistent copies without locks: A reader retries, if a store happened
+  * while it copied the value.
+  *
+  * The value is kept in 32-bit atomic words, so that the copies are no data
+  * race and the lock is lock-free on every Raspberry Pi (ARMv6 has no
+  * lock-free 64-bit atomics)
+  */
+template <class T> class SeqLock {
+	static_assert(std::is_trivially_copyable<T>::value, "SeqLock requires a trivially copyable type");
+private:
+	static const size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+	/** Sequence number, odd while a store is in progress */
+	std::atomic<uint32_t> _seq;
+	std::atomic<uint32_t> _words[WORDS];
+
+	SeqLock(const SeqLock&);
+	SeqLock& operator=(const SeqLock&);
+public:
+	SeqLock() : _seq(0) {
+		for(size_t i = 0; i < WORDS; i++) this->_words[i].store(0, std::memory_order_relaxed);
+	}
+
+	/** Stores a new value. Must only be called by one thread at a time */
+	void store(const T &value) {
+		uint32_t words[WORDS];
+		words[WORDS - 1] = 0;
+		memcpy(words, &value, sizeof(T));
+		const uint32_t seq = this->_seq.load(std::memory_order_relaxed);
+		this->_seq.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for(size_t i = 0; i < WORDS; i++) this->_words[i].store(words[i], std::memory_order_relaxed);
+		this->_seq.store(seq + 2, std::memory_order_release);
+	}
+
+	/** Tries to copy the value once
+	  * @returns false if a store interfered, the value is unchanged then */
+	bool tryLoad(T &value) const {
+		const uint32_t before = this->_seq.load(std::memory_order_acquire);
+		if(before & 1) return false;
+		uint32_t words[WORDS];
+		for(size_t i = 0; i < WORDS; i++) words[i] = this->_words[i].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(this->_seq.load(std::memory_order_relaxed) != before) return false;
+		memcpy(&value, words, sizeof(T));
+		return true;
+	}
+
+	/** @returns a consistent copy of the value. Retries until no store interferes */
+	T load(void) const {
+		T value;
+		for(int tries = 1; !this->tryLoad(value); tries++)
+			if(tries % 64 == 0) std::this_thread::yield();		// Writer was preempted
+		return value;
+	}
+
+	/** @returns the number of completed stores */
+	uint32_t version(void) const { return this->_seq.load(std::memory_order_acquire) / 2; }
+};
+
+}
+
+
+#endif
@@ -0,0 +1,128 @@
+/* =============================================================================
+ *
+ * Title:         Single-producer, single-consumer ring
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Lock-free bounded queue of fixed-size records between
+ *                two threads
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_SPSC_HPP
+#define _METEO_SPSC_HPP
+
+#include <atomic>
+#include <type_traits>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+namespace meteo {
+
+/**
+  * Bounded lock-free queue of trivially copyable records. One thread pushes,
+  * one other thread pops, neither ever waits for the other. The storage is
+  * allocated once, pushing and popping do not allocate memory.
+  *
+  * The producer may drop the oldest record to make room (pushOverwrite()).
+  * The consumer then might copy a slot while it is overwritten, so the pop
+  * only commits, if the slot still belonged to it afterwards. The slots are
+  * kept in 32-bit atomic words, so that such a copy is no data race
+  */
+template <class T> class SpscRing {
+	static_assert(std::is_trivially_copyable<T>::value, "SpscRing requires a trivially copyable type");
+private:
+	static const size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+	/** Number of slots minus one, the number of slots is a power of two */
+	size_t _mask;
+	std::atomic<uint32_t> *_words;
+	/** Next slot to be written, only advanced by the producer */
+	std::atomic<size_t> _head;
+	char _pad_head[64 - sizeof(std::atomic<size_t>)];
+	/** Next slot to be read. Advanced by the consumer and by a dropping producer */
+	std::atomic<size_t> _tail;
+	char _pad_tail[64 - sizeof(std::atomic<size_t>)];
+
+	void write(size_t index, const T &value) {
+		uint32_t words[WORDS];
+		words[WORDS - 1] = 0;
+		memcpy(words, &value, sizeof(T));
+		std::atomic<uint32_t> *slot = this->_words + (index & this->_mask) * WORDS;
+		for(size_t i = 0; i < WORDS; i++) slot[i].store(words[i], std::memory_order_relaxed);
+	}
+
+	SpscRing(const SpscRing&);
+	SpscRing& operator=(const SpscRing&);
+public:
+	/** Allocates the slots
+	  * @param capacity Minimum number of records, rounded up to a power of two */
+	explicit SpscRing(size_t capacity) : _head(0), _tail(0) {
+		size_t slots = 1;
+		while(slots < capacity) slots <<= 1;
+		this->_mask = slots - 1;
+		this->_words = new std::atomic<uint32_t>[slots * WORDS];
+		for(size_t i = 0; i < slots * WORDS; i++) this->_words[i].store(0, std::memory_order_relaxed);
+	}
+	virtual ~SpscRing() { delete[] this->_words; }
+
+	/** Appends a record. Producer only
+	  * @returns false if the ring is full, the record is not appended then */
+	bool push(const T &value) {
+		const size_t head = this->_head.load(std::memory_order_relaxed);
+		if(head - this->_tail.load(std::memory_order_acquire) > this->_mask) return false;
+		this->write(head, value);
+		this->_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Appends a record and drops the oldest one, if the ring is full. Producer only
+	  * @returns false if a record has been dropped */
+	bool pushOverwrite(const T &value) {
+		const size_t head = this->_head.load(std::memory_order_relaxed);
+		size_t tail = this->_tail.load(std::memory_order_acquire);
+		bool dropped = false;
+		while(!dropped && head - tail > this->_mask) {
+			// Fails if the consumer popped the oldest record meanwhile
+			if(this->_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+				dropped = true;
+		}
+		this->write(head, value);
+		this->_head.store(head + 1, std::memory_order_release);
+		return !dropped;
+	}
+
+	/** Removes the oldest record. Consumer only
+	  * @returns false if the ring is empty, the value is unchanged then */
+	bool pop(T &value) {
+		size_t tail = this->_tail.load(std::memory_order_acquire);
+		for(;;) {
+			if(tail == this->_head.load(std::memory_order_acquire)) return false;
+			uint32_t words[WORDS];
+			const std::atomic<uint32_t> *slot = this->_words + (tail & this->_mask) * WORDS;
+			for(size_t i = 0; i < WORDS; i++) words[i] = slot[i].load(std::memory_order_relaxed);
+			// The copy is only valid, if the producer did not drop the record meanwhile
+			if(this->_tail.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+				memcpy(&value, words, sizeof(T));
+				return true;
+			}
+		}
+	}
+
+	/** @returns the number of records in the ring */
+	size_t size(void) const {
+		const size_t tail = this->_tail.load(std::memory_order_acquire);
+		const size_t head = this->_head.load(std::memory_order_acquire);
+		return head - tail;
+	}
+	/** @returns the number of slots */
+	size_t capacity(void) const { return this->_mask + 1; }
+};
+
+}
+
+
+#endif
@@ -0,0 +1,114 @@
+/* =============================================================================
+ *
+ * Title:         Sensor state cache
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Persists the device state of the sensors (calibration,
+ *                gain) between runs for a warm start
+ *
+ * =============================================================================
+ */
+
+#include <fstream>
+#include <sstream>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "statecache.hpp"
+
+
+namespace meteo {
+
+/* File format (native byte order, the file never leaves the node):
+ *   "METEOSC1"
+ *   uint32_t count
+ *   count times: uint16_t key length, key, uint16_t state length, state
+ */
+static const char MAGIC[8] = { 'M', 'E', 'T', 'E', 'O', 'S', 'C', '1' };
+
+static bool readString(std::istream &in, std::string &value) {
+	uint16_t length;
+	if(!in.read((char*)&length, sizeof(length))) return false;
+	value.resize(length);
+	if(length > 0 && !in.read(&value[0], length)) return false;
+	return true;
+}
+
+static void writeString(std::ostream &out, const std::string &value) {
+	const uint16_t length = (uint16_t)value.size();
+	out.write((const char*)&length, sizeof(length));
+	out.write(value.data(), length);
+}
+
+int StateCache::load(const std::string &filename) {
+	std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!in.is_open()) return -1;
+
+	char magic[sizeof(MAGIC)];
+	uint32_t count;
+	if(!in.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) return -2;
+	if(!in.read((char*)&count, sizeof(count))) return -2;
+
+	// Only take over a completely valid file
+	std::map<std::string, std::string> states;
+	for(uint32_t i = 0; i < count; i++) {
+		std::string key, state;
+		if(!readString(in, key) || !readString(in, state)) return -2;
+		if(state.size() > MAX_STATE) return -2;
+		states[key] = state;
+	}
+	for(std::map<std::string, std::string>::const_iterator it = states.begin(); it != states.end(); ++it)
+		this->_states[it->first] = it->second;
+	return (int)states.size();
+}
+
+int StateCache::save(const std::string &filename) const {
+	const std::string tmp = filename + ".tmp";
+	{
+		std::ofstream out(tmp.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if(!out.is_open()) return -1;
+		out.write(MAGIC, sizeof(MAGIC));
+		const uint32_t count = (uint32_t)this->_states.size();
+		out.write((const char*)&count, sizeof(count));
+		for(std::map<std::string, std::string>::const_iterator it = this->_states.begin(); it != this->_states.end(); ++it) {
+			writeString(out, it->first);
+			writeString(out, it->second);
+		}
+		out.flush();
+		if(!out.good()) {
+			remove(tmp.c_str());
+			return -1;
+		}
+	}
+	if(rename(tmp.c_str(), filename.c_str()) != 0) {
+		remove(tmp.c_str());
+		return -1;
+	}
+	return 0;
+}
+
+std::string StateCache::get(const std::string &key) const {
+	std::map<std::string, std::string>::const_iterator it = this->_states.find(key);
+	if(it == this->_states.end()) return "";
+	return it->second;
+}
+
+void StateCache::put(const std::string &key, const sensors::Sensor *sensor) {
+	char buffer[MAX_STATE];
+	const size_t size = sensor->saveState(buffer, sizeof(buffer));
+	if(size > 0)
+		this->_states[key] = std::string(buffer, size);
+}
+
+std::string StateCache::key(const SensorSpec &spec) {
+	std::stringstream ss;
+	ss << spec.type << '@' << spec.bus;
+	if(spec.mux >= 0) ss << '/' << std::hex << "0x" << spec.mux << std::dec << ':' << spec.channel;
+	ss << '/' << std::hex << "0x" << SensorRegistry::address(spec);
+	return ss.str();
+}
+
+}
@@ -0,0 +1,67 @@
+/* =============================================================================
+ *
+ * Title:         Sensor state cache
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Persists the device state of the sensors (calibration,
+ *                gain) between runs for a warm start
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_STATECACHE_HPP
+#define _METEO_STATECACHE_HPP
+
+#include <string>
+#include <map>
+
+#include "sensor.hpp"
+#include "registry.hpp"
+
+
+namespace meteo {
+
+/**
+  * Small binary file with the saved state of every sensor (see
+  * Sensor::saveState()), keyed by type, bus, multiplexer channel and
+  * address. The file is only a cache: A missing, damaged or outdated file
+  * only costs a cold start
+  */
+class StateCache {
+private:
+	/** Saved states by key */
+	std::map<std::string, std::string> _states;
+public:
+	StateCache() {}
+
+	/**
+	  * Loads the given cache file. Existing entries are replaced
+	  * @returns the number of loaded entries or a negative value, if the file cannot be read or is invalid
+	  */
+	int load(const std::string &filename);
+	/**
+	  * Writes the cache file. The file is replaced atomically
+	  * @returns 0 on success, a non-zero value on error
+	  */
+	int save(const std::string &filename) const;
+
+	/** @returns the saved state of the given sensor, empty if none */
+	std::string get(const std::string &key) const;
+	/** Saves the state of the given sensor, if it has one */
+	void put(const std::string &key, const sensors::Sensor *sensor);
+
+	/** @returns the number of entries */
+	size_t size(void) const { return this->_states.size(); }
+
+	/** @returns the key of the sensor described by the given spec */
+	static std::string key(const SensorSpec &spec);
+
+	/** Maximum size of the state of one sensor */
+	static const size_t MAX_STATE = 256;
+};
+
+}
+
+
+#endif
@@ -0,0 +1,111 @@
+/* =============================================================================
+ *
+ * Title:         TCA9548A I2C multiplexer
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   8-channel I2C multiplexer with cached channel selection
+ *
+ * =============================================================================
+ */
+
+#include <sstream>
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+
+#include "tca9548a.hpp"
+
+
+namespace sensors {
+
+std::vector<TCA9548A*> TCA9548A::_instances;
+
+TCA9548A::TCA9548A(const std::string &i2c_device, int address) {
+	this->_device = i2c_device;
+	this->_address = address;
+	this->_current = -1;
+	this->_switches = 0;
+	this->_hits = 0;
+	this->_errors = 0;
+	this->_fd = ::open(i2c_device.c_str(), O_RDWR);
+	if(this->_fd >= 0 && ioctl(this->_fd, I2C_SLAVE, address) < 0) {
+		::close(this->_fd);
+		this->_fd = -1;
+	}
+}
+
+TCA9548A::~TCA9548A() {
+	if(this->_fd >= 0) ::close(this->_fd);
+}
+
+TCA9548A* TCA9548A::get(const std::string &i2c_device, int address) {
+	for(std::vector<TCA9548A*>::const_iterator it = _instances.begin(); it != _instances.end(); ++it)
+		if((*it)->_device == i2c_device && (*it)->_address == address) return *it;
+
+	TCA9548A *mux = new TCA9548A(i2c_device, address);
+	if(mux->_fd < 0) {
+		delete mux;
+		return NULL;
+	}
+	_instances.push_back(mux);
+	return mux;
+}
+
+void TCA9548A::closeAll(void) {
+	for(std::vector<TCA9548A*>::iterator it = _instances.begin(); it != _instances.end(); ++it)
+		delete *it;
+	_instances.clear();
+}
+
+int TCA9548A::write(int mask) {
+	const uint8_t value = (uint8_t)mask;
+	this->_switches++;
+	if(::write(this->_fd, &value, 1) != 1) {
+		this->_errors++;
+		this->_current = -1;
+		return -1;
+	}
+	this->_current = mask;
+	return 0;
+}
+
+int TCA9548A::select(int channel) {
+	if(channel < 0 || channel >= CHANNELS) return -2;
+	const int mask = 1 << channel;
+	if(this->_current == mask) {
+		this->_hits++;
+		return 0;
+	}
+
+	// Close other multiplexers on this bus first
+	for(std::vector<TCA9548A*>::const_iterator it = _instances.begin(); it != _instances.end(); ++it) {
+		TCA9548A *mux = *it;
+		if(mux == this || mux->_device != this->_device || mux->_current == 0) continue;
+		if(mux->disable() != 0) return -1;
+	}
+	return this->write(mask);
+}
+
+int TCA9548A::disable(void) {
+	if(this->_current == 0) return 0;
+	return this->write(0);
+}
+
+int TCA9548A::channel(void) const {
+	for(int i = 0; i < CHANNELS; i++)
+		if(this->_current == (1 << i)) return i;
+	return -1;
+}
+
+std::string TCA9548A::toString(void) const {
+	std::stringstream ss;
+	ss << "0x" << std::hex << this->_address << std::dec << " on " << this->_device << ": ";
+	ss << this->_switches << " switches, " << this->_hits << " avoided, " << this->_errors << " errors";
+	return ss.str();
+}
+
+}
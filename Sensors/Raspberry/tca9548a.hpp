@@ -0,0 +1,100 @@
+/* =============================================================================
+ *
+ * Title:         TCA9548A I2C multiplexer
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   8-channel I2C multiplexer with cached channel selection
+ *
+ * =============================================================================
+ */
+
+#ifndef _METEO_TCA9548A_HPP
+#define _METEO_TCA9548A_HPP
+
+
+#include <string>
+#include <vector>
+
+
+namespace sensors {
+
+/**
+  * TCA9548A 8-channel I2C multiplexer.
+  * The selected channel is cached, so selecting the channel that is already
+  * selected does not cause a bus transaction. Selecting a channel closes the
+  * channels of all other multiplexers on the same bus, so that sensors with
+  * the same address behind different multiplexers do not collide.
+  *
+  * Instances are shared per bus and address, see get(). A multiplexer is
+  * only used by the thread, that reads the sensors of its bus
+  */
+class TCA9548A {
+private:
+	/** Device name */
+	std::string _device;
+	/** I2C Address */
+	int _address;
+	/** File descriptor of the bus */
+	int _fd;
+	/** Currently selected channel, 0 if none or -1 if unknown */
+	int _current;
+
+	/** Number of channel switches (bus transactions) */
+	long _switches;
+	/** Number of selections, that were served by the cached channel */
+	long _hits;
+	/** Number of failed switches */
+	long _errors;
+
+	/** Writes the given channel mask */
+	int write(int mask);
+
+	/** All multiplexers */
+	static std::vector<TCA9548A*> _instances;
+
+	TCA9548A(const std::string &i2c_device, int address);
+	TCA9548A(const TCA9548A&);
+	TCA9548A& operator=(const TCA9548A&);
+public:
+	virtual ~TCA9548A();
+
+	/**
+	  * Gets the multiplexer at the given bus and address. It is opened on the first call
+	  * @returns the multiplexer or NULL, if the bus cannot be opened
+	  */
+	static TCA9548A* get(const std::string &i2c_device, int address = DEVICE_ADDRESS);
+	/** Closes all multiplexers */
+	static void closeAll(void);
+	/** @returns all multiplexers */
+	static const std::vector<TCA9548A*>& instances(void) { return _instances; }
+
+	/**
+	  * Selects the given channel, if it is not already selected
+	  * @param channel Channel (0-7)
+	  * @returns 0 on success, a negative value on error
+	  */
+	int select(int channel);
+	/** Closes all channels */
+	int disable(void);
+
+	/** @returns the selected channel, -1 if none or unknown */
+	int channel(void) const;
+
+	std::string device(void) const { return this->_device; }
+	int address(void) const { return this->_address; }
+	long switches(void) const { return this->_switches; }
+	long hits(void) const { return this->_hits; }
+	long errors(void) const { return this->_errors; }
+
+	/** @returns a one-line summary of the statistics */
+	std::string toString(void) const;
+
+	static const int DEVICE_ADDRESS = 0x70;
+	static const int CHANNELS = 8;
+};
+
+}
+
+
+#endif
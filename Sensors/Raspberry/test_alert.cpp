@@ -0,0 +1,253 @@
+/* =============================================================================
+ *
+ * Title:         Threshold alert test
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Runs the MCP9808 driver and GpioLine against a fake I2C
+ *                bus and a fake GPIO chip: arm, edge, read and re-arm.
+ *                open() and ioctl() are wrapped by the linker (see the
+ *                test_alert target). Run by "make test"
+ *
+ * =============================================================================
+ */
+
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#include <linux/gpio.h>
+
+#include "mcp9808.hpp"
+#include "sampler.hpp"
+#include "eventloop.hpp"
+
+
+using namespace std;
+using namespace sensors;
+using namespace meteo;
+
+#define FAKE_I2C "/dev/fake-i2c"
+#define FAKE_CHIP "/dev/fake-gpiochip"
+#define FAKE_ADDRESS 0x18
+#define FAKE_LINE 17
+
+extern "C" {
+int __real_open(const char *path, int flags, ...);
+int __real_ioctl(int fd, unsigned long request, ...);
+}
+
+/**
+  * MCP9808 behind a fake I2C bus, with its ALERT output on a fake GPIO line.
+  * The registers hold the values as the device sends them msb first
+  */
+static struct {
+	int i2c_fd, chip_fd;
+	int address;
+	uint16_t registers[16];
+	/** Pipe of the requested line, the kernel queue of the edge events */
+	int events[2];
+	/** Level of the ALERT output, active-low */
+	int level;
+	long edges;
+} fake;
+
+static float decode(uint16_t raw) {
+	float temperature = (float)(raw & 0x0FFF) / 16.0F;
+	if(raw & 0x1000) temperature -= 256.0F;
+	return temperature;
+}
+
+static uint16_t encode(float temperature) {
+	int sixteenths = (int)(temperature * 16.0F);
+	return (uint16_t)(sixteenths & 0x1FFF);
+}
+
+/** Comparator mode: the output is asserted while the temperature is outside the window */
+static void updateAlert(void) {
+	const float t = decode(fake.registers[0x05]);
+	const bool enabled = (fake.registers[0x01] & 0x0008) != 0;
+	const bool outside = t > decode(fake.registers[0x02]) || t < decode(fake.registers[0x03]) || t >= decode(fake.registers[0x04]);
+	const int level = (enabled && outside ? 0 : 1);
+	if(level == 0 && fake.level == 1 && fake.events[1] >= 0) {
+		struct gpioevent_data event;
+		memset(&event, 0, sizeof(event));
+		event.id = GPIOEVENT_EVENT_FALLING_EDGE;
+		if(::write(fake.events[1], &event, sizeof(event)) == (ssize_t)sizeof(event)) fake.edges++;
+	}
+	fake.level = level;
+}
+
+static void setTemperature(float temperature) {
+	fake.registers[0x05] = encode(temperature);
+	updateAlert();
+}
+
+static int smbus(struct i2c_smbus_ioctl_data *args) {
+	if(fake.address != FAKE_ADDRESS || args->command >= 16) {
+		errno = EIO;
+		return -1;
+	}
+	uint16_t &reg = fake.registers[args->command];
+	if(args->read_write == I2C_SMBUS_READ) {
+		// SMBus words are sent lsb first
+		if(args->size == I2C_SMBUS_WORD_DATA) args->data->word = (uint16_t)((reg >> 8) | (reg << 8));
+		else args->data->byte = (uint8_t)reg;
+		return 0;
+	}
+	if(args->size == I2C_SMBUS_WORD_DATA) reg = (uint16_t)((args->data->word >> 8) | (args->data->word << 8));
+	else reg = args->data->byte;
+	updateAlert();
+	return 0;
+}
+
+extern "C" int __wrap_open(const char *path, int flags, ...) {
+	mode_t mode = 0;
+	if(flags & O_CREAT) {
+		va_list ap;
+		va_start(ap, flags);
+		mode = (mode_t)va_arg(ap, int);
+		va_end(ap);
+	}
+	if(strcmp(path, FAKE_I2C) == 0) return (fake.i2c_fd = __real_open("/dev/null", O_RDWR));
+	if(strcmp(path, FAKE_CHIP) == 0) return (fake.chip_fd = __real_open("/dev/null", O_RDONLY));
+	return __real_open(path, flags, mode);
+}
+
+extern "C" int __wrap_ioctl(int fd, unsigned long request, ...) {
+	va_list ap;
+	va_start(ap, request);
+	void *arg = va_arg(ap, void*);
+	va_end(ap);
+
+	if(fd == fake.i2c_fd && request == I2C_SLAVE) {
+		fake.address = (int)(long)arg;
+		return 0;
+	}
+	if(fd == fake.i2c_fd && request == I2C_SMBUS)
+		return smbus((struct i2c_smbus_ioctl_data*)arg);
+	if(fd == fake.chip_fd && request == GPIO_GET_LINEEVENT_IOCTL) {
+		struct gpioevent_request *line = (struct gpioevent_request*)arg;
+		if(line->lineoffset != FAKE_LINE || line->eventflags != GPIOEVENT_REQUEST_FALLING_EDGE) {
+			errno = EINVAL;
+			return -1;
+		}
+		if(::pipe(fake.events) < 0) return -1;
+		line->fd = fake.events[0];
+		return 0;
+	}
+	if(fd == fake.events[0] && request == GPIOHANDLE_GET_LINE_VALUES_IOCTL) {
+		((struct gpiohandle_data*)arg)->values[0] = (uint8_t)fake.level;
+		return 0;
+	}
+	return __real_ioctl(fd, request, arg);
+}
+
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+	if(condition) return;
+	cerr << "test_alert: " << what << " failed" << endl;
+	failures++;
+}
+
+/** @returns true if the line has a pending edge within the given time */
+static bool edgePending(const GpioLine &line, int timeout_ms) {
+	struct pollfd pfd;
+	pfd.fd = line.fd();
+	pfd.events = POLLIN;
+	return ::poll(&pfd, 1, timeout_ms) > 0;
+}
+
+/** Reads the sensor through the sampler, that re-arms the alert after the readout
+  * @returns true if the sensor has been read */
+static bool readout(Sampler &sampler, Sensor *sensor) {
+	vector<Sensor*> sensors, read, late;
+	sensors.push_back(sensor);
+	if(!sampler.sample(sensors)) return false;
+	struct pollfd pfd;
+	pfd.fd = sampler.fd();
+	pfd.events = POLLIN;
+	for(int i = 0; i < 100; i++) {
+		if(sampler.collect(read, late)) return read.size() == 1;
+		::poll(&pfd, 1, 10);
+	}
+	return false;
+}
+
+int main() {
+	memset(&fake, 0, sizeof(fake));
+	fake.i2c_fd = fake.chip_fd = -1;
+	fake.events[0] = fake.events[1] = -1;
+	fake.level = 1;
+	fake.registers[0x06] = 0x0054;		// Manufacturer ID
+	fake.registers[0x07] = 0x0400;		// Device ID
+	setTemperature(21.0F);
+
+	MCP9808 *sensor = new MCP9808(FAKE_I2C, FAKE_ADDRESS);
+	check(!sensor->isError(), "init");
+	sensor->setAlertBand(0.5F);
+	GpioLine *line = NULL;
+	try {
+		line = new GpioLine(FAKE_CHIP, FAKE_LINE);
+	} catch (const char* msg) {
+		cerr << "test_alert: " << msg << endl;
+		return EXIT_FAILURE;
+	}
+	Sampler sampler;
+	sampler.add(sensor, sensor->device());
+
+	// Arm: the first readout programs the window around the reading
+	check(readout(sampler, sensor), "first readout");
+	check(sensor->temperature() == 21.0F, "first reading");
+	check((fake.registers[0x01] & 0x000F) == 0x0008, "alert output enabled");
+	check(decode(fake.registers[0x02]) == 21.5F && decode(fake.registers[0x03]) == 20.5F, "window 20.5..21.5");
+	check(line->value() == 1 && !edgePending(*line, 0), "line idle after arming");
+
+	// A change within the window does not wake up the loop
+	setTemperature(21.25F);
+	check(!edgePending(*line, 50), "no edge within the window");
+
+	// Edge: leaving the window asserts the line
+	setTemperature(23.0F);
+	check(edgePending(*line, 1000), "edge when leaving the window");
+	check(line->acknowledge() == 1, "one edge acknowledged");
+	check(line->value() == 0, "line asserted");
+
+	// Read and re-arm: the window follows the new reading and releases the line
+	check(readout(sampler, sensor), "readout after the edge");
+	check(sensor->temperature() == 23.0F, "reading after the edge");
+	check(decode(fake.registers[0x02]) == 23.5F && decode(fake.registers[0x03]) == 22.5F, "window re-armed to 22.5..23.5");
+	check(line->value() == 1 && !edgePending(*line, 0), "line released after re-arming");
+
+	// The lower limit fires as well
+	setTemperature(20.0F);
+	check(edgePending(*line, 1000) && line->acknowledge() == 1, "edge below the window");
+	check(readout(sampler, sensor) && sensor->temperature() == 20.0F, "readout below the window");
+	check(decode(fake.registers[0x03]) == 19.5F && line->value() == 1, "window re-armed to 19.5..20.5");
+
+	// Disarmed, the line stays released
+	check(sensor->disarmAlert() == 0 && (fake.registers[0x01] & 0x000F) == 0, "alert output disabled");
+	setTemperature(30.0F);
+	check(line->value() == 1 && !edgePending(*line, 50), "no edge when disarmed");
+
+	sampler.stop();
+	delete line;
+	delete sensor;
+
+	cout << "test_alert: " << fake.edges << " edges, " << failures << " failures" << endl;
+	if(failures > 0) {
+		cerr << "test_alert: FAILED" << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,268 @@
+/* =============================================================================
+ *
+ * Title:         Allocation test of the sampling path
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Counts the allocations of the steady-state sampling,
+ *                reporting, encoding and publishing path through a
+ *                replacement of the global operator new and of malloc().
+ *                The mosquitto calls of the publisher thread go to a fake
+ *                broker, that is linked in place of the library functions
+ *                (see the test_alloc target). Run by "make test"
+ *
+ * =============================================================================
+ */
+
+
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <vector>
+#include <map>
+#include <string>
+
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <mosquitto.h>
+
+#include "sensor.hpp"
+#include "sampler.hpp"
+#include "deadband.hpp"
+#include "publisher.hpp"
+#include "report.hpp"
+#include "scheduler.hpp"
+
+
+using namespace std;
+using namespace sensors;
+using namespace meteo;
+
+/** Allocations of all threads while counting is enabled */
+static std::atomic<long> allocations(0);
+static std::atomic<bool> counting(false);
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void *ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+	if(counting.load(std::memory_order_relaxed)) allocations++;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+	if(counting.load(std::memory_order_relaxed)) allocations++;
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void *ptr, size_t size) {
+	if(counting.load(std::memory_order_relaxed)) allocations++;
+	return __real_realloc(ptr, size);
+}
+}
+
+void* operator new(size_t size) {
+	if(counting.load(std::memory_order_relaxed)) allocations++;
+	void *ptr = __real_malloc(size == 0 ? 1 : size);
+	if(ptr == NULL) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size) {
+	if(counting.load(std::memory_order_relaxed)) allocations++;
+	void *ptr = __real_malloc(size == 0 ? 1 : size);
+	if(ptr == NULL) throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept { ::free(ptr); }
+void operator delete[](void *ptr) noexcept { ::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { ::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { ::free(ptr); }
+
+
+/**
+  * Broker behind the wrapped mosquitto calls. The connection is always up,
+  * published messages are only counted
+  */
+static struct {
+	/** Pipe, whose read end is the socket of the connection */
+	int socket[2];
+	std::atomic<long> messages, samples, bytes;
+	/** A message was not a JSON object of the node */
+	std::atomic<bool> malformed;
+} broker;
+
+extern "C" {
+int __wrap_mosquitto_connect(struct mosquitto*, const char*, int, int) { return MOSQ_ERR_SUCCESS; }
+int __wrap_mosquitto_reconnect(struct mosquitto*) { return MOSQ_ERR_SUCCESS; }
+int __wrap_mosquitto_disconnect(struct mosquitto*) { return MOSQ_ERR_SUCCESS; }
+int __wrap_mosquitto_socket(struct mosquitto*) { return broker.socket[0]; }
+bool __wrap_mosquitto_want_write(struct mosquitto*) { return false; }
+int __wrap_mosquitto_loop_read(struct mosquitto*, int) { return MOSQ_ERR_SUCCESS; }
+int __wrap_mosquitto_loop_write(struct mosquitto*, int) { return MOSQ_ERR_SUCCESS; }
+int __wrap_mosquitto_loop_misc(struct mosquitto*) { return MOSQ_ERR_SUCCESS; }
+
+int __wrap_mosquitto_publish(struct mosquitto*, int*, const char*, int len, const void *payload, int, bool) {
+	const char *data = (const char*)payload;
+	if(len < 2 || data[0] != '{' || data[len - 1] != '}' || strncmp(data, "{\"node\":", 8) != 0) broker.malformed = true;
+	// A batch has one timestamp per sample
+	long samples = 0;
+	for(const char *ts = data; (ts = strstr(ts, "\"ts\":")) != NULL && ts < data + len; ts++) samples++;
+	broker.samples += (samples > 0 ? samples : 1);
+	broker.messages++;
+	broker.bytes += len;
+	return MOSQ_ERR_SUCCESS;
+}
+}
+
+
+/** Sensor without a bus, that is read in one blocking call */
+class FakeSensor : public Sensor {
+private:
+	float _readings[3];
+	int _reads;
+public:
+	FakeSensor(const std::string &bus, int address) : Sensor(bus, address), _reads(0) {
+		for(int i = 0; i < 3; i++) this->_readings[i] = 0.0F;
+	}
+	virtual int read(void) {
+		this->_reads++;
+		this->_readings[0] = 20.0F + (float)(this->_reads % 10) * 0.1F;
+		this->_readings[1] = 1013.0F;
+		this->_readings[2] = 45.0F;
+		return 0;
+	}
+	virtual size_t channelCount(void) const { return 3; }
+	virtual const Channel* channels(void) const {
+		static const Channel channels[] = { {"t", "C", CHANNEL_TEMPERATURE, 0}, {"p", "hPa", CHANNEL_PRESSURE, 1}, {"hum", "%rel", CHANNEL_HUMIDITY, 2} };
+		return channels;
+	}
+	virtual const float* readings(void) const { return this->_readings; }
+	virtual int init(void) { return 0; }
+};
+
+/** Sensor without a bus, that needs two conversions like the TSL2561 autogain */
+class FakeConvertingSensor : public FakeSensor {
+private:
+	int _step;
+public:
+	FakeConvertingSensor(const std::string &bus, int address) : FakeSensor(bus, address), _step(0) {}
+	virtual long start(void) { this->_step = 0; return 200; }
+	virtual long collect(void) {
+		if(++this->_step < 2) return 200;
+		return this->read();
+	}
+};
+
+
+/** Waits for the cycle of the sampler and fetches the result
+  * @returns false on timeout */
+static bool waitCycle(Sampler &sampler, vector<Sensor*> &read, vector<Sensor*> &late) {
+	struct pollfd pfd;
+	pfd.fd = sampler.fd();
+	pfd.events = POLLIN;
+	for(int i = 0; i < 100; i++) {
+		if(sampler.collect(read, late)) return true;
+		if(::poll(&pfd, 1, 10) < 0) return false;
+	}
+	return false;
+}
+
+/** Waits until the broker received the given number of samples
+  * @returns false on timeout */
+static bool waitPublished(long samples) {
+	for(int i = 0; i < 2000 && broker.samples < samples; i++) ::poll(NULL, 0, 1);
+	return broker.samples == samples;
+}
+
+int main() {
+	const int warmup = 10;
+	const int cycles = 250;
+	const int batch = 5;
+
+	if(::pipe(broker.socket) < 0) {
+		cerr << "test_alloc: pipe failed" << endl;
+		return EXIT_FAILURE;
+	}
+
+	vector<Sensor*> sensors;
+	sensors.push_back(new FakeSensor("/dev/fake-0", 0x10));
+	sensors.push_back(new FakeConvertingSensor("/dev/fake-0", 0x11));
+	sensors.push_back(new FakeSensor("/dev/fake-1", 0x12));
+	sensors[2]->setPrefix("out_");
+
+	Sampler sampler;
+	for(size_t i = 0; i < sensors.size(); i++) sampler.add(sensors[i], sensors[i]->device());
+	// The publisher thread encodes and publishes to the fake broker
+	PublisherConfig config;
+	config.mosquitto = "fake-broker";
+	config.node_id = 1;
+	config.quiet = true;
+	Publisher *publisher = new Publisher(64, Publisher::DROP_OLDEST, config);
+	// The temperature of the first sensor changes by 0.1 every readout
+	map<string, string> options;
+	options["deadband.t"] = "0.05";
+	Deadband deadband(sensors[0], options);
+	Reporter reporter(publisher, true);
+	reporter.setDeadband(sensors[0], &deadband);
+
+	vector<Sensor*> read, late;
+	vector<pair<Sensor*, double> > stale;
+	read.reserve(sensors.size());
+	late.reserve(sensors.size());
+	stale.reserve(sensors.size());
+	int failed = 0;
+	// Single messages first, then batches with timestamps
+	for(int phase = 0; phase < 2; phase++) {
+		if(phase == 1) {
+			config.batch = batch;
+			config.timestamps = true;
+			publisher->configure(config);
+		}
+		for(int cycle = 0; cycle < warmup + cycles; cycle++) {
+			if(cycle == warmup) {
+				// The settings are applied and the encoder has grown to the largest sample
+				if(!waitPublished(reporter.packets())) failed++;
+				counting = true;
+			}
+
+			if(!sampler.sample(sensors) || !waitCycle(sampler, read, late)) {
+				failed++;
+				continue;
+			}
+			if(read.size() != sensors.size()) failed++;
+			// Every fourth cycle the last sensor missed the budget
+			stale.clear();
+			if(cycle % 4 == 0 && read.size() > 0) {
+				Sensor *sensor = read.back();
+				read.pop_back();
+				stale.push_back(pair<Sensor*, double>(sensor, sampler.health(sensor)->age(monotonic_ns())));
+			}
+			if(!reporter.process(read, stale)) failed++;
+			publisher->retry();
+		}
+		if(!waitPublished(reporter.packets())) failed++;
+		counting = false;
+	}
+
+	publisher->stop();
+	const long dropped = publisher->dropped();
+	delete publisher;
+	sampler.stop();
+	for(size_t i = 0; i < sensors.size(); i++) delete sensors[i];
+
+	cout << "test_alloc: " << 2 * cycles << " cycles, " << broker.messages << " messages, " << broker.samples << " samples, ";
+	cout << allocations << " allocations, " << failed << " failed cycles" << endl;
+	if(broker.malformed) cerr << "test_alloc: Malformed message" << endl;
+	if(dropped > 0) cerr << "test_alloc: " << dropped << " samples dropped" << endl;
+	if(allocations != 0 || failed != 0 || broker.malformed || dropped > 0 || broker.samples != reporter.packets()) {
+		cerr << "test_alloc: FAILED" << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+/* =============================================================================
+ *
+ * Title:         Deadband test
+ * Author:        Felix Niederwanger
+ * License:       Copyright (c), 2017 Felix Niederwanger
+ *                MIT license (http://opensource.org/licenses/MIT)
+ * Description:   Checks which readouts of a sensor are news for its
+ *                deadbands and heartbeat. Run by "make test"
+ *
+ * =============================================================================
+ */
+
+
+#include <iostream>
+#include <cstdlib>
+#include <map>
+#include <string>
+
+#include "sensor.hpp"
+#include "deadband.hpp"
+
+
+using namespace std;
+using namespace sensors;
+using namespace meteo;
+
+#define SECOND 1000000000LL
+
+/** Sensor without a bus with the channels of a BMP180, the test sets its readings */
+class FakeSensor : public Sensor {
+public:
+	float _readings[3];
+
+	FakeSensor() : Sensor("/dev/null", 0x77) {
+		this->set(21.0F, 1013.0F, 540.0F);
+	}
+	void set(float t, float p, float alt) {
+		this->_readings[0] = t;
+		this->_readings[1] = p;
+		this->_readings[2] = alt;
+	}
+	virtual int read(void) { return 0; }
+	virtual size_t channelCount(void) const { return 3; }
+	virtual const Channel* channels(void) const {
+		static const Channel channels[] = { {"t", "C", CHANNEL_TEMPERATURE, 0}, {"p", "hPa", CHANNEL_PRESSURE, 1}, {"alt", "m", CHANNEL_ALTITUDE, 2} };
+		return channels;
+	}
+	virtual const float* readings(void) const { return this->_readings; }
+	virtual int init(void) { return 0; }
+};
+
+
+static int failures = 0;
+
+static void check(bool condition, const char* what) {
+	if(condition) return;
+	cerr << "test_deadband: " << what << " failed" << endl;
+	failures++;
+}
+
+int main() {
+	FakeSensor sensor;
+
+	// No band: every readout is news
+	{
+		map<string, string> options;
+		Deadband deadband(&sensor, options);
+		check(!deadband.active(), "no band inactive");
+		deadband.published(1 * SECOND);
+		check(deadband.changed(2 * SECOND), "no band, unchanged readout is news");
+	}
+
+	// Band on one channel: the other channels are ignored
+	{
+		map<string, string> options;
+		options["deadband.t"] = "0.1";
+		Deadband deadband(&sensor, options);
+		check(deadband.active(), "single band active");
+		check(deadband.changed(1 * SECOND), "first readout is news");
+		deadband.published(1 * SECOND);
+		check(!deadband.changed(2 * SECOND), "unchanged readout suppressed");
+		sensor.set(21.05F, 1020.0F, 480.0F);
+		check(!deadband.changed(3 * SECOND), "channels without a band ignored");
+		sensor.set(21.2F, 1020.0F, 480.0F);
+		check(deadband.changed(4 * SECOND), "temperature outside its band");
+		deadband.published(4 * SECOND);
+		check(!deadband.changed(5 * SECOND), "suppressed after publishing");
+	}
+
+	// Relative band and heartbeat
+	{
+		map<string, string> options;
+		options["deadband_rel.p"] = "1";
+		options["heartbeat"] = "10";
+		sensor.set(21.0F, 1000.0F, 540.0F);
+		Deadband deadband(&sensor, options);
+		deadband.published(1 * SECOND);
+		sensor.set(25.0F, 1005.0F, 540.0F);
+		check(!deadband.changed(2 * SECOND), "pressure within 1 %");
+		sensor.set(25.0F, 1011.0F, 540.0F);
+		check(deadband.changed(3 * SECOND), "pressure outside 1 %");
+		sensor.set(25.0F, 1000.0F, 540.0F);
+		check(!deadband.changed(10 * SECOND), "heartbeat not yet expired");
+		check(deadband.changed(11 * SECOND), "heartbeat expired");
+	}
+
+	// Bands of unknown channels are rejected
+	{
+		map<string, string> options;
+		options["deadband.temp"] = "0.1";
+		bool rejected = false;
+		try {
+			Deadband deadband(&sensor, options);
+		} catch (const char*) {
+			rejected = true;
+		}
+		check(rejected, "unknown channel rejected");
+		options.clear();
+		options["deadband_rel.hum"] = "1";
+		rejected = false;
+		try {
+			Deadband deadband(&sensor, options);
+		} catch (const char*) {
+			rejected = true;
+		}
+		check(rejected, "unknown channel of relative band rejected");
+	}
+
+	cout << "test_deadband: " << failures << " failures" << endl;
+	if(failures > 0) {
+		cerr << "test_deadband: FAILED" << endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
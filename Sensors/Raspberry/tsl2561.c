@@ -54,6 +54,11 @@
  */
 #define TSL2561_REG_CTRL 0x00
 #define TSL2561_REG_TIMING 0x01
+#define TSL2561_REG_ID 0x0A
+
+#define TSL2561_REG_THRESH_LOW 0x02
+#define TSL2561_REG_THRESH_HIGH 0x04
+#define TSL2561_REG_INTERRUPT 0x06
 
 #define TSL2561_REG_CH0_LOW 0x0C
 #define TSL2561_REG_CH0_HIGH 0x0D
@@ -62,6 +67,9 @@
 
 #define TSL2561_CMD_BIT (0x80)
 #define TSL2561_WORD_BIT (0x20)
+#define TSL2561_CLEAR_BIT (0x40)
+
+#define TSL2561_INTR_LEVEL 0x10
 
 #define TSL2561_CTRL_PWR_ON 0x03
 #define TSL2561_CTRL_PWR_OFF 0x00
@@ -460,6 +468,47 @@ void tsl2561_set_integration_time(void *_tsl, int time) {
 
 
 
+/**
+ * Returns the gain value of this TSL2561 sensor.
+ *
+ * @param tsl sensor
+ * @return gain
+ */
+int tsl2561_get_gain(void *_tsl) {
+	tsl2561_t *tsl = TO_TSL(_tsl);
+	return tsl->gain;
+}
+
+
+
+/**
+ * Returns the integration time value of this TSL2561 sensor.
+ *
+ * @param tsl sensor
+ * @return integration time
+ */
+int tsl2561_get_integration_time(void *_tsl) {
+	tsl2561_t *tsl = TO_TSL(_tsl);
+	return tsl->integration_time;
+}
+
+
+
+/**
+ * Reads the ID register of this TSL2561 sensor. The upper nibble is the
+ * part number (0x1 for the CS, 0x5 for the T/FN/CL package), the lower
+ * nibble the revision.
+ *
+ * @param tsl sensor
+ * @return ID register or a negative value on error
+ */
+int tsl2561_id(void *_tsl) {
+	tsl2561_t *tsl = TO_TSL(_tsl);
+	return i2c_smbus_read_byte_data(tsl->file, TSL2561_CMD_BIT | TSL2561_REG_ID);
+}
+
+
+
 /**
  * Enables autogain for this TSL2561 sensor.
  * 
@@ -534,29 +583,56 @@ void tsl2561_close(void *_tsl) {
  *
  */
 #define TSL2561_FACTOR_US 1000000
-	
-void tsl2561_read(void *_tsl, int *broadband, int *ir) {
-	tsl2561_enable(_tsl);
+
+/**
+ * Returns the time until the ADC of this TSL2561 sensor is complete
+ * with the current integration time.
+ *
+ * @param tsl sensor
+ * @return conversion time in microseconds
+ */
+long tsl2561_conversion_time(void *_tsl) {
 	tsl2561_t *tsl = TO_TSL(_tsl);
 
-	// wait until ADC is complete
+	// time until ADC is complete
 	switch(tsl->integration_time) {
 		case TSL2561_INTEGRATION_TIME_402MS:
-			usleep(0.403 * TSL2561_FACTOR_US);
-			break;
+			return 0.403 * TSL2561_FACTOR_US;
 
 		case TSL2561_INTEGRATION_TIME_101MS:
-			usleep(0.102 * TSL2561_FACTOR_US);
-			break;
+			return 0.102 * TSL2561_FACTOR_US;
 
 		case TSL2561_INTEGRATION_TIME_13MS:
-			usleep(0.014 * TSL2561_FACTOR_US);
-			break;
+			return 0.014 * TSL2561_FACTOR_US;
 		default:
-			usleep(0.403 * TSL2561_FACTOR_US);
-			break;
+			return 0.403 * TSL2561_FACTOR_US;
 	}
+}
 
+
+
+/**
+ * Powers up this TSL2561 sensor and thereby starts an integration cycle
+ * without waiting for it.
+ *
+ * @param tsl sensor
+ * @return waiting time in us until tsl2561_fetch can be called
+ */
+long tsl2561_start(void *_tsl) {
+	tsl2561_enable(_tsl);
+	return tsl2561_conversion_time(_tsl);
+}
+
+
+/**
+ * Fetches the channel values of a completed integration cycle and
+ * powers down this TSL2561 sensor.
+ *
+ * @param tsl sensor
+ * @param broadband channel
+ * @param ir channel
+ */
+void tsl2561_fetch(void *_tsl, int *broadband, int *ir) {
 	*broadband = tsl2561_read_word_data(_tsl, TSL2561_CMD_BIT | TSL2561_WORD_BIT | TSL2561_REG_CH0_LOW);
 	*ir = tsl2561_read_word_data(_tsl, TSL2561_CMD_BIT | TSL2561_WORD_BIT | TSL2561_REG_CH1_LOW);
 	
@@ -568,6 +644,12 @@ void tsl2561_read(void *_tsl, int *broadband, int *ir) {
 	tsl2561_disable(_tsl);
 }
 
+	
+void tsl2561_read(void *_tsl, int *broadband, int *ir) {
+	usleep(tsl2561_start(_tsl));
+	tsl2561_fetch(_tsl, broadband, ir);
+}
+
 
 /*
  * Computes a lux value for this TSL2561 sensor.
@@ -597,52 +679,55 @@ long tsl2561_lux(void *_tsl) {
 }
 
 
-void tsl2561_luminosity(void *_tsl, int *channel0, int *channel1) {
+/**
+ * Adjusts the gain of this TSL2561 sensor if autogain is enabled and the
+ * given broadband value is outside of the autogain thresholds.
+ *
+ * @param tsl sensor
+ * @param broadband channel of the last read
+ * @return 1 if the gain has been changed and the sensor needs to be read again, otherwise 0
+ */
+int tsl2561_autogain(void *_tsl, int channel0) {
 	tsl2561_t *tsl = TO_TSL(_tsl);
-	uint16_t hi, lo;	
-	bool agc_check = false, valid = false;
+	uint16_t hi, lo;
 
-	if(!tsl->autogain) { 
-		tsl2561_read(_tsl, channel0, channel1);	
-		return;
+	if(!tsl->autogain)
+		return 0;
+
+	switch(tsl->integration_time) {
+		case TSL2561_INTEGRATION_TIME_13MS:
+			hi = TSL2561_AGC_THI_13MS;
+			lo = TSL2561_AGC_TLO_13MS;
+			break;
+
+		case TSL2561_INTEGRATION_TIME_101MS:
+			hi = TSL2561_AGC_THI_101MS;
+			lo = TSL2561_AGC_TLO_101MS;
+			break;
+	
+		default: 
+			hi = TSL2561_AGC_THI_402MS;
+			lo = TSL2561_AGC_TLO_402MS;
+			break;	
 	}
 
-	while (!valid) {
-		switch(tsl->integration_time) {
-			case TSL2561_INTEGRATION_TIME_13MS:
-				hi = TSL2561_AGC_THI_13MS;
-				lo = TSL2561_AGC_TLO_13MS;
-				break;
-
-			case TSL2561_INTEGRATION_TIME_101MS:
-				hi = TSL2561_AGC_THI_101MS;
-				lo = TSL2561_AGC_TLO_101MS;
-				break;
-		
-			default: 
-				hi = TSL2561_AGC_THI_402MS;
-				lo = TSL2561_AGC_TLO_402MS;
-				break;	
-		}
-		
-		tsl2561_read(_tsl, channel0, channel1);
-		if(!agc_check) {
-			if((*channel0 < lo) && (tsl->gain == TSL2561_GAIN_0X)) {
-				tsl2561_set_gain(_tsl, TSL2561_GAIN_16X);
-				tsl2561_read(_tsl, channel0, channel1);
-				agc_check = true;
-
-			} else if((*channel0 > hi) && (tsl->gain == TSL2561_GAIN_16X)) {
-				tsl2561_set_gain(_tsl, TSL2561_GAIN_0X);
-				tsl2561_read(_tsl, channel0, channel1);
-				agc_check = true;
-			} else {
-				valid = true;
-			}
-		} else {
-			valid = true;
-		}
+	if((channel0 < lo) && (tsl->gain == TSL2561_GAIN_0X)) {
+		tsl2561_set_gain(_tsl, TSL2561_GAIN_16X);
+		return 1;
+	} else if((channel0 > hi) && (tsl->gain == TSL2561_GAIN_16X)) {
+		tsl2561_set_gain(_tsl, TSL2561_GAIN_0X);
+		return 1;
 	}
+	return 0;
+}
+
+
+void tsl2561_luminosity(void *_tsl, int *channel0, int *channel1) {
+	tsl2561_read(_tsl, channel0, channel1);
+	
+	// At most one gain change is required to get a valid reading
+	if(tsl2561_autogain(_tsl, *channel0))
+		tsl2561_read(_tsl, channel0, channel1);
 }
 
 
@@ -745,3 +830,57 @@ unsigned long tsl2561_compute_lux(void *_tsl, int ch0, int ch1) {
 
 	return lux;		
 }
+
+
+
+/**
+ * Programs the interrupt thresholds of channel 0 (broadband) and enables
+ * the level interrupt. The sensor is powered up, so that it integrates
+ * continuously. The INT pin (active-low) is asserted, when channel 0 is
+ * outside of the thresholds for persist integration cycles, until the
+ * interrupt is cleared.
+ *
+ * @param tsl sensor
+ * @param low lower threshold
+ * @param high upper threshold
+ * @param persist integration cycles outside of the thresholds (1-15)
+ * @return 0 on success, a negative value on error
+ */
+int tsl2561_set_interrupt(void *_tsl, int low, int high, int persist) {
+	tsl2561_t *tsl = TO_TSL(_tsl);
+	if(persist < 1) persist = 1;
+	if(persist > 15) persist = 15;
+
+	if(i2c_smbus_write_byte_data(tsl->file, TSL2561_CMD_BIT | TSL2561_REG_INTERRUPT, 0) < 0) return -1;
+	if(i2c_smbus_write_word_data(tsl->file, TSL2561_CMD_BIT | TSL2561_WORD_BIT | TSL2561_REG_THRESH_LOW, low) < 0) return -1;
+	if(i2c_smbus_write_word_data(tsl->file, TSL2561_CMD_BIT | TSL2561_WORD_BIT | TSL2561_REG_THRESH_HIGH, high) < 0) return -1;
+	if(tsl2561_clear_interrupt(_tsl) < 0) return -1;
+	if(i2c_smbus_write_byte_data(tsl->file, TSL2561_CMD_BIT | TSL2561_REG_INTERRUPT, TSL2561_INTR_LEVEL | persist) < 0) return -1;
+	if(i2c_smbus_write_byte_data(tsl->file, TSL2561_CMD_BIT | TSL2561_REG_CTRL, TSL2561_CTRL_PWR_ON) < 0) return -1;
+	return 0;
+}
+
+
+/**
+ * Clears a pending interrupt, so that the INT pin is released.
+ *
+ * @param tsl sensor
+ * @return 0 on success, a negative value on error
+ */
+int tsl2561_clear_interrupt(void *_tsl) {
+	tsl2561_t *tsl = TO_TSL(_tsl);
+	return (i2c_smbus_write_byte(tsl->file, TSL2561_CMD_BIT | TSL2561_CLEAR_BIT) < 0 ? -1 : 0);
+}
+
+
+/**
+ * Disables the interrupt and clears a pending one.
+ *
+ * @param tsl sensor
+ * @return 0 on success, a negative value on error
+ */
+int tsl2561_disable_interrupt(void *_tsl) {
+	tsl2561_t *tsl = TO_TSL(_tsl);
+	if(i2c_smbus_write_byte_data(tsl->file, TSL2561_CMD_BIT | TSL2561_REG_INTERRUPT, 0) < 0) return -1;
+	return tsl2561_clear_interrupt(_tsl);
+}
@@ -23,20 +23,30 @@
 
 namespace sensors {
 
+constexpr Channel TSL2561::CHANNEL_TABLE[];
+
 
 TSL2561::TSL2561(const char* i2c_device, int address) : Sensor(i2c_device, address) {
-	this->tsl = tsl2561_init(address, i2c_device);
-	if(this->tsl == NULL) this->_error = true;
-	this->_visible = 0;
-	this->_ir = 0;
+	this->tsl = NULL;
+	this->_autogain = false;
+	this->_itime = -1;
+	this->_gain = -1;
+	if(this->init() != 0) this->_error = true;
+	this->_readings[CH_VIS] = 0.0F;
+	this->_readings[CH_IR] = 0.0F;
+	this->_agc_checked = false;
 }
 
 
 TSL2561::TSL2561(const std::string i2c_device, int address)  : Sensor(i2c_device, address) {
-	this->tsl = tsl2561_init(address, i2c_device.c_str());
-	if(this->tsl == NULL) this->_error = true;
-	this->_visible = 0;
-	this->_ir = 0;
+	this->tsl = NULL;
+	this->_autogain = false;
+	this->_itime = -1;
+	this->_gain = -1;
+	if(this->init() != 0) this->_error = true;
+	this->_readings[CH_VIS] = 0.0F;
+	this->_readings[CH_IR] = 0.0F;
+	this->_agc_checked = false;
 }
 
 
@@ -44,15 +54,135 @@ TSL2561::~TSL2561() {
 	tsl2561_close(this->tsl);
 }
 
+int TSL2561::init() {
+	tsl2561_close(this->tsl);
+	this->tsl = tsl2561_init(this->_address, this->_device.c_str());
+	if(this->tsl == NULL) return -1;
+	if(this->_autogain) tsl2561_enable_autogain(this->tsl);
+	if(this->_gain >= 0)
+		tsl2561_set_timing(this->tsl, (this->_itime >= 0 ? this->_itime : tsl2561_get_integration_time(this->tsl)), this->_gain);
+	else if(this->_itime >= 0)
+		tsl2561_set_integration_time(this->tsl, this->_itime);
+	this->_error = false;
+	return 0;
+}
+
+void TSL2561::setAutogain(bool enabled) {
+	this->_autogain = enabled;
+	if(this->tsl == NULL) return;
+	if(enabled)
+		tsl2561_enable_autogain(this->tsl);
+	else
+		tsl2561_disable_autogain(this->tsl);
+}
+
+int TSL2561::setPrecision(int level) {
+	if(level < TSL2561_INTEGRATION_TIME_13MS || level > TSL2561_INTEGRATION_TIME_402MS) return -1;
+	this->_itime = level;
+	if(this->tsl != NULL) tsl2561_set_integration_time(this->tsl, level);
+	return 0;
+}
+
+int TSL2561::precision(void) const {
+	if(this->tsl != NULL) return tsl2561_get_integration_time(this->tsl);
+	return (this->_itime < 0 ? TSL2561_INTEGRATION_TIME_402MS : this->_itime);
+}
+
+std::string TSL2561::precisionName(int level) const {
+	switch(level) {
+	case TSL2561_INTEGRATION_TIME_13MS: return "13 ms";
+	case TSL2561_INTEGRATION_TIME_101MS: return "101 ms";
+	case TSL2561_INTEGRATION_TIME_402MS: return "402 ms";
+	default: return "";
+	}
+}
+
+long TSL2561::conversionTime(void) const {
+	if(this->tsl == NULL) return 0;
+	return tsl2561_conversion_time(this->tsl);
+}
+
+int TSL2561::armAlert(void) {
+	if(this->tsl == NULL || this->_alertBand <= 0.0F) return -1;
+	const float counts = this->_readings[CH_VIS];
+	const long low = (long)(counts - this->_alertBand);
+	const long high = (long)(counts + this->_alertBand);
+	return tsl2561_set_interrupt(this->tsl, (low < 0 ? 0 : low), (high > 0xFFFF ? 0xFFFF : high), 1);
+}
+
+int TSL2561::disarmAlert(void) {
+	if(this->tsl == NULL) return -1;
+	if(tsl2561_disable_interrupt(this->tsl) != 0) return -1;
+	tsl2561_disable(this->tsl);
+	return 0;
+}
+
+size_t TSL2561::saveState(void *buffer, size_t size) const {
+	if(this->tsl == NULL || size < 2) return 0;
+	uint8_t *state = (uint8_t*)buffer;
+	state[0] = (uint8_t)tsl2561_get_gain(this->tsl);
+	state[1] = (uint8_t)tsl2561_get_integration_time(this->tsl);
+	return 2;
+}
+
+int TSL2561::restoreState(const void *state, size_t size) {
+	if(this->tsl == NULL) return -1;
+	if(size != 2) return 0;
+	// Part number 0x1 (CS package) or 0x5 (T/FN/CL package)
+	const int id = tsl2561_id(this->tsl);
+	if(id < 0) return -1;
+	if((id >> 4) != 0x1 && (id >> 4) != 0x5) return 0;
+	const uint8_t *values = (const uint8_t*)state;
+	if(values[0] != TSL2561_GAIN_0X && values[0] != TSL2561_GAIN_16X) return 0;
+	if(values[1] > TSL2561_INTEGRATION_TIME_402MS) return 0;
+	// Kept for the next init(), e.g. after the circuit breaker reopens
+	this->_gain = values[0];
+	this->_itime = values[1];
+	tsl2561_set_timing(this->tsl, values[1], values[0]);
+	return 0;
+}
+
 	
 int TSL2561::read() {
 	if(this->tsl == NULL) return -1;
-	tsl2561_luminosity(this->tsl, &this->_visible, &this->_ir);
+	int visible, ir;
+	tsl2561_luminosity(this->tsl, &visible, &ir);
+	this->_readings[CH_VIS] = visible;
+	this->_readings[CH_IR] = ir;
 	// TODO: Return status on error
 	
 	return 0;
 }
 
+long TSL2561::start() {
+	if(this->tsl == NULL) return -1;
+	this->_agc_checked = false;
+	return tsl2561_start(this->tsl);
+}
+
+long TSL2561::collect() {
+	if(this->tsl == NULL) return -1;
+	
+	int visible, ir;
+	tsl2561_fetch(this->tsl, &visible, &ir);
+	if(visible < 0 || ir < 0) return -1;
+	
+	// Same as in tsl2561_luminosity: At most one gain change per reading
+	if(!this->_agc_checked && tsl2561_autogain(this->tsl, visible)) {
+		this->_agc_checked = true;
+		return tsl2561_start(this->tsl);
+	}
+	
+	this->_readings[CH_VIS] = visible;
+	this->_readings[CH_IR] = ir;
+	return 0;
+}
+
+void TSL2561::abort() {
+	// Power down until the next start()
+	if(this->tsl != NULL) tsl2561_disable(this->tsl);
+}
+
 }
 
 
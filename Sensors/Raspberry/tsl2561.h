@@ -36,11 +36,21 @@ void tsl2561_set_timing(void *_tsl, int integration_time, int gain);
 void tsl2561_set_gain(void *_tsl, int gain);
 void tsl2561_set_integration_time(void *_tsl, int ingeration_time);
 void tsl2561_set_type(void *_tsl, int type);
+int tsl2561_get_gain(void *_tsl);
+int tsl2561_get_integration_time(void *_tsl);
+int tsl2561_id(void *_tsl);
 
 void tsl2561_read(void *_tsl, int *visible, int *ir);
+long tsl2561_start(void *_tsl);
+long tsl2561_conversion_time(void *_tsl);
+int tsl2561_set_interrupt(void *_tsl, int low, int high, int persist);
+int tsl2561_clear_interrupt(void *_tsl);
+int tsl2561_disable_interrupt(void *_tsl);
+void tsl2561_fetch(void *_tsl, int *visible, int *ir);
 long tsl2561_lux(void *_tsl);
 void tsl2561_luminosity(void *_tsl, int *visible, int *ir);
 	
 void tsl2561_enable_autogain(void *_tsl);
 void tsl2561_disable_autogain(void *_tsl);	
+int tsl2561_autogain(void *_tsl, int visible);
 
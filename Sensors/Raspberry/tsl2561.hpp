@@ -25,10 +25,26 @@
 namespace sensors {
 
 class TSL2561 : public Sensor {
+public:
+	/** Channel indices */
+	enum { CH_IR = 0, CH_VIS, CHANNELS };
+	/** Channel descriptors, available at compile time */
+	static constexpr Channel CHANNEL_TABLE[CHANNELS] = {
+		{ "l_ir", "counts", CHANNEL_LIGHT, CH_IR },
+		{ "l_vis", "counts", CHANNEL_LIGHT, CH_VIS },
+	};
 private:
 	// Last readings
-	int _visible, _ir;
+	float _readings[CHANNELS];
 	
+	/** Autogain already adjusted during the running conversion */
+	bool _agc_checked;
+	/** Autogain enabled, restored on init() */
+	bool _autogain;
+	/** Integration time set with setPrecision() or restoreState(), restored on init(). -1 if not set */
+	int _itime;
+	/** Gain set with restoreState(), restored on init(). -1 if not set */
+	int _gain;
 	
 	void* tsl;
 public:
@@ -36,17 +52,39 @@ public:
 	TSL2561(const std::string i2c_device, int address=DEVICE_ADDRESS);
 	virtual ~TSL2561();
 	
+	virtual int init(void);
+	/** Saves gain and integration time */
+	virtual size_t saveState(void *buffer, size_t size) const;
+	/** Applies the saved gain and integration time, if the device is a TSL2561 */
+	virtual int restoreState(const void *state, size_t size);
 	int read(void);
+	virtual long start(void);
+	virtual long collect(void);
+	virtual void abort(void);
+	
+	/** Enables or disables the automatic gain adjustment (default: disabled) */
+	void setAutogain(bool enabled);
+	
+	/** Sets the integration time (0 = 13 ms, 1 = 101 ms, 2 = 402 ms, default: 2).
+	  * The counts scale with the integration time */
+	virtual int setPrecision(int level);
+	virtual int precision(void) const;
+	virtual int precisionLevels(void) const { return 3; }
+	virtual std::string precisionName(int level) const;
+	virtual long conversionTime(void) const;
+	
+	/** The INT pin watches channel 0, the broadband counts */
+	virtual const Channel* alertChannel(void) const { return &CHANNEL_TABLE[CH_VIS]; }
+	/** Keeps the sensor powered, so that it integrates continuously */
+	virtual int armAlert(void);
+	virtual int disarmAlert(void);
 	
-	float visible() { return this->_visible; }
-	float ir() { return this->_ir; }
+	float visible() { return this->_readings[CH_VIS]; }
+	float ir() { return this->_readings[CH_IR]; }
 	
-	virtual std::map<std::string,float> values(void) const {
-		std::map<std::string,float> ret;
-		ret["l_vis"] = this->_visible;
-		ret["l_ir"] = this->_ir;
-		return ret;
-	}
+	virtual size_t channelCount(void) const { return CHANNELS; }
+	virtual const Channel* channels(void) const { return CHANNEL_TABLE; }
+	virtual const float* readings(void) const { return this->_readings; }
 	
 	static const int DEVICE_ADDRESS = 0x39;
 };